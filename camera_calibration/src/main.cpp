@@ -7,6 +7,9 @@
 #include <iostream>
 #include <ctime>
 
+#include "fdcl_calibrator.hpp"
+#include "fdcl_frame_selection.hpp"
+
 using namespace std;
 using namespace cv;
 
@@ -16,7 +19,10 @@ const char* about =
         "Calibration using a ArUco Planar Grid board\n"
         "  To capture a frame for calibration, press 'c',\n"
         "  If input comes from video, press any key for next frame\n"
-        "  To finish capturing, press 'ESC' key and calibration starts.\n";
+        "  The calibration is updated in the background as frames are captured,\n"
+        "  frames too close to a captured one are rejected.\n"
+        "  To finish capturing, press 'ESC' key and the final calibration starts.\n"
+        "  With -b, the frames of the video given with -v are selected automatically.\n";
 const char* keys  =
         "{w        |       | Number of squares in X direction }"
         "{h        |       | Number of squares in Y direction }"
@@ -34,7 +40,12 @@ const char* keys  =
         "{zt       | false | Assume zero tangential distortion }"
         "{a        |       | Fix aspect ratio (fx/fy) to this value }"
         "{pc       | false | Fix the principal point at the center }"
-        "{waitkey  | 10    | Time in milliseconds to wait for key press }";
+        "{mc       | 0.03  | Minimum mean motion of the marker corners from any captured frame, "
+        "relative to the image diagonal, for a frame to be captured }"
+        "{waitkey  | 10    | Time in milliseconds to wait for key press }"
+        "{b        | false | Batch mode: detect the board on every frame of the video given with -v "
+        "in parallel, select the frames and calibrate, without any window }"
+        "{n        | 40    | Number of frames to select in batch mode }";
 }
 
 /**
@@ -109,6 +120,70 @@ static bool saveCameraParams(const string &filename, Size imageSize, float aspec
 
 
 
+/**
+ */
+static int saveCalibration(const string &filename, Size imageSize, float aspectRatio, int flags,
+                           const Mat &cameraMatrix, const Mat &distCoeffs, double totalAvgErr) {
+    bool saveOk = saveCameraParams(filename, imageSize, aspectRatio, flags, cameraMatrix,
+                                   distCoeffs, totalAvgErr);
+
+    if(!saveOk) {
+        cerr << "Cannot save output file" << endl;
+        return 0;
+    }
+
+    cout << "Rep Error: " << totalAvgErr << endl;
+    cout << "Calibration saved to " << filename << endl;
+
+    return 0;
+}
+
+
+
+/**
+ * Detects the board on every frame of the video in parallel, selects up to nFrames frames
+ * by pose diversity and corner coverage and calibrates on them. Returns the reprojection
+ * error, or -1 if there is nothing to calibrate on.
+ */
+static double calibrateFromVideo(const string &video, const Ptr<aruco::Dictionary> &dictionary,
+                                 const Ptr<aruco::DetectorParameters> &detectorParams,
+                                 const Ptr<aruco::Board> &board, bool refindStrategy, int nFrames,
+                                 int calibrationFlags, float aspectRatio, Size &imgSize,
+                                 Mat &cameraMatrix, Mat &distCoeffs) {
+    int64 start = getTickCount();
+    vector< fdcl::FrameView > frames;
+    int minMarkers = min(4, (int)board->ids.size());
+    int decoded = fdcl::detect_video_views(video, dictionary, detectorParams, board, refindStrategy,
+                                           minMarkers, frames, imgSize);
+    if(decoded < 0) {
+        cerr << "failed to open video input: " << video << endl;
+        return -1;
+    }
+    cout << "Board found on " << frames.size() << " of " << decoded << " frames in "
+         << (getTickCount() - start) / getTickFrequency() << " s with " << getNumThreads()
+         << " threads" << endl;
+
+    vector< int > selection = fdcl::select_views(frames, nFrames, (int)board->ids.size());
+    if(selection.empty()) {
+        cerr << "Not enough captures for calibration" << endl;
+        return -1;
+    }
+
+    vector< fdcl::CalibrationView > views;
+    cout << "Selected frames:";
+    for(size_t i = 0; i < selection.size(); i++) {
+        views.push_back(frames[selection[i]].view);
+        cout << " " << frames[selection[i]].frame;
+    }
+    cout << endl;
+
+    vector< Mat > rvecs, tvecs;
+    return fdcl::calibrate_views(views, board, imgSize, calibrationFlags, aspectRatio, cameraMatrix,
+                                 distCoeffs, rvecs, tvecs);
+}
+
+
+
 /**
  */
 int main(int argc, char *argv[]) {
@@ -154,12 +229,40 @@ int main(int argc, char *argv[]) {
     }
 
     int waitTime = parser.get<int>("waitkey");
+    double minViewChange = parser.get<double>("mc");
+    bool batchMode = parser.get<bool>("b");
+    int nFrames = parser.get<int>("n");
 
     if(!parser.check()) {
         parser.printErrors();
         return 0;
     }
 
+    Ptr<aruco::Dictionary> dictionary =
+        aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionaryId));
+
+    // create board object
+    Ptr<aruco::GridBoard> gridboard =
+            aruco::GridBoard::create(markersX, markersY, markerLength, markerSeparation, dictionary);
+    Ptr<aruco::Board> board = gridboard.staticCast<aruco::Board>();
+
+    if(batchMode) {
+        if(video.empty()) {
+            cerr << "Batch mode needs a video file (-v)" << endl;
+            return 0;
+        }
+
+        Size imgSize;
+        Mat cameraMatrix, distCoeffs;
+        double repError = calibrateFromVideo(video, dictionary, detectorParams, board, refindStrategy,
+                                             nFrames, calibrationFlags, aspectRatio, imgSize,
+                                             cameraMatrix, distCoeffs);
+        if(repError < 0) return 0;
+
+        return saveCalibration(outputFile, imgSize, aspectRatio, calibrationFlags, cameraMatrix,
+                               distCoeffs, repError);
+    }
+
     String videoInput;
     VideoCapture inputVideo;
 
@@ -177,17 +280,9 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
-    Ptr<aruco::Dictionary> dictionary =
-        aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionaryId));
-
-    // create board object
-    Ptr<aruco::GridBoard> gridboard =
-            aruco::GridBoard::create(markersX, markersY, markerLength, markerSeparation, dictionary);
-    Ptr<aruco::Board> board = gridboard.staticCast<aruco::Board>();
-
-    // collected frames for calibration
-    vector< vector< vector< Point2f > > > allCorners;
-    vector< vector< int > > allIds;
+    // calibrated in the background from the captured frames, created with
+    // the first frame as it needs the image size
+    Ptr<fdcl::IncrementalCalibrator> calibrator;
     Size imgSize;
 
     while(inputVideo.grab()) {
@@ -203,24 +298,37 @@ int main(int argc, char *argv[]) {
         // refind strategy to detect more markers
         if(refindStrategy) aruco::refineDetectedMarkers(image, board, corners, ids, rejected);
 
+        if(!calibrator) {
+            imgSize = image.size();
+            calibrator = makePtr< fdcl::IncrementalCalibrator >(board, imgSize, calibrationFlags,
+                                                              aspectRatio, minViewChange);
+        }
+
         // draw results
         image.copyTo(imageCopy);
         if(ids.size() > 0) aruco::drawDetectedMarkers(imageCopy, corners, ids);
         putText(imageCopy, "Press 'c' to add current frame. 'ESC' to finish and calibrate",
                 Point(10, 20), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 0, 0), 2);
 
+        // running calibration, one line of the report after the other
+        stringstream report(calibrator->report());
+        string line;
+        for(int y = 45; getline(report, line); y += 25)
+            putText(imageCopy, line, Point(10, y), FONT_HERSHEY_SIMPLEX, 0.5, Scalar(255, 0, 0), 2);
+
         imshow("out", imageCopy);
         char key = (char)waitKey(waitTime);
         if(key == 27) break;
-        if(key == 'c' && ids.size() > 0) {
-            cout << "Frame captured" << endl;
-            allCorners.push_back(corners);
-            allIds.push_back(ids);
-            imgSize = image.size();
+        if(key == 'c') {
+            string reason;
+            if(calibrator->add_view(corners, ids, &reason))
+                cout << "Frame captured" << endl;
+            else
+                cout << "Frame not captured: " << reason << endl;
         }
     }
 
-    if(allIds.size() < 1) {
+    if(!calibrator || calibrator->view_count() < 1) {
         cerr << "Not enough captures for calibration" << endl;
         return 0;
     }
@@ -229,38 +337,9 @@ int main(int argc, char *argv[]) {
     vector< Mat > rvecs, tvecs;
     double repError;
 
-    if(calibrationFlags & CALIB_FIX_ASPECT_RATIO) {
-        cameraMatrix = Mat::eye(3, 3, CV_64F);
-        cameraMatrix.at< double >(0, 0) = aspectRatio;
-    }
-
-    // prepare data for calibration
-    vector< vector< Point2f > > allCornersConcatenated;
-    vector< int > allIdsConcatenated;
-    vector< int > markerCounterPerFrame;
-    markerCounterPerFrame.reserve(allCorners.size());
-    for(unsigned int i = 0; i < allCorners.size(); i++) {
-        markerCounterPerFrame.push_back((int)allCorners[i].size());
-        for(unsigned int j = 0; j < allCorners[i].size(); j++) {
-            allCornersConcatenated.push_back(allCorners[i][j]);
-            allIdsConcatenated.push_back(allIds[i][j]);
-        }
-    }
-    // calibrate camera
-    repError = aruco::calibrateCameraAruco(allCornersConcatenated, allIdsConcatenated,
-                                           markerCounterPerFrame, board, imgSize, cameraMatrix,
-                                           distCoeffs, rvecs, tvecs, calibrationFlags);
+    // calibrate camera over all the frames, starting from the running estimate
+    repError = calibrator->finish(cameraMatrix, distCoeffs, rvecs, tvecs);
 
-    bool saveOk = saveCameraParams(outputFile, imgSize, aspectRatio, calibrationFlags, cameraMatrix,
-                                   distCoeffs, repError);
-
-    if(!saveOk) {
-        cerr << "Cannot save output file" << endl;
-        return 0;
-    }
-
-    cout << "Rep Error: " << repError << endl;
-    cout << "Calibration saved to " << outputFile << endl;
-
-    return 0;
+    return saveCalibration(outputFile, imgSize, aspectRatio, calibrationFlags, cameraMatrix,
+                           distCoeffs, repError);
 }
@@ -0,0 +1,330 @@
+#ifndef __FDCL_CALIBRATOR_HPP__
+#define __FDCL_CALIBRATOR_HPP__
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+#include <condition_variable>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fdcl_pipeline.hpp"
+
+namespace fdcl {
+    /**
+     * Markers of one board view, as detectMarkers returns them.
+     */
+    struct CalibrationView {
+        std::vector<std::vector<cv::Point2f> > corners;
+        std::vector<int> ids;
+    };
+
+    // The image is split into coverage_rows x coverage_cols cells to tell
+    // how much of it the corners of the views cover.
+    const int coverage_rows = 6;
+    const int coverage_cols = 8;
+
+    inline int coverage_cell(const cv::Point2f &p, cv::Size image_size) {
+        int col = (int)(p.x * coverage_cols / image_size.width);
+        int row = (int)(p.y * coverage_rows / image_size.height);
+        col = std::min(std::max(col, 0), coverage_cols - 1);
+        row = std::min(std::max(row, 0), coverage_rows - 1);
+        return row * coverage_cols + col;
+    }
+
+    /**
+     * calibrateCameraAruco over the markers of all the views. camera_matrix
+     * and dist_coeffs are the starting point with CALIB_USE_INTRINSIC_GUESS;
+     * without it, a CALIB_FIX_ASPECT_RATIO camera matrix starts with the
+     * given aspect ratio.
+     */
+    inline double calibrate_views(const std::vector<CalibrationView> &views,
+        const cv::Ptr<cv::aruco::Board> &board, cv::Size image_size, int flags,
+        double aspect_ratio, cv::Mat &camera_matrix, cv::Mat &dist_coeffs,
+        std::vector<cv::Mat> &rvecs, std::vector<cv::Mat> &tvecs,
+        cv::TermCriteria criteria = cv::TermCriteria(cv::TermCriteria::COUNT +
+            cv::TermCriteria::EPS, 30, DBL_EPSILON)) {
+        std::vector<std::vector<cv::Point2f> > corners;
+        std::vector<int> ids, counter;
+        counter.reserve(views.size());
+        for (size_t v = 0; v < views.size(); v++) {
+            counter.push_back((int)views[v].ids.size());
+            corners.insert(corners.end(), views[v].corners.begin(),
+                views[v].corners.end());
+            ids.insert(ids.end(), views[v].ids.begin(), views[v].ids.end());
+        }
+
+        if (!(flags & cv::CALIB_USE_INTRINSIC_GUESS)) {
+            camera_matrix = cv::Mat::eye(3, 3, CV_64F);
+            camera_matrix.at<double>(0, 0) = aspect_ratio;
+            dist_coeffs = cv::Mat();
+        }
+        return cv::aruco::calibrateCameraAruco(corners, ids, counter, board,
+            image_size, camera_matrix, dist_coeffs, rvecs, tvecs, flags,
+            criteria);
+    }
+
+    /**
+     * Camera calibration on a marker board that is solved again in a
+     * background thread whenever views are added, so the running intrinsics,
+     * reprojection error and image coverage can be shown while capturing.
+     * Each solve starts from the previous estimate and is capped to a few
+     * iterations, the next one carrying on from there; the final solve over
+     * all the views starts from the running estimate too.
+     * A view whose markers barely moved from an already added view brings
+     * no new constraint and is rejected as redundant.
+     */
+    class IncrementalCalibrator {
+    public:
+        struct Estimate {
+            cv::Mat camera_matrix, dist_coeffs;
+            double rms;       // reprojection error in pixels
+            int views;        // views it was solved from, 0 before the first solve
+            double solve_ms;
+        };
+
+        // flags and aspect_ratio as for calibrateCameraAruco; a view must
+        // move its shared corners by min_view_change of the image diagonal
+        // on average to be added.
+        IncrementalCalibrator(const cv::Ptr<cv::aruco::Board> &board,
+            cv::Size image_size, int flags = 0, double aspect_ratio = 1,
+            double min_view_change = 0.03)
+            : board_(board), image_size_(image_size), flags_(flags),
+              aspect_ratio_(aspect_ratio),
+              min_view_change_(min_view_change), redundant_(0),
+              cells_(coverage_rows * coverage_cols, 0), solved_views_(0),
+              stopping_(false) {
+            estimate_.rms = 0;
+            estimate_.views = 0;
+            estimate_.solve_ms = 0;
+            solver_ = std::thread(&IncrementalCalibrator::solve_loop, this);
+        }
+
+        ~IncrementalCalibrator() {
+            stop();
+        }
+
+        // Adds a view unless it has no marker or is redundant, in which case
+        // reason tells why.
+        bool add_view(const std::vector<std::vector<cv::Point2f> > &corners,
+            const std::vector<int> &ids, std::string *reason = nullptr) {
+            CV_Assert(corners.size() == ids.size());
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (ids.empty()) {
+                if (reason) {
+                    *reason = "no marker";
+                }
+                return false;
+            }
+
+            double diagonal = std::hypot((double)image_size_.width,
+                (double)image_size_.height);
+            for (size_t v = 0; v < views_.size(); v++) {
+                double motion = 0;
+                int shared = 0;
+                for (size_t i = 0; i < ids.size(); i++) {
+                    const std::vector<int> &kept_ids = views_[v].ids;
+                    size_t j = std::find(kept_ids.begin(), kept_ids.end(),
+                        ids[i]) - kept_ids.begin();
+                    if (j == kept_ids.size()) {
+                        continue;
+                    }
+                    for (int c = 0; c < 4; c++) {
+                        motion += cv::norm(corners[i][c] -
+                            views_[v].corners[j][c]);
+                    }
+                    shared++;
+                }
+
+                // most of the markers are in both views, at the same place
+                if (2 * shared >= (int)std::min(ids.size(), views_[v].ids.size()) &&
+                    motion / (4 * shared) < min_view_change_ * diagonal) {
+                    redundant_++;
+                    if (reason) {
+                        std::ostringstream out;
+                        out << "redundant with view " << v + 1;
+                        *reason = out.str();
+                    }
+                    return false;
+                }
+            }
+
+            CalibrationView view;
+            view.corners = corners;
+            view.ids = ids;
+            views_.push_back(view);
+            for (size_t i = 0; i < corners.size(); i++) {
+                for (int c = 0; c < 4; c++) {
+                    cells_[coverage_cell(corners[i][c], image_size_)]++;
+                }
+            }
+            updated_.notify_one();
+            return true;
+        }
+
+        size_t view_count() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return views_.size();
+        }
+
+        // Fraction of the image cells holding at least one corner.
+        double coverage() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return coverage_locked();
+        }
+
+        Estimate estimate() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            Estimate estimate = estimate_;
+            estimate.camera_matrix = estimate_.camera_matrix.clone();
+            estimate.dist_coeffs = estimate_.dist_coeffs.clone();
+            return estimate;
+        }
+
+        // "views n (m redundant), coverage x%, rms y px over k views", then
+        // the running intrinsics once there are some.
+        std::string report() const {
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(1) << "views "
+                << views_.size() << " (" << redundant_ << " redundant), coverage "
+                << 100 * coverage_locked() << "%";
+            if (estimate_.views > 0) {
+                const cv::Mat &k = estimate_.camera_matrix;
+                out << std::setprecision(3) << ", rms " << estimate_.rms
+                    << " px over " << estimate_.views << " views\n"
+                    << std::setprecision(1) << "fx " << k.at<double>(0, 0)
+                    << " fy " << k.at<double>(1, 1) << " cx "
+                    << k.at<double>(0, 2) << " cy " << k.at<double>(1, 2)
+                    << ", solved in " << estimate_.solve_ms << " ms";
+            }
+            return out.str();
+        }
+
+        // Stops the background solver and runs the full optimization over all
+        // the views, starting from the running estimate. Returns the
+        // reprojection error, or -1 without any view.
+        double finish(cv::Mat &camera_matrix, cv::Mat &dist_coeffs,
+            std::vector<cv::Mat> &rvecs, std::vector<cv::Mat> &tvecs) {
+            stop();
+
+            std::vector<CalibrationView> views;
+            Estimate start;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                views = views_;
+                start = estimate_;
+            }
+            if (views.empty()) {
+                return -1;
+            }
+            return solve(views, start, camera_matrix, dist_coeffs, rvecs,
+                tvecs, cv::TermCriteria(cv::TermCriteria::COUNT +
+                    cv::TermCriteria::EPS, 30, DBL_EPSILON));
+        }
+
+    private:
+        // Solves again whenever views were added; the views added during a
+        // solve are all taken by the next one.
+        void solve_loop() {
+            std::vector<CalibrationView> views;
+            for (;;) {
+                Estimate start;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    updated_.wait(lock, [this]() {
+                        return stopping_ || views_.size() != solved_views_;
+                    });
+                    if (stopping_) {
+                        return;
+                    }
+                    views = views_;
+                    start = estimate_;
+                }
+
+                // fewer views leave the intrinsics poorly constrained
+                Estimate next = start;
+                if (views.size() >= min_views) {
+                    std::vector<cv::Mat> rvecs, tvecs;
+                    int64_t begin = now_ns();
+                    try {
+                        next.rms = solve(views, start, next.camera_matrix,
+                            next.dist_coeffs, rvecs, tvecs,
+                            cv::TermCriteria(cv::TermCriteria::COUNT +
+                                cv::TermCriteria::EPS, running_iterations,
+                                DBL_EPSILON));
+                        next.views = (int)views.size();
+                        next.solve_ms = (now_ns() - begin) / 1e6;
+                    } catch (const cv::Exception &) {
+                        // degenerate views; keep the previous estimate
+                        next = start;
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                estimate_ = next;
+                solved_views_ = views.size();
+            }
+        }
+
+        double solve(const std::vector<CalibrationView> &views,
+            const Estimate &start, cv::Mat &camera_matrix,
+            cv::Mat &dist_coeffs, std::vector<cv::Mat> &rvecs,
+            std::vector<cv::Mat> &tvecs, cv::TermCriteria criteria) const {
+            int flags = flags_;
+            if (start.views > 0) {
+                camera_matrix = start.camera_matrix.clone();
+                dist_coeffs = start.dist_coeffs.clone();
+                flags |= cv::CALIB_USE_INTRINSIC_GUESS;
+            }
+            return calibrate_views(views, board_, image_size_, flags,
+                aspect_ratio_, camera_matrix, dist_coeffs, rvecs, tvecs,
+                criteria);
+        }
+
+        void stop() {
+            if (!solver_.joinable()) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            updated_.notify_all();
+            solver_.join();
+        }
+
+        double coverage_locked() const {
+            int covered = 0;
+            for (size_t i = 0; i < cells_.size(); i++) {
+                covered += cells_[i] > 0 ? 1 : 0;
+            }
+            return (double)covered / cells_.size();
+        }
+
+        static const size_t min_views = 3;
+        static const int running_iterations = 10;
+
+        cv::Ptr<cv::aruco::Board> board_;
+        cv::Size image_size_;
+        int flags_;
+        double aspect_ratio_;
+        double min_view_change_;
+
+        std::vector<CalibrationView> views_;
+        int redundant_;
+        std::vector<int> cells_; // corners in each coverage cell
+
+        Estimate estimate_;
+        size_t solved_views_;
+        bool stopping_;
+        mutable std::mutex mutex_;
+        std::condition_variable updated_;
+        std::thread solver_;
+    };
+}
+
+#endif
@@ -16,6 +16,16 @@ namespace fdcl {
         "{h        |false | Print help }"
         "{v        |<none>| Custom video source, otherwise '0' }"
         "{l        |      | Actual marker length in meter }"
+        "{rp       |drop  | Recording policy when the encoder falls behind: "
+        "drop, drop-oldest, block }"
+        "{rb       |8     | Recording buffer size in frames }"
+        "{t        |0     | Track markers between full-frame detections, "
+        "which run every t frames; 0 detects on every frame }"
+        "{f        |0     | Smooth marker poses with a constant-velocity "
+        "filter of this gain in (0, 1], whose prediction also seeds solvePnP; "
+        "0 disables it }"
+        "{s        |false | Print detector statistics once per second, to tune "
+        "the detector parameters }"
         ;
 }
 
@@ -0,0 +1,233 @@
+#ifndef __FDCL_FRAME_SELECTION_HPP__
+#define __FDCL_FRAME_SELECTION_HPP__
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "fdcl_calibrator.hpp"
+
+namespace fdcl {
+    /**
+     * Board seen on one frame of a video. The pose comes from a guessed
+     * camera, which is enough to tell how different two frames are.
+     */
+    struct FrameView {
+        int frame;
+        CalibrationView view;
+        cv::Matx33d rotation;
+        cv::Vec3d tvec;
+        uint64_t cells; // bit i set when coverage cell i holds a corner
+    };
+
+    // Pinhole camera with a 53 degree field of view across the largest side
+    // of the image and no distortion.
+    inline cv::Mat guess_camera_matrix(cv::Size image_size) {
+        double f = std::max(image_size.width, image_size.height);
+        return (cv::Mat_<double>(3, 3) << f, 0, image_size.width / 2.0,
+            0, f, image_size.height / 2.0, 0, 0, 1);
+    }
+
+    /**
+     * Moves video to frame, and checks that it got there. Many backends
+     * seek to the nearest keyframe instead, so the position is read back and
+     * the frames up to the requested one are grabbed. Returns false when the
+     * position cannot be trusted: the backend does not report it, it is past
+     * frame, or it does not follow the grabbed frames.
+     */
+    inline bool seek_frame(cv::VideoCapture &video, int frame) {
+        if (frame == 0) {
+            return true;
+        }
+        video.set(cv::CAP_PROP_POS_FRAMES, frame);
+        int position = (int)video.get(cv::CAP_PROP_POS_FRAMES);
+        if (position < 0 || position > frame) {
+            return false;
+        }
+        if (position == frame) {
+            return true;
+        }
+        for (int f = position; f < frame; f++) {
+            if (!video.grab()) {
+                return false;
+            }
+        }
+        return (int)video.get(cv::CAP_PROP_POS_FRAMES) == frame;
+    }
+
+    /**
+     * Decodes a whole video in one chunk of frames per thread, each chunk
+     * seeking to its first frame with its own cv::VideoCapture, and detects
+     * the board on every frame. The last chunk reads up to the end of the
+     * file, as the frame count is often an estimate. If a chunk cannot get
+     * to its first frame exactly, the video is decoded again in a single
+     * chunk, so that no frame is skipped or read twice. frames gets the
+     * frames with at least min_markers markers, in frame order. Returns the
+     * number of frames decoded, or -1 if the video cannot be opened.
+     */
+    inline int detect_video_views(const std::string &filename,
+        const cv::Ptr<cv::aruco::Dictionary> &dictionary,
+        const cv::Ptr<cv::aruco::DetectorParameters> &params,
+        const cv::Ptr<cv::aruco::Board> &board, bool refind, int min_markers,
+        std::vector<FrameView> &frames, cv::Size &image_size) {
+        cv::VideoCapture probe(filename);
+        if (!probe.isOpened()) {
+            return -1;
+        }
+        int count = (int)probe.get(cv::CAP_PROP_FRAME_COUNT);
+        image_size = cv::Size((int)probe.get(cv::CAP_PROP_FRAME_WIDTH),
+            (int)probe.get(cv::CAP_PROP_FRAME_HEIGHT));
+        probe.release();
+
+        // without a frame count the video is decoded in a single chunk
+        int nchunks = count > 0 ?
+            std::max(1, std::min(count, cv::getNumThreads())) : 1;
+        const cv::Mat camera_matrix = guess_camera_matrix(image_size);
+        std::vector<std::vector<FrameView> > found;
+        std::vector<int> decoded;
+        std::atomic<bool> seek_failed(false);
+
+        auto decode_chunk = [&](int c) {
+            const int begin = (int)((int64_t)count * c / nchunks);
+            const int end = c + 1 < nchunks ?
+                (int)((int64_t)count * (c + 1) / nchunks) : INT_MAX;
+            cv::VideoCapture video(filename);
+            if (!seek_frame(video, begin)) {
+                seek_failed = true;
+                return;
+            }
+            cv::Ptr<cv::aruco::ArucoDetector> detector =
+                cv::aruco::ArucoDetector::create(dictionary, params);
+
+            cv::Mat image;
+            std::vector<std::vector<cv::Point2f> > rejected;
+            for (int f = begin; f < end && !seek_failed && video.read(image);
+                f++) {
+                decoded[c]++;
+                FrameView view;
+                detector->detectMarkers(image, view.view.corners,
+                    view.view.ids, rejected);
+                if (refind) {
+                    cv::aruco::refineDetectedMarkers(image, board,
+                        view.view.corners, view.view.ids, rejected);
+                }
+                if ((int)view.view.ids.size() < min_markers) {
+                    continue;
+                }
+
+                cv::Vec3d rvec;
+                if (cv::aruco::estimatePoseBoard(view.view.corners,
+                        view.view.ids, board, camera_matrix, cv::Mat(),
+                        rvec, view.tvec) == 0) {
+                    continue;
+                }
+                cv::Rodrigues(rvec, view.rotation);
+                view.frame = f;
+                view.cells = 0;
+                for (size_t i = 0; i < view.view.corners.size(); i++) {
+                    for (int k = 0; k < 4; k++) {
+                        view.cells |= (uint64_t)1 << coverage_cell(
+                            view.view.corners[i][k], image_size);
+                    }
+                }
+                found[c].push_back(view);
+            }
+        };
+
+        found.assign(nchunks, std::vector<FrameView>());
+        decoded.assign(nchunks, 0);
+        cv::parallel_for_(cv::Range(0, nchunks), [&](const cv::Range &range) {
+            for (int c = range.start; c < range.end; c++) {
+                decode_chunk(c);
+            }
+        });
+        if (seek_failed) {
+            // the first chunk does not seek, so this one cannot fail
+            nchunks = 1;
+            found.assign(1, std::vector<FrameView>());
+            decoded.assign(1, 0);
+            seek_failed = false;
+            decode_chunk(0);
+        }
+
+        int total = 0;
+        frames.clear();
+        for (int c = 0; c < nchunks; c++) {
+            frames.insert(frames.end(), found[c].begin(), found[c].end());
+            total += decoded[c];
+        }
+        return total;
+    }
+
+    /**
+     * Picks up to count frames for calibration, greedily: each pick is the
+     * frame that adds the most coverage cells and whose pose is the most
+     * different from the frames already picked, with a bonus for the
+     * frames showing more of the board. Poses closer than max_angle in
+     * rotation and max_shift of the distance to the board in translation
+     * only partly count as different. Frames that add neither coverage nor
+     * a new pose are never picked, so fewer frames than count may come back.
+     * Returns indices into frames, in frame order.
+     */
+    inline std::vector<int> select_views(const std::vector<FrameView> &frames,
+        int count, int board_markers, double max_angle = 0.35,
+        double max_shift = 0.2) {
+        const int ncells = coverage_rows * coverage_cols;
+        std::vector<double> novelty(frames.size(), 1.0);
+        std::vector<bool> picked(frames.size(), false);
+        std::vector<int> selection;
+        uint64_t covered = 0;
+
+        while ((int)selection.size() < count) {
+            int best = -1;
+            double best_score = 0;
+            for (size_t i = 0; i < frames.size(); i++) {
+                if (picked[i]) {
+                    continue;
+                }
+                int gain = 0;
+                for (uint64_t cells = frames[i].cells & ~covered; cells;
+                    cells &= cells - 1) {
+                    gain++;
+                }
+                // a repeated pose adding no cell brings nothing
+                if (gain == 0 && novelty[i] < 0.25) {
+                    continue;
+                }
+                double score = novelty[i] + 2.0 * gain / ncells + 0.25 *
+                    frames[i].view.ids.size() / board_markers;
+                if (score > best_score) {
+                    best = (int)i;
+                    best_score = score;
+                }
+            }
+            if (best < 0) {
+                break;
+            }
+
+            picked[best] = true;
+            selection.push_back(best);
+            covered |= frames[best].cells;
+
+            // novelty is the distance to the closest picked pose, up to 1
+            const FrameView &p = frames[best];
+            for (size_t i = 0; i < frames.size(); i++) {
+                double c = (cv::trace(frames[i].rotation.t() * p.rotation) - 1) / 2;
+                double angle = std::acos(std::min(std::max(c, -1.0), 1.0));
+                double shift = cv::norm(frames[i].tvec - p.tvec) /
+                    (max_shift * cv::norm(p.tvec));
+                novelty[i] = std::min(novelty[i],
+                    std::min(1.0, angle / max_angle + shift));
+            }
+        }
+
+        std::sort(selection.begin(), selection.end());
+        return selection;
+    }
+}
+
+#endif
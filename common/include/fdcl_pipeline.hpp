@@ -0,0 +1,147 @@
+#ifndef __FDCL_PIPELINE_HPP__
+#define __FDCL_PIPELINE_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fdcl {
+    typedef std::chrono::steady_clock pipeline_clock;
+
+    inline int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            pipeline_clock::now().time_since_epoch()).count();
+    }
+
+    /**
+     * Bounded lock-free queue between exactly one producer thread and one
+     * consumer thread. Items are moved in and out, so a cv::Mat only hands
+     * over its reference count, never the pixels.
+     */
+    template <typename T>
+    class SpscQueue {
+    public:
+        explicit SpscQueue(size_t capacity)
+            : slots_(capacity + 1), head_(0), tail_(0) {}
+
+        bool try_push(T &item) {
+            const size_t tail = tail_.load(std::memory_order_relaxed);
+            const size_t next = increment(tail);
+            if (next == head_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            slots_[tail] = std::move(item);
+            tail_.store(next, std::memory_order_release);
+            return true;
+        }
+
+        bool try_pop(T &item) {
+            const size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) {
+                return false;
+            }
+            item = std::move(slots_[head]);
+            slots_[head] = T();
+            head_.store(increment(head), std::memory_order_release);
+            return true;
+        }
+
+        // Blocks the producer while the queue is full (back-pressure).
+        bool push(T &item, const std::atomic<bool> &stop) {
+            while (!try_push(item)) {
+                if (stop.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                std::this_thread::yield();
+            }
+            return true;
+        }
+
+        // Blocks the consumer until an item arrives, or the producer is done
+        // and everything it pushed has been drained.
+        bool pop(T &item, const std::atomic<bool> &producer_done,
+            const std::atomic<bool> &stop) {
+            while (!try_pop(item)) {
+                if (stop.load(std::memory_order_relaxed)) {
+                    return false;
+                }
+                if (producer_done.load(std::memory_order_acquire)) {
+                    return try_pop(item);
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            return true;
+        }
+
+        size_t capacity() const {
+            return slots_.size() - 1;
+        }
+
+    private:
+        size_t increment(size_t i) const {
+            return (i + 1 == slots_.size()) ? 0 : i + 1;
+        }
+
+        std::vector<T> slots_;
+        alignas(64) std::atomic<size_t> head_;
+        alignas(64) std::atomic<size_t> tail_;
+    };
+
+    /**
+     * Latency counters of one pipeline stage. Updated by the stage thread,
+     * read (and reset) by whoever prints the report.
+     */
+    class StageStats {
+    public:
+        explicit StageStats(const std::string &name)
+            : name_(name), frames_(0), dropped_(0), total_ns_(0), max_ns_(0) {}
+
+        void record(int64_t elapsed_ns) {
+            frames_.fetch_add(1, std::memory_order_relaxed);
+            total_ns_.fetch_add(elapsed_ns, std::memory_order_relaxed);
+            int64_t prev = max_ns_.load(std::memory_order_relaxed);
+            while (elapsed_ns > prev &&
+                !max_ns_.compare_exchange_weak(prev, elapsed_ns,
+                    std::memory_order_relaxed)) {
+            }
+        }
+
+        void drop() {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // One line "name: n frames, avg x ms, max y ms, z dropped", then the
+        // counters start over for the next reporting period.
+        std::string report_and_reset() {
+            int64_t frames = frames_.exchange(0);
+            int64_t dropped = dropped_.exchange(0);
+            int64_t total = total_ns_.exchange(0);
+            int64_t max = max_ns_.exchange(0);
+
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(2) << std::setw(10)
+                << name_ << ": " << std::setw(4) << frames << " frames, avg "
+                << (frames > 0 ? total / 1e6 / frames : 0.0) << " ms, max "
+                << max / 1e6 << " ms";
+            if (dropped > 0) {
+                out << ", " << dropped << " dropped";
+            }
+            return out.str();
+        }
+
+    private:
+        std::string name_;
+        std::atomic<int64_t> frames_;
+        std::atomic<int64_t> dropped_;
+        std::atomic<int64_t> total_ns_;
+        std::atomic<int64_t> max_ns_;
+    };
+}
+
+#endif
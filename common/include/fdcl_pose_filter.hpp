@@ -0,0 +1,102 @@
+#ifndef __FDCL_POSE_FILTER_HPP__
+#define __FDCL_POSE_FILTER_HPP__
+
+#include <opencv2/opencv.hpp>
+
+namespace fdcl {
+    /**
+     * Smooths the pose of one marker across frames with a constant-velocity
+     * model on SE(3): the translation and the rotation keep the velocity
+     * they had on the last frame, and each measurement corrects the
+     * predicted pose and velocity with fixed gains. This is an alpha-beta
+     * filter, the steady state of a constant-velocity Kalman filter, with
+     * beta = alpha^2 / (2 - alpha).
+     * Rotations are corrected in the tangent space of the predicted
+     * rotation, so the filter never sees the wrap-around of rotation
+     * vectors at pi.
+     * The time step is one frame, so update() is called once per frame.
+     * A measurement too far from the prediction, such as an IPPE flip or a
+     * sudden motion, restarts the filter from that measurement.
+     */
+    class PoseFilter {
+    public:
+        // gain in (0, 1] is the weight of a measurement in the filtered pose;
+        // 1 follows the measurements and only predicts.
+        // max_translation_jump is relative to the distance to the marker.
+        explicit PoseFilter(double gain = 0.5, double max_rotation_jump = 0.35,
+            double max_translation_jump = 0.2)
+            : alpha_(gain), beta_(gain * gain / (2 - gain)),
+              max_rotation_jump_(max_rotation_jump),
+              max_translation_jump_(max_translation_jump),
+              initialized_(false) {
+            CV_Assert(gain > 0 && gain <= 1);
+        }
+
+        bool initialized() const {
+            return initialized_;
+        }
+
+        // Pose expected on the next frame.
+        void predict(cv::Vec3d &rvec, cv::Vec3d &tvec) const {
+            CV_Assert(initialized_);
+            cv::Rodrigues(predicted_rotation(), rvec);
+            tvec = t_ + v_;
+        }
+
+        // Corrects the prediction with the pose measured on this frame.
+        void update(const cv::Vec3d &rvec, const cv::Vec3d &tvec,
+            cv::Vec3d &filtered_rvec, cv::Vec3d &filtered_tvec) {
+            cv::Matx33d measured;
+            cv::Rodrigues(rvec, measured);
+
+            bool restart = !initialized_;
+            if (initialized_) {
+                cv::Matx33d predicted = predicted_rotation();
+                cv::Vec3d predicted_t = t_ + v_;
+                cv::Vec3d rotation_error, translation_error = tvec - predicted_t;
+                cv::Rodrigues(measured * predicted.t(), rotation_error);
+
+                if (cv::norm(rotation_error) <= max_rotation_jump_ &&
+                    cv::norm(translation_error) <=
+                        max_translation_jump_ * cv::norm(predicted_t)) {
+                    cv::Matx33d correction;
+                    cv::Rodrigues(alpha_ * rotation_error, correction);
+                    R_ = correction * predicted;
+                    t_ = predicted_t + alpha_ * translation_error;
+                    w_ += beta_ * rotation_error;
+                    v_ += beta_ * translation_error;
+                } else {
+                    restart = true;
+                }
+            }
+
+            if (restart) {
+                R_ = measured;
+                t_ = tvec;
+                w_ = v_ = cv::Vec3d(0, 0, 0);
+                initialized_ = true;
+            }
+            cv::Rodrigues(R_, filtered_rvec);
+            filtered_tvec = t_;
+        }
+
+        void reset() {
+            initialized_ = false;
+        }
+
+    private:
+        cv::Matx33d predicted_rotation() const {
+            cv::Matx33d step;
+            cv::Rodrigues(w_, step);
+            return step * R_;
+        }
+
+        double alpha_, beta_;
+        double max_rotation_jump_, max_translation_jump_;
+        bool initialized_;
+        cv::Matx33d R_;
+        cv::Vec3d t_, v_, w_; // w_ is a rotation vector per frame
+    };
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef __FDCL_RECORDER_HPP__
+#define __FDCL_RECORDER_HPP__
+
+#include <opencv2/opencv.hpp>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "fdcl_pipeline.hpp"
+
+namespace fdcl {
+    /**
+     * What VideoRecorder::write does when every slot of the ring buffer is
+     * still waiting for the encoder.
+     */
+    enum RecordingPolicy {
+        RECORD_DROP_NEWEST, // skip the frame being written
+        RECORD_DROP_OLDEST, // overwrite the oldest frame not yet encoded
+        RECORD_BLOCK        // wait for the encoder (no frame is ever lost)
+    };
+
+    inline bool parse_recording_policy(const std::string &name,
+        RecordingPolicy &policy) {
+        if (name == "drop") {
+            policy = RECORD_DROP_NEWEST;
+        } else if (name == "drop-oldest") {
+            policy = RECORD_DROP_OLDEST;
+        } else if (name == "block") {
+            policy = RECORD_BLOCK;
+        } else {
+            std::cerr << "Unknown recording policy: " << name << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * cv::VideoWriter running on its own thread. write() copies the frame into
+     * a preallocated buffer and swaps it into a slot of the ring; the encoder
+     * thread drains the ring, so the detection loop never waits for the JPEG
+     * encoder unless the policy is RECORD_BLOCK. write() is meant to be called
+     * from a single thread.
+     */
+    class VideoRecorder {
+    public:
+        VideoRecorder()
+            : policy_(RECORD_DROP_NEWEST), head_(0), count_(0),
+              stopping_(false), encode_stats_("encode") {}
+
+        ~VideoRecorder() {
+            close();
+        }
+
+        bool open(const std::string &filename, int fourcc, double fps,
+            cv::Size frame_size, RecordingPolicy policy, int capacity) {
+            CV_Assert(capacity >= 1);
+            close();
+            if (!writer_.open(filename, fourcc, fps, frame_size, true)) {
+                std::cerr << "Failed to open video output: " << filename << "\n";
+                return false;
+            }
+
+            policy_ = policy;
+            ring_.assign(capacity, cv::Mat());
+            for (size_t i = 0; i < ring_.size(); i++) {
+                ring_[i].create(frame_size, CV_8UC3);
+            }
+            spare_.create(frame_size, CV_8UC3);
+            head_ = 0;
+            count_ = 0;
+            stopping_ = false;
+            encoder_ = std::thread(&VideoRecorder::encode_loop, this);
+            return true;
+        }
+
+        bool isOpened() const {
+            return encoder_.joinable();
+        }
+
+        void write(const cv::Mat &frame) {
+            if (!isOpened()) {
+                return;
+            }
+
+            // only this thread adds frames, so a slot free now is still free
+            // once the frame is copied
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (count_ == ring_.size() && policy_ == RECORD_DROP_NEWEST) {
+                    encode_stats_.drop();
+                    return;
+                }
+            }
+            // the copy runs without the lock, so it never holds up the encoder
+            frame.copyTo(spare_);
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (count_ == ring_.size()) {
+                if (policy_ == RECORD_DROP_OLDEST) {
+                    head_ = (head_ + 1) % ring_.size();
+                    count_--;
+                    encode_stats_.drop();
+                } else {
+                    not_full_.wait(lock, [this]() {
+                        return count_ < ring_.size() || stopping_;
+                    });
+                    if (stopping_) {
+                        return;
+                    }
+                }
+            }
+
+            size_t tail = (head_ + count_) % ring_.size();
+            cv::swap(spare_, ring_[tail]);
+            count_++;
+            not_empty_.notify_one();
+        }
+
+        // Encodes whatever is still buffered and closes the file.
+        void close() {
+            if (!isOpened()) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+            }
+            not_empty_.notify_all();
+            not_full_.notify_all();
+            encoder_.join();
+            writer_.release();
+        }
+
+        // "encode: n frames, avg x ms, max y ms, z dropped" since last call
+        std::string report_and_reset() {
+            return encode_stats_.report_and_reset();
+        }
+
+    private:
+        void encode_loop() {
+            cv::Mat frame;
+            for (;;) {
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    not_empty_.wait(lock, [this]() {
+                        return count_ > 0 || stopping_;
+                    });
+                    if (count_ == 0) {
+                        return;
+                    }
+                    // swap the slot out so the producer can refill it while
+                    // this thread encodes
+                    cv::swap(frame, ring_[head_]);
+                    if (ring_[head_].empty()) {
+                        ring_[head_].create(frame.size(), frame.type());
+                    }
+                    head_ = (head_ + 1) % ring_.size();
+                    count_--;
+                }
+                not_full_.notify_one();
+
+                int64_t start = now_ns();
+                writer_.write(frame);
+                encode_stats_.record(now_ns() - start);
+            }
+        }
+
+        cv::VideoWriter writer_;
+        RecordingPolicy policy_;
+
+        std::vector<cv::Mat> ring_;
+        cv::Mat spare_; // next frame, copied by write() before taking a slot
+        size_t head_;
+        size_t count_;
+        bool stopping_;
+        std::mutex mutex_;
+        std::condition_variable not_empty_;
+        std::condition_variable not_full_;
+        std::thread encoder_;
+
+        StageStats encode_stats_;
+    };
+}
+
+#endif
@@ -0,0 +1,356 @@
+#ifndef __FDCL_TRACKER_HPP__
+#define __FDCL_TRACKER_HPP__
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "fdcl_pose_filter.hpp"
+
+namespace fdcl {
+    /**
+     * Runs cv::aruco::detectMarkers on the full frame only every
+     * redetect_interval frames, or right away when a tracked marker is lost.
+     * On the frames in between markers are only searched inside padded boxes
+     * around their last corners, and their last pose seeds solvePnP.
+     * A redetect_interval of 0 detects every frame and never seeds solvePnP,
+     * which gives the same result as detectMarkers +
+     * estimatePoseSingleMarkers.
+     * Full frame and region detections reuse the buffers of one
+     * cv::aruco::ArucoDetector, whose statistics detector_report_and_reset()
+     * prints.
+     * With filter_poses() each tracked marker also gets a PoseFilter, and the
+     * filtered poses are returned. solvePnP then starts from the IPPE pose of
+     * the marker, the one of its two IPPE solutions closest to the
+     * prediction of the filter, which rules out flips.
+     */
+    class MarkerTracker {
+    public:
+        MarkerTracker(const cv::Ptr<cv::aruco::Dictionary> &dictionary,
+            int redetect_interval, float roi_padding = 0.5f)
+            : params_(cv::aruco::DetectorParameters::create()),
+              detector_(cv::aruco::ArucoDetector::create(dictionary, params_)),
+              redetect_interval_(redetect_interval),
+              roi_padding_(roi_padding), filter_gain_(0),
+              frames_since_full_(0), last_was_full_(false) {}
+
+        // Gain of the PoseFilter of each marker, see PoseFilter; 0 disables
+        // the filters.
+        void filter_poses(double gain) {
+            CV_Assert(gain >= 0 && gain <= 1);
+            filter_gain_ = gain;
+            for (size_t t = 0; t < tracks_.size(); t++) {
+                tracks_[t].filter = PoseFilter(gain > 0 ? gain : 1);
+            }
+        }
+
+        void detect(const cv::Mat &image,
+            std::vector<std::vector<cv::Point2f> > &corners,
+            std::vector<int> &ids) {
+            if (redetect_interval_ > 0 && !tracks_.empty() &&
+                frames_since_full_ < redetect_interval_ &&
+                detect_in_rois(image, corners, ids)) {
+                frames_since_full_++;
+                last_was_full_ = false;
+                return;
+            }
+
+            detector_->detectMarkers(image, corners, ids);
+            frames_since_full_ = 1;
+            last_was_full_ = true;
+            update_tracks(corners, ids);
+        }
+
+        // corners and ids have to be the output of the last detect() call.
+        void estimate_pose(const std::vector<std::vector<cv::Point2f> > &corners,
+            const std::vector<int> &ids, float marker_length,
+            const cv::Mat &camera_matrix, const cv::Mat &dist_coeffs,
+            std::vector<cv::Vec3d> &rvecs, std::vector<cv::Vec3d> &tvecs) {
+            CV_Assert(corners.size() == ids.size());
+            const float half = marker_length / 2.f;
+            const std::vector<cv::Point3f> object_points = {
+                cv::Point3f(-half, half, 0), cv::Point3f(half, half, 0),
+                cv::Point3f(half, -half, 0), cv::Point3f(-half, -half, 0)
+            };
+            const bool tracked = ids.size() == tracks_.size();
+            if (filter_gain_ > 0) {
+                estimate_filtered_pose(corners, ids, marker_length, object_points,
+                    camera_matrix, dist_coeffs, tracked, rvecs, tvecs);
+                return;
+            }
+
+            rvecs.resize(ids.size());
+            tvecs.resize(ids.size());
+            seeds_.resize(ids.size());
+            for (size_t i = 0; i < ids.size(); i++) {
+                PoseSeed &seed = seeds_[i];
+                seed.tracked = tracked && redetect_interval_ > 0 &&
+                    tracks_[i].has_pose;
+                seed.predicted = false;
+                if (seed.tracked) {
+                    seed.rvec = rvecs[i] = tracks_[i].rvec;
+                    seed.tvec = tvecs[i] = tracks_[i].tvec;
+                }
+                cv::solvePnP(object_points, corners[i], camera_matrix,
+                    dist_coeffs, rvecs[i], tvecs[i], seed.tracked,
+                    cv::SOLVEPNP_ITERATIVE);
+                if (tracked) {
+                    tracks_[i].rvec = rvecs[i];
+                    tracks_[i].tvec = tvecs[i];
+                    tracks_[i].has_pose = true;
+                }
+            }
+        }
+
+        // Where solvePnP started from in the last estimate_pose(), and the
+        // prediction of the marker's filter if it had one. Without filters
+        // only the markers tracked from a previous pose have a start, solvePnP
+        // computing its own for the others.
+        struct PoseSeed {
+            cv::Vec3d rvec, tvec;
+            bool tracked;   // the marker had a pose from the previous frames
+            bool predicted;
+            cv::Vec3d predicted_rvec, predicted_tvec;
+        };
+
+        const std::vector<PoseSeed> &last_seeds() const {
+            return seeds_;
+        }
+
+        // Whether the last detect() searched the whole frame.
+        bool last_was_full() const {
+            return last_was_full_;
+        }
+
+        const cv::Ptr<cv::aruco::DetectorParameters> &parameters() const {
+            return params_;
+        }
+
+        // Two lines of where the detections since the last call spent their
+        // time and where their candidates were rejected, averaged per frame,
+        // then the statistics start over for the next reporting period.
+        std::string detector_report_and_reset() {
+            cv::aruco::DetectorStatistics s = detector_->getStatistics();
+            detector_->resetStatistics();
+            const double n = std::max(s.frames, 1);
+
+            std::ostringstream out;
+            out << std::fixed << std::setprecision(2) << std::setw(10)
+                << "detector" << ": " << std::setw(4) << s.frames
+                << " frames, avg " << s.totalTime / n << " ms: grey "
+                << s.greyTime / n << ", threshold " << s.thresholdTime / n
+                << ", contours " << s.contourTime / n << ", filter "
+                << s.filterTime / n << ", bits " << s.bitsTime / n
+                << ", identify " << s.identifyTime / n << ", refine "
+                << s.refineTime / n << "\n"
+                << std::setprecision(1) << std::setw(10) << "candidates"
+                << ": " << s.contours / n << " contours - "
+                << s.rejectedPerimeter / n << " perimeter - "
+                << s.rejectedShape / n << " shape - "
+                << s.rejectedCornerDistance / n << " corner distance - "
+                << s.rejectedImageBorder / n << " image border = "
+                << s.candidates / n << " quads - "
+                << s.rejectedTooClose / n << " too close - "
+                << s.rejectedBorderBits / n << " border bits - "
+                << s.rejectedDictionary / n << " dictionary = "
+                << s.markers / n << " markers";
+            return out.str();
+        }
+
+    private:
+        struct Track {
+            int id;
+            std::vector<cv::Point2f> corners;
+            cv::Vec3d rvec, tvec;
+            bool has_pose;
+            PoseFilter filter;
+        };
+
+        // Angle of the rotation between two rotation vectors.
+        static double rotation_angle(const cv::Vec3d &a, const cv::Vec3d &b) {
+            cv::Matx33d ra, rb;
+            cv::Rodrigues(a, ra);
+            cv::Rodrigues(b, rb);
+            cv::Vec3d difference;
+            cv::Rodrigues(ra * rb.t(), difference);
+            return cv::norm(difference);
+        }
+
+        // The IPPE poses of all the markers are solved at once. Markers seen
+        // for the first time start from the one with the lowest reprojection
+        // error, the others from the one closest to the prediction of their
+        // filter. Both are refined with the same solvePnP as without filters:
+        // the IPPE pose needs fewer iterations than the prediction, which
+        // lags behind when the marker accelerates.
+        void estimate_filtered_pose(
+            const std::vector<std::vector<cv::Point2f> > &corners,
+            const std::vector<int> &ids, float marker_length,
+            const std::vector<cv::Point3f> &object_points,
+            const cv::Mat &camera_matrix, const cv::Mat &dist_coeffs,
+            bool tracked, std::vector<cv::Vec3d> &rvecs,
+            std::vector<cv::Vec3d> &tvecs) {
+            cv::aruco::estimatePoseSquareMarkers(corners, marker_length,
+                camera_matrix, dist_coeffs, ippe_rvecs_, ippe_tvecs_,
+                ippe_rvecs2_, ippe_tvecs2_, ippe_errors_);
+
+            rvecs.resize(ids.size());
+            tvecs.resize(ids.size());
+            seeds_.resize(ids.size());
+            for (size_t i = 0; i < ids.size(); i++) {
+                PoseSeed &seed = seeds_[i];
+                seed.predicted = tracked && tracks_[i].filter.initialized();
+                seed.tracked = seed.predicted;
+                seed.rvec = ippe_rvecs_[i];
+                seed.tvec = ippe_tvecs_[i];
+                if (seed.predicted) {
+                    tracks_[i].filter.predict(seed.predicted_rvec,
+                        seed.predicted_tvec);
+                    if (ippe_errors_[i][1] <= std::numeric_limits<double>::max() &&
+                        rotation_angle(ippe_rvecs2_[i], seed.predicted_rvec) <
+                        rotation_angle(ippe_rvecs_[i], seed.predicted_rvec)) {
+                        seed.rvec = ippe_rvecs2_[i];
+                        seed.tvec = ippe_tvecs2_[i];
+                    }
+                }
+
+                rvecs[i] = seed.rvec;
+                tvecs[i] = seed.tvec;
+                // a degenerate marker has no IPPE pose to start from
+                cv::solvePnP(object_points, corners[i], camera_matrix,
+                    dist_coeffs, rvecs[i], tvecs[i], seed.tvec[2] > 0,
+                    cv::SOLVEPNP_ITERATIVE);
+                if (tracked) {
+                    tracks_[i].filter.update(rvecs[i], tvecs[i], rvecs[i],
+                        tvecs[i]);
+                }
+            }
+        }
+
+        static cv::Point2f center(const std::vector<cv::Point2f> &corners) {
+            cv::Point2f c(0, 0);
+            for (size_t i = 0; i < corners.size(); i++) {
+                c += corners[i];
+            }
+            return c * (1.f / corners.size());
+        }
+
+        // Detection with the given id whose center is closest to near, or -1.
+        static int closest(const std::vector<std::vector<cv::Point2f> > &corners,
+            const std::vector<int> &ids, int id, cv::Point2f near,
+            const std::vector<bool> &taken) {
+            int best = -1;
+            double best_distance = std::numeric_limits<double>::max();
+            for (size_t i = 0; i < ids.size(); i++) {
+                if (ids[i] != id || taken[i]) {
+                    continue;
+                }
+                cv::Point2f d = center(corners[i]) - near;
+                double distance = d.dot(d);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = (int)i;
+                }
+            }
+            return best;
+        }
+
+        cv::Rect roi_of(const Track &track, const cv::Size &image_size) const {
+            cv::Rect box = cv::boundingRect(track.corners);
+            int pad = cvCeil(roi_padding_ * std::max(box.width, box.height));
+            box.x -= pad;
+            box.y -= pad;
+            box.width += 2 * pad;
+            box.height += 2 * pad;
+            return box & cv::Rect(cv::Point(0, 0), image_size);
+        }
+
+        // Looks for every tracked marker around its last position, with one
+        // region-restricted detection. Returns false when one of
+        // them is not found.
+        bool detect_in_rois(const cv::Mat &image,
+            std::vector<std::vector<cv::Point2f> > &corners,
+            std::vector<int> &ids) {
+            rois_.clear();
+            for (size_t t = 0; t < tracks_.size(); t++) {
+                rois_.push_back(roi_of(tracks_[t], image.size()));
+            }
+
+            roi_corners_.clear();
+            roi_ids_.clear();
+            detector_->detectMarkers(image, roi_corners_, roi_ids_, rois_);
+
+            std::vector<bool> taken(roi_ids_.size(), false);
+            corners.resize(tracks_.size());
+            ids.resize(tracks_.size());
+            for (size_t t = 0; t < tracks_.size(); t++) {
+                Track &track = tracks_[t];
+                int found = closest(roi_corners_, roi_ids_, track.id,
+                    center(track.corners), taken);
+                if (found < 0) {
+                    return false;
+                }
+                taken[found] = true;
+                track.corners = roi_corners_[found];
+                corners[t] = track.corners;
+                ids[t] = track.id;
+            }
+            return true;
+        }
+
+        // Replaces the tracks with a full detection and carries the poses of
+        // markers that were already tracked over to them.
+        void update_tracks(const std::vector<std::vector<cv::Point2f> > &corners,
+            const std::vector<int> &ids) {
+            std::vector<Track> tracks(ids.size());
+            std::vector<int> previous_ids(tracks_.size());
+            std::vector<std::vector<cv::Point2f> > previous_corners(tracks_.size());
+            for (size_t t = 0; t < tracks_.size(); t++) {
+                previous_ids[t] = tracks_[t].id;
+                previous_corners[t] = tracks_[t].corners;
+            }
+            std::vector<bool> taken(tracks_.size(), false);
+
+            for (size_t i = 0; i < ids.size(); i++) {
+                tracks[i].id = ids[i];
+                tracks[i].corners = corners[i];
+                tracks[i].has_pose = false;
+                tracks[i].filter = PoseFilter(filter_gain_ > 0 ? filter_gain_ : 1);
+                int previous = closest(previous_corners, previous_ids, ids[i],
+                    center(corners[i]), taken);
+                if (previous < 0) {
+                    continue;
+                }
+                taken[previous] = true;
+                if (tracks_[previous].has_pose) {
+                    tracks[i].rvec = tracks_[previous].rvec;
+                    tracks[i].tvec = tracks_[previous].tvec;
+                    tracks[i].has_pose = true;
+                }
+                tracks[i].filter = tracks_[previous].filter;
+            }
+            tracks_.swap(tracks);
+        }
+
+        cv::Ptr<cv::aruco::DetectorParameters> params_;
+        cv::Ptr<cv::aruco::ArucoDetector> detector_;
+        int redetect_interval_;
+        float roi_padding_;
+        double filter_gain_;
+        int frames_since_full_;
+        bool last_was_full_;
+
+        std::vector<Track> tracks_;
+        std::vector<cv::Rect> rois_;
+        std::vector<std::vector<cv::Point2f> > roi_corners_;
+        std::vector<int> roi_ids_;
+        std::vector<cv::Vec3d> ippe_rvecs_, ippe_tvecs_, ippe_rvecs2_, ippe_tvecs2_;
+        std::vector<cv::Vec2d> ippe_errors_;
+        std::vector<PoseSeed> seeds_;
+    };
+}
+
+#endif
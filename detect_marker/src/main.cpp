@@ -5,6 +5,7 @@
 #include <cstdlib>
 
 #include "fdcl_common.hpp"
+#include "fdcl_tracker.hpp"
 
 
 int main(int argc, char **argv)
@@ -30,6 +31,7 @@ int main(int argc, char **argv)
     cv::Ptr<cv::aruco::Dictionary> dictionary =
         cv::aruco::getPredefinedDictionary( \
         cv::aruco::PREDEFINED_DICTIONARY_NAME(dictionary_id));
+    fdcl::MarkerTracker tracker(dictionary, parser.get<int>("t"));
 
 
     // Process the video
@@ -40,7 +42,7 @@ int main(int argc, char **argv)
 
         std::vector<int> ids;
         std::vector<std::vector<cv::Point2f>> corners;
-        cv::aruco::detectMarkers(image, dictionary, corners, ids);
+        tracker.detect(image, corners, ids);
 
         if (ids.size() > 0) {
             cv::aruco::drawDetectedMarkers(image_copy, corners, ids);
@@ -0,0 +1,21 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <vector>
+
+enum OpCode : uint8_t {
+    OP_NEW_ARRAY, // a: size
+    OP_STORE,     // a: index, b: value
+    OP_CLEAR      // a: index
+};
+
+struct Instruction {
+    OpCode op;
+    int32_t a;
+    int32_t b;
+};
+
+typedef std::vector<Instruction> Program;
+
+#endif // BYTECODE_H
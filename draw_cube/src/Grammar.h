@@ -0,0 +1,179 @@
+#ifndef GRAMMAR_H
+#define GRAMMAR_H
+
+#include "LexicalAnalyzer.h"
+#include <cstddef>
+
+// Terminals of the marker language. Unlike TokenType, every keyword and
+// separator is its own terminal, so the grammar alone decides validity.
+enum Terminal {
+    T_NEW, T_ARRAY, T_INSERT, T_DELETE, T_ASSIGN, T_LPAREN, T_RPAREN, T_SEMICOLON, T_NUMBER,
+    T_END, T_INVALID,
+    TERMINAL_COUNT = T_INVALID
+};
+
+enum Nonterminal { N_STATEMENT, N_INDEX, NONTERMINAL_COUNT };
+
+enum StatementKind { STMT_NONE, STMT_NEW_ARRAY, STMT_INSERT, STMT_DELETE };
+
+struct GrammarToken {
+    Terminal terminal;
+    int value; // numeric value of T_NUMBER
+};
+
+// Parse result; a fixed-size node, so parsing never allocates.
+struct Statement {
+    StatementKind kind = STMT_NONE;
+    int args[2] = { 0, 0 }; // new: size | insert: index, value | delete: index
+};
+
+struct GrammarSymbol {
+    bool terminal;
+    int id;
+    int slot; // Statement::args entry a T_NUMBER is stored into, -1 for none
+};
+
+const int MAX_PRODUCTION_LENGTH = 6;
+
+struct Production {
+    Nonterminal lhs;
+    StatementKind kind; // set on the Statement when the production is expanded
+    int length;
+    GrammarSymbol rhs[MAX_PRODUCTION_LENGTH];
+};
+
+constexpr GrammarSymbol term(Terminal id) { return { true, id, -1 }; }
+constexpr GrammarSymbol number(int slot) { return { true, T_NUMBER, slot }; }
+constexpr GrammarSymbol nonterm(Nonterminal id) { return { false, id, -1 }; }
+
+// To add a statement kind, add its productions here; the parse table below is
+// derived from this list at compile time, so parsing a frame does not get
+// any slower. Productions must not be empty or left recursive.
+constexpr Production productions[] = {
+    // new array = N ;
+    { N_STATEMENT, STMT_NEW_ARRAY, 5, { term(T_NEW), term(T_ARRAY), term(T_ASSIGN), number(0), term(T_SEMICOLON) } },
+    // insert ( i ) = v ;
+    { N_STATEMENT, STMT_INSERT, 5, { term(T_INSERT), nonterm(N_INDEX), term(T_ASSIGN), number(1), term(T_SEMICOLON) } },
+    // delete ( i ) ;
+    { N_STATEMENT, STMT_DELETE, 3, { term(T_DELETE), nonterm(N_INDEX), term(T_SEMICOLON) } },
+    // ( i )
+    { N_INDEX, STMT_NONE, 3, { term(T_LPAREN), number(0), term(T_RPAREN) } },
+};
+
+const int PRODUCTION_COUNT = sizeof(productions) / sizeof(productions[0]);
+
+constexpr bool startsWith(GrammarSymbol symbol, int terminal);
+
+// Whether some production of nonterminal can start with terminal.
+constexpr bool nonterminalStartsWith(int nonterminal, int terminal, int p = 0) {
+    return p < PRODUCTION_COUNT &&
+           ((productions[p].lhs == nonterminal && startsWith(productions[p].rhs[0], terminal)) ||
+            nonterminalStartsWith(nonterminal, terminal, p + 1));
+}
+
+constexpr bool startsWith(GrammarSymbol symbol, int terminal) {
+    return symbol.terminal ? symbol.id == terminal : nonterminalStartsWith(symbol.id, terminal);
+}
+
+constexpr bool predicts(int p, int nonterminal, int terminal) {
+    return productions[p].lhs == nonterminal && startsWith(productions[p].rhs[0], terminal);
+}
+
+// The production to expand nonterminal with when terminal is next, -1 if none.
+constexpr int predict(int nonterminal, int terminal, int p = 0) {
+    return p == PRODUCTION_COUNT ? -1 :
+           predicts(p, nonterminal, terminal) ? p : predict(nonterminal, terminal, p + 1);
+}
+
+constexpr int countPredictions(int nonterminal, int terminal, int p = 0) {
+    return p == PRODUCTION_COUNT ? 0 :
+           (predicts(p, nonterminal, terminal) ? 1 : 0) + countPredictions(nonterminal, terminal, p + 1);
+}
+
+constexpr bool isLL1(int nonterminal = 0, int terminal = 0) {
+    return nonterminal == NONTERMINAL_COUNT ? true :
+           terminal == TERMINAL_COUNT ? isLL1(nonterminal + 1, 0) :
+           countPredictions(nonterminal, terminal) <= 1 && isLL1(nonterminal, terminal + 1);
+}
+
+static_assert(isLL1(), "two productions of one nonterminal start with the same terminal");
+
+static_assert(TERMINAL_COUNT == 10, "GRAMMAR_ROW has one entry per terminal");
+#define GRAMMAR_ROW(nt) { \
+    predict(nt, 0), predict(nt, 1), predict(nt, 2), predict(nt, 3), predict(nt, 4), \
+    predict(nt, 5), predict(nt, 6), predict(nt, 7), predict(nt, 8), predict(nt, 9) }
+
+constexpr signed char parse_table[NONTERMINAL_COUNT][TERMINAL_COUNT] = {
+    GRAMMAR_ROW(N_STATEMENT),
+    GRAMMAR_ROW(N_INDEX),
+};
+
+#undef GRAMMAR_ROW
+
+class Grammar {
+public:
+    static Terminal terminalOf(const Token& token) {
+        if (token.type == NUMBER) return T_NUMBER;
+        if (token.lexeme == "new") return T_NEW;
+        if (token.lexeme == "array") return T_ARRAY;
+        if (token.lexeme == "insert") return T_INSERT;
+        if (token.lexeme == "delete") return T_DELETE;
+        if (token.lexeme == "=") return T_ASSIGN;
+        if (token.lexeme == "(") return T_LPAREN;
+        if (token.lexeme == ")") return T_RPAREN;
+        if (token.lexeme == ";") return T_SEMICOLON;
+        return T_INVALID;
+    }
+
+    static GrammarToken toGrammarToken(const Token& token) {
+        GrammarToken out = { terminalOf(token), 0 };
+        if (out.terminal == T_NUMBER) {
+            out.value = std::stoi(token.lexeme);
+        }
+        return out;
+    }
+
+    // Table-driven LL(1) parse of a whole statement in one pass over input.
+    static bool parse(const GrammarToken* input, size_t count, Statement& statement) {
+        const int max_depth = 16;
+        GrammarSymbol stack[max_depth];
+        int depth = 0;
+        stack[depth++] = term(T_END);
+        stack[depth++] = nonterm(N_STATEMENT);
+
+        statement = Statement();
+        size_t pos = 0;
+        while (depth > 0) {
+            GrammarSymbol top = stack[--depth];
+            Terminal next = pos < count ? input[pos].terminal : T_END;
+            if (next == T_INVALID) {
+                return false;
+            }
+
+            if (top.terminal) {
+                if (top.id != next) {
+                    return false;
+                }
+                if (top.slot >= 0) {
+                    statement.args[top.slot] = input[pos].value;
+                }
+                pos++;
+                continue;
+            }
+
+            int p = parse_table[top.id][next];
+            if (p < 0 || depth + productions[p].length > max_depth) {
+                return false;
+            }
+            if (productions[p].kind != STMT_NONE) {
+                statement.kind = productions[p].kind;
+            }
+            for (int i = productions[p].length - 1; i >= 0; --i) {
+                stack[depth++] = productions[p].rhs[i];
+            }
+        }
+        return pos == count + 1;
+    }
+};
+
+#endif // GRAMMAR_H
@@ -4,7 +4,6 @@
 #include <string>
 #include <vector>
 #include <regex>
-#include <iostream>
 
 enum TokenType { KEYWORD, IDENTIFIER, NUMBER, OPERATOR, SEPARATOR, UNKNOWN, FUNCTION };
 
@@ -16,8 +15,10 @@ struct Token {
 class LexicalAnalyzer {
 public:
     static std::vector<Token> analyze(const std::string& input) {
+        static const std::regex token_regex(R"((new|array|insert|delete|\d+|=|;|\(|\)|\s+))");
+        static const std::regex number_regex(R"(\d+)");
+
         std::vector<Token> tokens;
-        std::regex token_regex(R"((new|array|insert|delete|\d+|=|;|\(|\)|\s+))");
         auto words_begin = std::sregex_iterator(input.begin(), input.end(), token_regex);
         auto words_end = std::sregex_iterator();
 
@@ -27,18 +28,13 @@ public:
             if (part == "new") type = KEYWORD;
             else if (part == "array") type = IDENTIFIER;
             else if (part == "insert" || part == "delete") type = FUNCTION;
-            else if (std::regex_match(part, std::regex(R"(\d+)"))) type = NUMBER;
+            else if (std::regex_match(part, number_regex)) type = NUMBER;
             else if (part == "=") type = OPERATOR;
             else if (part == ";" || part == "(" || part == ")") type = SEPARATOR;
             else continue; // Skip whitespace
             tokens.push_back({ part, type });
         }
 
-        std::cout << "Generated Tokens: " << std::endl;
-        for (const auto& token : tokens) {
-            std::cout << "{ lexeme: \"" << token.lexeme << "\", type: " << token.type << " }" << std::endl;
-        }
-
         return tokens;
     }
 };
@@ -0,0 +1,93 @@
+#ifndef MARKER_FRONT_END_H
+#define MARKER_FRONT_END_H
+
+#include "Grammar.h"
+#include "LexicalAnalyzer.h"
+#include "SyntaxAnalyzer.h"
+#include "SemanticAnalyzer.h"
+#include <map>
+#include <string>
+#include <vector>
+
+// Marker that anchors the result; it is not part of the statement.
+const int RESULT_MARKER_ID = 19;
+
+struct CompiledStatement {
+    std::vector<int> ids;       // marker ids from left to right, the cache key
+    std::string source;         // statement text as written to captured_strings.txt
+    std::vector<GrammarToken> tokens;
+    Statement statement;        // valid when syntax_valid
+    bool syntax_valid = false;
+    bool semantic_valid = false;
+};
+
+// Lexes marker ids straight from a table built once from id_to_string, and
+// keeps the analysis of the last id sequence so an unchanged frame costs a
+// vector comparison.
+class MarkerFrontEnd {
+public:
+    explicit MarkerFrontEnd(const std::map<int, std::string>& id_to_string) : has_result(false) {
+        for (const auto& entry : id_to_string) {
+            if (entry.first < 0) {
+                continue;
+            }
+            if (entry.first >= (int)table.size()) {
+                table.resize(entry.first + 1);
+            }
+            TableEntry& row = table[entry.first];
+            row.known = true;
+            row.text = entry.second;
+            for (const Token& token : LexicalAnalyzer::analyze(entry.second)) {
+                row.tokens.push_back(Grammar::toGrammarToken(token));
+            }
+        }
+    }
+
+    // Returns false when ids is the same sequence as in the previous call, in
+    // which case result() still holds its analysis.
+    bool compile(const std::vector<int>& ids) {
+        if (has_result && ids == current.ids) {
+            return false;
+        }
+        has_result = true;
+
+        current.ids = ids;
+        current.source.clear();
+        current.tokens.clear();
+        for (int id : ids) {
+            if (id == RESULT_MARKER_ID) {
+                continue;
+            }
+            if (!current.source.empty()) {
+                current.source += ' ';
+            }
+            if (id >= 0 && id < (int)table.size() && table[id].known) {
+                current.source += table[id].text;
+                current.tokens.insert(current.tokens.end(), table[id].tokens.begin(), table[id].tokens.end());
+            } else {
+                current.source += "error";
+            }
+        }
+
+        current.syntax_valid = SyntaxAnalyzer::parse(current.tokens, current.statement);
+        current.semantic_valid = current.syntax_valid && SemanticAnalyzer::analyze(current.statement);
+        return true;
+    }
+
+    const CompiledStatement& result() const {
+        return current;
+    }
+
+private:
+    struct TableEntry {
+        bool known = false;
+        std::string text;
+        std::vector<GrammarToken> tokens;
+    };
+
+    std::vector<TableEntry> table;
+    CompiledStatement current;
+    bool has_result;
+};
+
+#endif // MARKER_FRONT_END_H
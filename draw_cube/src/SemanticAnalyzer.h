@@ -1,37 +1,29 @@
 #ifndef SEMANTIC_ANALYZER_H
 #define SEMANTIC_ANALYZER_H
 
-#include "LexicalAnalyzer.h"
+#include "Grammar.h"
 #include <iostream>
-#include <vector>
 
+// Checks the parsed statement; which keyword goes where is already decided by
+// the grammar, so only the values are left to check.
 class SemanticAnalyzer {
 public:
-    static bool analyze(const std::vector<Token>& tokens) {
-        if (tokens.size() == 5 &&
-            tokens[0].lexeme == "new" &&
-            tokens[1].lexeme == "array" &&
-            tokens[2].lexeme == "=" &&
-            tokens[3].type == NUMBER &&
-            tokens[4].lexeme == ";") {
-            return true;
-            } else if (tokens.size() == 7 &&
-                       tokens[0].lexeme == "insert" &&
-                       tokens[1].lexeme == "(" &&
-                       tokens[2].type == NUMBER &&
-                       tokens[3].lexeme == ")" &&
-                       tokens[4].lexeme == "=" &&
-                       tokens[5].type == NUMBER &&
-                       tokens[6].lexeme == ";") {
+    static bool analyze(const Statement& statement) {
+        switch (statement.kind) {
+        case STMT_NEW_ARRAY:
+            if (statement.args[0] > 0) {
                 return true;
-                       } else if (tokens.size() == 5 &&
-                                  tokens[0].lexeme == "delete" &&
-                                  tokens[1].lexeme == "(" &&
-                                  tokens[2].type == NUMBER &&
-                                  tokens[3].lexeme == ")" &&
-                                  tokens[4].lexeme == ";") {
-                           return true;
-                                  }
+            }
+            break;
+        case STMT_INSERT:
+        case STMT_DELETE:
+            if (statement.args[0] >= 0) {
+                return true;
+            }
+            break;
+        default:
+            break;
+        }
         std::cerr << "Failed semantic analysis." << std::endl;
         return false;
     }
@@ -0,0 +1,88 @@
+#ifndef VIRTUAL_MACHINE_H
+#define VIRTUAL_MACHINE_H
+
+#include "Bytecode.h"
+#include <iostream>
+#include <vector>
+
+// Runs marker programs in process; the array it leaves behind is what the
+// render stage draws as cubes.
+class VirtualMachine {
+public:
+    explicit VirtualMachine(bool trace = false) : trace(trace) {}
+
+    void reset() {
+        array.clear();
+    }
+
+    // Stops at the first instruction with an index outside the array and
+    // returns false; the instructions before it have taken effect.
+    bool run(const Instruction* code, size_t count) {
+        for (size_t pc = 0; pc < count; ++pc) {
+            if (!step(code[pc])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool run(const Program& program) {
+        return run(program.data(), program.size());
+    }
+
+    const std::vector<int>& values() const {
+        return array;
+    }
+
+private:
+    bool step(const Instruction& instruction) {
+        switch (instruction.op) {
+        case OP_NEW_ARRAY:
+            if (instruction.a <= 0) {
+                std::cerr << "Invalid array size." << std::endl;
+                return false;
+            }
+            array.assign(instruction.a, 0);
+            if (trace) {
+                std::cout << "Array of size " << instruction.a << " created." << std::endl;
+            }
+            break;
+        case OP_STORE:
+            if (instruction.a < 0 || instruction.a >= (int)array.size()) {
+                std::cerr << "Invalid index for insert." << std::endl;
+                return false;
+            }
+            array[instruction.a] = instruction.b;
+            if (trace) {
+                std::cout << "Inserted " << instruction.b << " at position " << instruction.a << "." << std::endl;
+            }
+            break;
+        case OP_CLEAR:
+            if (instruction.a < 0 || instruction.a >= (int)array.size()) {
+                std::cerr << "Invalid index for delete." << std::endl;
+                return false;
+            }
+            array[instruction.a] = 0;
+            if (trace) {
+                std::cout << "Deleted element at position " << instruction.a << "." << std::endl;
+            }
+            break;
+        }
+        if (trace) {
+            displayArray();
+        }
+        return true;
+    }
+
+    void displayArray() const {
+        std::cout << "Current array state:" << std::endl;
+        for (size_t i = 0; i < array.size(); ++i) {
+            std::cout << "Index " << i << ": " << array[i] << std::endl;
+        }
+    }
+
+    std::vector<int> array;
+    bool trace;
+};
+
+#endif // VIRTUAL_MACHINE_H
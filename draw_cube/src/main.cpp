@@ -4,21 +4,47 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <sstream>
 #include <cstdlib>
 #include <map>
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <thread>
 #include "LexicalAnalyzer.h"
 #include "SyntaxAnalyzer.h"
 #include "SemanticAnalyzer.h"
 #include "CodeGenerator.h"
+#include "VirtualMachine.h"
+#include "MarkerFrontEnd.h"
 #include "fdcl_common.hpp"
+#include "fdcl_pipeline.hpp"
+#include "fdcl_recorder.hpp"
+#include "fdcl_tracker.hpp"
 
 bool isStringValid(const std::string& str);
 void saveCapturedStrings(const std::vector<std::string>& captured_strings, const std::string& filename);
 bool isStringInVector(const std::vector<std::string>& vec, const std::string& str);
-void cmp(const std::string& filename);
+void drawMultipleCubesWireframe(cv::InputOutputArray image, cv::InputArray camera_matrix, cv::InputArray dist_coeffs, cv::InputArray rvec, cv::InputArray tvec, float l, const std::vector<int>& values);
+
+struct Frame {
+    int64_t seq = 0;
+    int64_t captured_ns = 0;
+    cv::Mat image;
+    std::vector<int> ids;
+    std::vector<std::vector<cv::Point2f>> corners;
+    std::vector<cv::Vec3d> rvecs, tvecs;
+    std::vector<int> values; // array left by the captured program, drawn on the result marker
+    std::string detector_report; // once per second with -s, printed with the other reports
+};
+
+// Capacity of the queues between stages. Small on purpose: a deeper queue only
+// adds latency once a stage falls behind.
+const size_t queue_capacity = 4;
+
+bool isLiveSource(const cv::CommandLineParser& parser);
+void compileFrame(const Frame& frame, MarkerFrontEnd& front_end, VirtualMachine& live_vm,
+                  std::vector<std::string>& captured_strings, Program& captured_program,
+                  bool& marker19_found);
 
 int main(int argc, char **argv) {
     cv::CommandLineParser parser(argc, argv, fdcl::keys);
@@ -44,7 +70,6 @@ int main(int argc, char **argv) {
         return 1;
     }
 
-    cv::Mat image, image_copy;
     cv::Mat camera_matrix, dist_coeffs;
 
     cv::Ptr<cv::aruco::Dictionary> dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::PREDEFINED_DICTIONARY_NAME(dictionary_id));
@@ -57,263 +82,263 @@ int main(int argc, char **argv) {
     int frame_height = in_video.get(cv::CAP_PROP_FRAME_HEIGHT);
     int fps = 30;
     int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
-    cv::VideoWriter video("out.avi", fourcc, fps, cv::Size(frame_width, frame_height), true);
+    fdcl::RecordingPolicy recording_policy;
+    if (!fdcl::parse_recording_policy(parser.get<std::string>("rp"), recording_policy)) {
+        return 1;
+    }
+    int recording_buffer = parser.get<int>("rb");
+    if (recording_buffer < 1) {
+        std::cerr << "Recording buffer size must be at least 1 frame\n";
+        return 1;
+    }
+    fdcl::VideoRecorder video;
+    video.open("out.avi", fourcc, fps, cv::Size(frame_width, frame_height), recording_policy, recording_buffer);
 
     std::map<int, std::string> id_to_string = {
         {0, "1"}, {1, "2"}, {2, "3"}, {3, "4"}, {4, "5"}, {5, "6"}, {6, "7"}, {7, "8"}, {8, "9"}, {9, "10"},
         {11, "new"}, {12, "array"}, {13, "="}, {14, "insert"}, {15, "("}, {16, ")"}, {17, ";"}, {18, "delete"}, {19, "resultado"}
     };
 
-    std::vector<int> myArray;
-    cv::Vec3d rvec19, tvec19;
+    // state of the compile stage, only touched by its thread
+    MarkerFrontEnd front_end(id_to_string);
+    VirtualMachine live_vm(true);
     bool marker19_found = false;
-
     std::vector<std::string> captured_strings;
-
-    while (in_video.grab()) {
-        in_video.retrieve(image);
-        image.copyTo(image_copy);
-
-        std::vector<int> ids;
-        std::vector<std::vector<cv::Point2f>> corners;
-        cv::aruco::detectMarkers(image, dictionary, corners, ids);
-
-        std::string detected_string;
-
-        if (ids.size() > 0) {
-            std::vector<cv::Vec3d> rvecs, tvecs;
-            cv::aruco::estimatePoseSingleMarkers(corners, marker_length_m, camera_matrix, dist_coeffs, rvecs, tvecs);
-
-            std::vector<std::pair<int, std::vector<cv::Point2f>>> sorted_markers;
-            for (size_t i = 0; i < ids.size(); ++i) {
-                sorted_markers.push_back(std::make_pair(ids[i], corners[i]));
+    Program captured_program; // bytecode of captured_strings, in the same order
+    std::vector<int> program_values;
+
+    // capture -> detect+pose -> compile -> render/encode (this thread, since
+    // imshow/waitKey have to stay on the main thread)
+    fdcl::SpscQueue<Frame> capture_to_detect(queue_capacity);
+    fdcl::SpscQueue<Frame> detect_to_compile(queue_capacity);
+    fdcl::SpscQueue<Frame> compile_to_render(queue_capacity);
+
+    fdcl::StageStats capture_stats("capture");
+    fdcl::StageStats detect_stats("detect");
+    fdcl::StageStats compile_stats("compile");
+    fdcl::StageStats render_stats("render");
+    fdcl::StageStats latency_stats("latency");
+
+    std::atomic<bool> stop(false);
+    std::atomic<bool> capture_done(false), detect_done(false), compile_done(false);
+    std::atomic<bool> save_requested(false);
+
+    // A camera keeps producing frames whether we read them or not, so when
+    // detection falls behind the newest frame is dropped instead of stalling
+    // the driver. Files are read at the pace of the slowest stage.
+    const bool live_source = isLiveSource(parser);
+
+    std::thread capture_thread([&]() {
+        int64_t seq = 0;
+        while (!stop) {
+            Frame frame;
+            int64_t start = fdcl::now_ns();
+            if (!in_video.grab() || !in_video.retrieve(frame.image)) {
+                break;
             }
-            std::sort(sorted_markers.begin(), sorted_markers.end(), [](const std::pair<int, std::vector<cv::Point2f>>& a, const std::pair<int, std::vector<cv::Point2f>>& b) {
-                return a.second[0].x < b.second[0].x;
-            });
-
-            for (const auto& marker : sorted_markers) {
-                int id = marker.first;
-                if (id == 19) {
-                    rvec19 = rvecs[&marker - &sorted_markers[0]];
-                    tvec19 = tvecs[&marker - &sorted_markers[0]];
-                    marker19_found = true;
-                    continue;
-                }
-                if (id_to_string.find(id) != id_to_string.end()) {
-                    detected_string += id_to_string[id] + " ";
-                } else {
-                    detected_string += "error ";
+            frame.seq = seq++;
+            frame.captured_ns = start;
+            capture_stats.record(fdcl::now_ns() - start);
+
+            if (live_source) {
+                if (!capture_to_detect.try_push(frame)) {
+                    capture_stats.drop();
                 }
+            } else if (!capture_to_detect.push(frame, stop)) {
+                break;
             }
-
-            if (!detected_string.empty()) {
-                detected_string.pop_back();
+        }
+        capture_done = true;
+    });
+
+    std::thread detect_thread([&]() {
+        fdcl::MarkerTracker tracker(dictionary, parser.get<int>("t"));
+        tracker.filter_poses(parser.get<double>("f"));
+        const bool print_statistics = parser.get<bool>("s");
+        int64_t last_report = fdcl::now_ns();
+        Frame frame;
+        while (capture_to_detect.pop(frame, capture_done, stop)) {
+            int64_t start = fdcl::now_ns();
+            tracker.detect(frame.image, frame.corners, frame.ids);
+            if (frame.ids.size() > 0) {
+                tracker.estimate_pose(frame.corners, frame.ids, marker_length_m, camera_matrix, dist_coeffs, frame.rvecs, frame.tvecs);
             }
-
-            std::vector<Token> tokens = LexicalAnalyzer::analyze(detected_string);
-            std::cout << "Lexical Tokens:" << std::endl;
-            for (const auto& token : tokens) {
-                std::cout << "{ lexeme: \"" << token.lexeme << "\", type: " << token.type << " }" << std::endl;
+            detect_stats.record(fdcl::now_ns() - start);
+            if (print_statistics && start - last_report > 1000000000) {
+                last_report = start;
+                frame.detector_report = tracker.detector_report_and_reset();
             }
 
-            bool syntax_valid = SyntaxAnalyzer::parse(tokens);
-
-            if (syntax_valid && marker19_found && !detected_string.empty() && !isStringInVector(captured_strings, detected_string) && SemanticAnalyzer::analyze(tokens)) {
-                captured_strings.push_back(detected_string);
+            if (!detect_to_compile.push(frame, stop)) {
+                break;
             }
-
-            std::cout << "Detected string: " << detected_string << std::endl;
-
-            if (syntax_valid && SemanticAnalyzer::analyze(tokens)) {
-                std::cout << "Semantic Analysis Passed" << std::endl;
-                CodeGenerator::generate(tokens);
-                if (tokens[0].lexeme == "new" && tokens[1].lexeme == "array") {
-                    int array_size = std::stoi(tokens[3].lexeme);
-                    myArray = std::vector<int>(array_size, 0);
-                } else if (tokens[0].lexeme == "insert") {
-                    int index = std::stoi(tokens[2].lexeme);
-                    int value = std::stoi(tokens[5].lexeme);
-                    if (index >= 0 && index < myArray.size()) {
-                        myArray[index] = value;
-                    }
-                } else if (tokens[0].lexeme == "delete") {
-                    int index = std::stoi(tokens[2].lexeme);
-                    if (index >= 0 && index < myArray.size()) {
-                        myArray[index] = 0;
-                    }
+        }
+        detect_done = true;
+    });
+
+    std::thread compile_thread([&]() {
+        Frame frame;
+        while (detect_to_compile.pop(frame, detect_done, stop)) {
+            int64_t start = fdcl::now_ns();
+            if (frame.ids.size() > 0) {
+                compileFrame(frame, front_end, live_vm, captured_strings, captured_program, marker19_found);
+            }
+            if (save_requested.exchange(false)) {
+                saveCapturedStrings(captured_strings, "captured_strings.txt");
+                std::cout << "Captured strings saved to captured_strings.txt" << std::endl;
+
+                VirtualMachine vm;
+                if (vm.run(captured_program)) {
+                    program_values = vm.values();
+                    std::cout << "Executed " << captured_program.size() << " instructions." << std::endl;
                 }
+            }
+            frame.values = program_values;
+            compile_stats.record(fdcl::now_ns() - start);
 
-                if (marker19_found) {
-                    std::cout << "..." << std::endl;
+            if (!compile_to_render.push(frame, stop)) {
+                break;
+            }
+        }
+        compile_done = true;
+    });
+
+    int64_t last_report = fdcl::now_ns();
+    Frame frame;
+    while (compile_to_render.pop(frame, compile_done, stop)) {
+        int64_t start = fdcl::now_ns();
+        if (!frame.detector_report.empty()) {
+            std::cout << frame.detector_report << std::endl;
+        }
+        if (!frame.values.empty()) {
+            for (size_t i = 0; i < frame.ids.size() && i < frame.rvecs.size(); i++) {
+                if (frame.ids[i] == RESULT_MARKER_ID) {
+                    drawMultipleCubesWireframe(frame.image, camera_matrix, dist_coeffs, frame.rvecs[i], frame.tvecs[i], marker_length_m, frame.values);
                 }
-            } else if (syntax_valid) {
-                std::cout << "Semantic Analysis Failed" << std::endl;
-            } else {
-                std::cout << "Syntax Analysis Failed" << std::endl;
             }
         }
+        video.write(frame.image);
+        cv::imshow("Pose estimation", frame.image);
+        render_stats.record(fdcl::now_ns() - start);
+        latency_stats.record(fdcl::now_ns() - frame.captured_ns);
+
+        if (start - last_report > 1000000000) {
+            last_report = start;
+            std::cout << capture_stats.report_and_reset() << "\n"
+                      << detect_stats.report_and_reset() << "\n"
+                      << compile_stats.report_and_reset() << "\n"
+                      << render_stats.report_and_reset() << "\n"
+                      << video.report_and_reset() << "\n"
+                      << latency_stats.report_and_reset() << std::endl;
+        }
 
-        video.write(image_copy);
-        cv::imshow("Pose estimation", image_copy);
         char key = (char)cv::waitKey(wait_time);
         if (key == 27) {
             break;
         } else if (key == 'c' || key == 'C') {
-            saveCapturedStrings(captured_strings, "captured_strings.txt");
-            std::cout << "Captured strings saved to captured_strings.txt" << std::endl;
-            cmp("captured_strings.txt");
+            save_requested = true;
         }
     }
 
+    stop = true;
+    capture_thread.join();
+    detect_thread.join();
+    compile_thread.join();
+    video.close();
+
     in_video.release();
 
     return 0;
 }
 
-bool isStringValid(const std::string& str) {
-    std::vector<Token> tokens = LexicalAnalyzer::analyze(str);
-    bool syntax_valid = SyntaxAnalyzer::parse(tokens);
-    return syntax_valid && SemanticAnalyzer::analyze(tokens);
-}
-
-bool isStringInVector(const std::vector<std::string>& vec, const std::string& str) {
-    return std::find(vec.begin(), vec.end(), str) != vec.end();
-}
-
-void saveCapturedStrings(const std::vector<std::string>& captured_strings, const std::string& filename) {
-    std::ofstream output_file(filename);
-    if (!output_file.is_open()) {
-        std::cerr << "Error opening file for writing!" << std::endl;
-        return;
-    }
-
-    for (const auto& str : captured_strings) {
-        output_file << str << std::endl;
+bool isLiveSource(const cv::CommandLineParser& parser) {
+    if (!parser.has("v")) {
+        return true;
     }
-
-    output_file.close();
+    cv::String video_input = parser.get<cv::String>("v");
+    char* end = nullptr;
+    std::strtol(video_input.c_str(), &end, 10);
+    return end && end != video_input.c_str();
 }
 
-void generateObjectCode(const std::vector<int>& array, const std::string& outputFile) {
-    std::string outputPath = "../../array/src/" + outputFile;
-    
-    std::ofstream out(outputPath);
-    if (!out.is_open()) {
-        std::cerr << "Could not open the output file.\n";
-        return;
+void compileFrame(const Frame& frame, MarkerFrontEnd& front_end, VirtualMachine& live_vm,
+                  std::vector<std::string>& captured_strings, Program& captured_program,
+                  bool& marker19_found) {
+    // marker ids from left to right
+    std::vector<size_t> order(frame.ids.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
     }
-    out << R"cpp(
-#include <opencv2/opencv.hpp>
-#include <opencv2/aruco.hpp>
-#include <iostream>
-#include <vector>
-#include <cstdlib>
-#include <map>
-
-#include "fdcl_common.hpp"
-
-void drawMultipleCubesWireframe(cv::InputOutputArray image, cv::InputArray camera_matrix, cv::InputArray dist_coeffs, cv::InputArray rvec, cv::InputArray tvec, float l, const std::vector<int>& values);
-
-int main(int argc, char **argv) {
-    cv::CommandLineParser parser(argc, argv, fdcl::keys);
-
-    const char* about = "Draw cube on ArUco marker images";
-    auto success = parse_inputs(parser, about);
-    if (!success) {
-        return 1;
+    std::sort(order.begin(), order.end(), [&frame](size_t a, size_t b) {
+        return frame.corners[a][0].x < frame.corners[b][0].x;
+    });
+
+    std::vector<int> sorted_ids(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        sorted_ids[i] = frame.ids[order[i]];
+        if (sorted_ids[i] == RESULT_MARKER_ID) {
+            marker19_found = true;
+        }
     }
 
-    cv::VideoCapture in_video;
-    success = parse_video_in(in_video, parser);
-    if (!success) {
-        return 1;
+    // Every statement is idempotent, so running it again on the frames that
+    // follow with the same markers would not change anything.
+    if (!front_end.compile(sorted_ids)) {
+        return;
     }
 
-    int wait_time = 10;
+    const CompiledStatement& statement = front_end.result();
+    const std::string& detected_string = statement.source;
 
-    int dictionary_id = parser.get<int>("d");
-    float marker_length_m = parser.get<float>("l");
-    if (marker_length_m <= 0) {
-        std::cerr << "Marker length must be a positive value in meter\n";
-        return 1;
+    if (statement.semantic_valid && marker19_found && !detected_string.empty() && !isStringInVector(captured_strings, detected_string)) {
+        captured_strings.push_back(detected_string);
+        CodeGenerator::generate(statement.statement, captured_program);
     }
 
-    cv::Mat image, image_copy;
-    cv::Mat camera_matrix, dist_coeffs;
-
-    cv::Ptr<cv::aruco::Dictionary> dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::PREDEFINED_DICTIONARY_NAME(dictionary_id));
+    std::cout << "Detected string: " << detected_string << std::endl;
 
-    cv::FileStorage fs("../../calibration_params.yml", cv::FileStorage::READ);
-    fs["camera_matrix"] >> camera_matrix;
-    fs["distortion_coefficients"] >> dist_coeffs;
+    if (statement.semantic_valid) {
+        std::cout << "Semantic Analysis Passed" << std::endl;
+        Program code;
+        CodeGenerator::generate(statement.statement, code);
+        live_vm.run(code);
 
-    int frame_width = in_video.get(cv::CAP_PROP_FRAME_WIDTH);
-    int frame_height = in_video.get(cv::CAP_PROP_FRAME_HEIGHT);
-    int fps = 30;
-    int fourcc = cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
-    cv::VideoWriter video("out.avi", fourcc, fps, cv::Size(frame_width, frame_height), true);
-
-    std::map<int, std::string> id_to_string = {
-        {11, "new"}, {12, "array"}, {13, "="}, {14, "insert"}, {15, "("}, {16, ")"}, {17, ";"}, {18, "delete"}, {19, "resultado"}
-    };
-
-    while (in_video.grab()) {
-        in_video.retrieve(image);
-        image.copyTo(image_copy);
-
-        std::vector<int> ids;
-        std::vector<std::vector<cv::Point2f>> corners;
-        cv::aruco::detectMarkers(image, dictionary, corners, ids);
-
-        std::string detected_string;
-
-        if (ids.size() > 0) {
-            cv::aruco::drawDetectedMarkers(image_copy, corners, ids);
-
-            std::vector<cv::Vec3d> rvecs, tvecs;
-            cv::aruco::estimatePoseSingleMarkers(corners, marker_length_m, camera_matrix, dist_coeffs, rvecs, tvecs);
-
-            for (int i = 0; i < ids.size(); i++) {
-                if (ids[i] == 19) {
-                    std::vector<int> values = {)cpp";
-
-    for (size_t i = 0; i < array.size(); ++i) {
-        out << array[i];
-        if (i != array.size() - 1) {
-            out << ", ";
+        if (marker19_found) {
+            std::cout << "..." << std::endl;
         }
+    } else if (statement.syntax_valid) {
+        std::cout << "Semantic Analysis Failed" << std::endl;
+    } else {
+        std::cout << "Syntax Analysis Failed" << std::endl;
     }
+}
 
-    out << R"cpp(};
-                    drawMultipleCubesWireframe(image_copy, camera_matrix, dist_coeffs, rvecs[i], tvecs[i], marker_length_m, values);
-                }
-
-                if (ids[i] <= 10) {
-                    detected_string += std::to_string(ids[i]) + " ";
-                } else if (id_to_string.find(ids[i]) != id_to_string.end()) {
-                    detected_string += id_to_string[ids[i]] + " ";
-                } else {
-                    detected_string += "error ";
-                }
-            }
+bool isStringValid(const std::string& str) {
+    std::vector<Token> tokens = LexicalAnalyzer::analyze(str);
+    Statement statement;
+    bool syntax_valid = SyntaxAnalyzer::parse(tokens, statement);
+    return syntax_valid && SemanticAnalyzer::analyze(statement);
+}
 
-            std::cout << "Detected string: " << detected_string << std::endl;
-        }
+bool isStringInVector(const std::vector<std::string>& vec, const std::string& str) {
+    return std::find(vec.begin(), vec.end(), str) != vec.end();
+}
 
-        video.write(image_copy);
-        cv::imshow("Pose estimation", image_copy);
-        char key = (char)cv::waitKey(wait_time);
-        if (key == 27) {
-            break;
-        }
+void saveCapturedStrings(const std::vector<std::string>& captured_strings, const std::string& filename) {
+    std::ofstream output_file(filename);
+    if (!output_file.is_open()) {
+        std::cerr << "Error opening file for writing!" << std::endl;
+        return;
     }
 
-    in_video.release();
+    for (const auto& str : captured_strings) {
+        output_file << str << std::endl;
+    }
 
-    return 0;
+    output_file.close();
 }
 
+
 void drawMultipleCubesWireframe(cv::InputOutputArray image, cv::InputArray camera_matrix, cv::InputArray dist_coeffs, cv::InputArray rvec, cv::InputArray tvec, float l, const std::vector<int>& values) {
     float half_l = l / 2.0;
     int num_cubes = values.size();
@@ -356,73 +381,3 @@ void drawMultipleCubesWireframe(cv::InputOutputArray image, cv::InputArray camer
         cv::putText(image, value_text, text_origin, cv::FONT_HERSHEY_SIMPLEX, 1.0, cv::Scalar(0, 255, 0), 2);
     }
 }
-)cpp";
-    out.close();
-}
-
-void cmp(const std::string& filename) {
-    std::ifstream inFile(filename);
-    if (!inFile.is_open()) {
-        std::cerr << "Could not open the input file.\n";
-        return;
-    }
-
-    std::vector<int> array;
-    std::string line;
-
-    while (std::getline(inFile, line)) {
-        std::istringstream iss(line);
-        std::string command;
-        iss >> command;
-
-        if (command == "new") {
-            std::cerr << "Processing 'new' command.\n";
-            std::string array_str, equals;
-            int size;
-            iss >> array_str >> equals >> size >> equals;
-
-            if (size > 0) {
-                array.resize(size, 0);
-                std::cerr << "Created array of size " << size << ".\n";
-            } else {
-                std::cerr << "Invalid array size.\n";
-                return;
-            }
-        } else if (command == "insert") {
-            std::cerr << "Processing 'insert' command.\n";
-            std::string token;
-            char parenthesis1, parenthesis2, equals;
-            int index, value;
-            iss >> parenthesis1 >> index >> parenthesis2 >> equals >> value >> token;
-
-            if (index >= 0 && index < array.size()) {
-                array[index] = value;
-                std::cerr << "Inserted " << value << " at position " << index << ".\n";
-            } else {
-                std::cerr << "Invalid index for insert.\n";
-                return;
-            }
-        } else if (command == "delete") {
-            std::cerr << "Processing 'delete' command.\n";
-            std::string token;
-            char parenthesis1, parenthesis2;
-            int index;
-            iss >> parenthesis1 >> index >> parenthesis2 >> token;
-
-            if (index >= 0 && index < array.size()) {
-                array[index] = 0;
-                std::cerr << "Deleted element at position " << index << ".\n";
-            } else {
-                std::cerr << "Invalid index for delete.\n";
-                return;
-            }
-        } else {
-            std::cerr << "Unknown command: " << command << "\n";
-            return;
-        }
-    }
-
-    inFile.close();
-    generateObjectCode(array, "main.cpp");
-    std::cout << "Generated code for the array operations.\n";
-}
@@ -146,6 +146,11 @@ enum CornerRefineMethod{
  *   Parameter is the standard deviation in pixels.  Very noisy images benefit from non-zero values (e.g. 0.8). (default 0.0)
  * - detectInvertedMarker: to check if there is a white marker. In order to generate a "white" marker just
  *   invert a normal marker by using a tilde, ~markerImage. (default false)
+ * - candidateDecimate: when greater than 1, the ArUco approach (any cornerRefinementMethod except
+ *   CORNER_REFINE_APRILTAG) searches candidates on the image downscaled by this factor and refines their
+ *   corners with cornerSubPix on the full resolution image before decoding. Faster on large images at
+ *   the cost of missing markers that become too small. CORNER_REFINE_CONTOUR is skipped in this mode
+ *   since the contours are found at low resolution. (default 0.0)
  */
 struct CV_EXPORTS_W DetectorParameters {
 
@@ -188,6 +193,9 @@ struct CV_EXPORTS_W DetectorParameters {
 
     // to detect white (inverted) markers
     CV_PROP_RW bool detectInvertedMarker;
+
+    // decimation of the candidate search in the ArUco approach
+    CV_PROP_RW float candidateDecimate;
 };
 
 
@@ -223,6 +231,147 @@ CV_EXPORTS_W void detectMarkers(InputArray image, const Ptr<Dictionary> &diction
                                 OutputArrayOfArrays rejectedImgPoints = noArray(), InputArray cameraMatrix= noArray(), InputArray distCoeff= noArray());
 
 
+/**
+ * @brief Marker detection restricted to regions of interest
+ *
+ * @param image input image
+ * @param dictionary indicates the type of markers that will be searched
+ * @param corners vector of detected marker corners, in full image coordinates.
+ * @param ids vector of identifiers of the detected markers.
+ * @param regions image regions where markers are searched, e.g. the padded bounding boxes of
+ * the markers found in the previous frame. Overlapping regions are merged and regions are
+ * clipped to the image, so each marker is reported once.
+ * @param parameters marker detection parameters. minMarkerPerimeterRate and
+ * maxMarkerPerimeterRate stay relative to the whole image, so a marker accepted by
+ * detectMarkers on the full image is also accepted inside a region.
+ * @param rejectedImgPoints contains the imgPoints of those squares whose inner code has not a
+ * correct codification, in full image coordinates.
+ * @param cameraMatrix optional input 3x3 floating-point camera matrix
+ * @param distCoeff optional vector of distortion coefficients
+ *
+ * Same as detectMarkers, but the grey conversion, thresholding, contour search and
+ * identification only run inside the given regions, so the cost depends on the region area
+ * instead of the image size. Markers that are not fully inside a region are not detected.
+ * @sa detectMarkers
+ */
+CV_EXPORTS_AS(detectMarkersInRegions) void detectMarkers(InputArray image, const Ptr<Dictionary> &dictionary,
+                                OutputArrayOfArrays corners, OutputArray ids, const std::vector<Rect> &regions,
+                                const Ptr<DetectorParameters> &parameters = DetectorParameters::create(),
+                                OutputArrayOfArrays rejectedImgPoints = noArray(), InputArray cameraMatrix= noArray(), InputArray distCoeff= noArray());
+
+
+/**
+ * @brief Where the time of marker detection goes, and why candidates are dropped
+ *
+ * Filled by ArucoDetector. The times and counts are summed over the detections since the last
+ * reset, so dividing them by frames gives the average of one image. Times are wall times in
+ * milliseconds. The candidates go through the stages in this order:
+ * - contours: borders traced in the thresholded images, all window sizes together, minus
+ *   rejectedPerimeter (perimeter out of minMarkerPerimeterRate and maxMarkerPerimeterRate),
+ *   rejectedShape (not approximated by a convex quadrilateral with polygonalApproxAccuracyRate),
+ *   rejectedCornerDistance (minCornerDistanceRate) and rejectedImageBorder (minDistanceToBorder),
+ *   give
+ * - candidates: quadrilaterals, or the quads of CORNER_REFINE_APRILTAG, which skips the previous
+ *   checks, minus rejectedTooClose (minMarkerDistanceRate), rejectedBorderBits
+ *   (maxErroneousBitsInBorderRate, minOtsuStdDev) and rejectedDictionary (errorCorrectionRate), give
+ * - markers: the markers found.
+ */
+struct CV_EXPORTS_W_SIMPLE DetectorStatistics {
+
+    CV_WRAP DetectorStatistics();
+
+    /** @brief Set every time and count to zero */
+    CV_WRAP void reset();
+
+    CV_PROP_RW int frames;                  ///< detections the statistics are summed over
+
+    CV_PROP_RW double greyTime;             ///< grey conversion and candidateDecimate downscaling
+    CV_PROP_RW double thresholdTime;        ///< adaptive thresholding of every window size
+    CV_PROP_RW double contourTime;          ///< contour tracing and shape checks, or AprilTag quads
+    CV_PROP_RW double filterTime;           ///< corner ordering and removal of too close candidates
+    CV_PROP_RW double bitsTime;             ///< perspective removal and border bits check
+    CV_PROP_RW double identifyTime;         ///< dictionary lookup
+    CV_PROP_RW double refineTime;           ///< corner refinement, of candidateDecimate included
+    CV_PROP_RW double totalTime;            ///< whole detections, output copies included
+
+    CV_PROP_RW int contours;
+    CV_PROP_RW int rejectedPerimeter;
+    CV_PROP_RW int rejectedShape;
+    CV_PROP_RW int rejectedCornerDistance;
+    CV_PROP_RW int rejectedImageBorder;
+    CV_PROP_RW int candidates;
+    CV_PROP_RW int rejectedTooClose;
+    CV_PROP_RW int rejectedBorderBits;
+    CV_PROP_RW int rejectedDictionary;
+    CV_PROP_RW int markers;
+};
+
+
+/**
+ * @brief Marker detector keeping its buffers from one image to the next
+ *
+ * Finds the same markers as detectMarkers, but the grey image, the thresholded images, the
+ * contours, the candidates and their bits are kept by the detector (the scratch buffers of the
+ * parallel loops once per thread) instead of being allocated again for every image. Once they
+ * have grown to what the images need, detection on a video does not allocate memory, as long
+ * as the corners and ids are std::vector outputs, the image size and parameters do not change and
+ * cornerRefinementMethod is CORNER_REFINE_NONE. The other refinement methods, candidateDecimate
+ * and CORNER_REFINE_APRILTAG still allocate for their own steps.
+ *
+ * The detector also sums DetectorStatistics over its detections.
+ *
+ * A detector must not be used by several threads at the same time.
+ * @sa detectMarkers
+ */
+class CV_EXPORTS_W ArucoDetector {
+public:
+    /**
+     * @param dictionary indicates the type of markers that will be searched
+     * @param parameters marker detection parameters, read again at each detection
+     */
+    ArucoDetector(const Ptr<Dictionary> &dictionary, const Ptr<DetectorParameters> &parameters);
+
+    CV_WRAP static Ptr<ArucoDetector> create(const Ptr<Dictionary> &dictionary,
+                                             const Ptr<DetectorParameters> &parameters = DetectorParameters::create());
+
+    /**
+     * @brief Basic marker detection, same arguments and output as detectMarkers
+     * @sa detectMarkers
+     */
+    CV_WRAP void detectMarkers(InputArray image, OutputArrayOfArrays corners, OutputArray ids,
+                               OutputArrayOfArrays rejectedImgPoints = noArray(),
+                               InputArray cameraMatrix = noArray(), InputArray distCoeff = noArray());
+
+    /**
+     * @brief Marker detection restricted to regions of interest, same arguments and output as
+     * the detectMarkers overload with regions
+     * @sa detectMarkers
+     */
+    CV_WRAP_AS(detectMarkersInRegions) void detectMarkers(InputArray image, OutputArrayOfArrays corners,
+                               OutputArray ids, const std::vector<Rect> &regions,
+                               OutputArrayOfArrays rejectedImgPoints = noArray(),
+                               InputArray cameraMatrix = noArray(), InputArray distCoeff = noArray());
+
+    /**
+     * @brief Statistics of the detections since the detector was created or the statistics reset
+     */
+    CV_WRAP DetectorStatistics getStatistics() const;
+
+    /** @brief Start the statistics over, e.g. after reading them for a reporting period */
+    CV_WRAP void resetStatistics();
+
+    /// the dictionary the markers are searched in
+    CV_PROP_RW Ptr<Dictionary> dictionary;
+
+    /// detection parameters
+    CV_PROP_RW Ptr<DetectorParameters> parameters;
+
+private:
+    struct Workspace;
+    Ptr<Workspace> workspace;
+};
+
+
 
 /**
  * @brief Pose estimation for single markers
@@ -258,6 +407,37 @@ CV_EXPORTS_W void estimatePoseSingleMarkers(InputArrayOfArrays corners, float ma
                                             OutputArray rvecs, OutputArray tvecs, OutputArray _objPoints = noArray());
 
 
+/**
+ * @brief Pose estimation of many square markers at once, with both IPPE solutions
+ *
+ * @param corners detected marker corners, as for estimatePoseSingleMarkers, or all of them in a
+ * single continuous CV_32FC2 array of 4N points
+ * @param markerLength the length of the markers' side
+ * @param cameraMatrix input 3x3 floating-point camera matrix
+ * @param distCoeffs vector of distortion coefficients, as for estimatePoseSingleMarkers
+ * @param rvecs rotation vector of the best pose of each marker (e.g. std::vector<cv::Vec3d>)
+ * @param tvecs translation vector of the best pose of each marker (e.g. std::vector<cv::Vec3d>)
+ * @param rvecs2 rotation vector of the other pose of each marker
+ * @param tvecs2 translation vector of the other pose of each marker
+ * @param reprojectionErrors reprojection errors of both poses of each marker
+ * (e.g. std::vector<cv::Vec2d>), the RMS distance in pixels between the corners and the corners
+ * of the posed marker, measured once the distortion is removed
+ *
+ * Same poses as solvePnPGeneric with SOLVEPNP_IPPE_SQUARE for each marker: a marker seen from the
+ * front has two possible poses, which IPPE computes in closed form and sorts by their
+ * reprojection error. Here the corners of all the markers are undistorted together and the
+ * markers are solved several at a time in SIMD registers, which makes it much faster than
+ * estimatePoseSingleMarkers for more than a few markers. Markers whose corners are degenerate
+ * (e.g. collinear) have null poses and infinite errors.
+ * @sa estimatePoseSingleMarkers, solvePnPGeneric
+ */
+CV_EXPORTS_W void estimatePoseSquareMarkers(InputArrayOfArrays corners, float markerLength,
+                                            InputArray cameraMatrix, InputArray distCoeffs,
+                                            OutputArray rvecs, OutputArray tvecs,
+                                            OutputArray rvecs2 = noArray(), OutputArray tvecs2 = noArray(),
+                                            OutputArray reprojectionErrors = noArray());
+
+
 
 /**
  * @brief Board of markers
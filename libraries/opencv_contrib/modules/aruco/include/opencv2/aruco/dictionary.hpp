@@ -72,8 +72,14 @@ class CV_EXPORTS_W Dictionary {
 
 
     /**
+     * @brief Copies the markers; the copy shares the byte list but has its own lookup tables
+     */
     Dictionary(const Dictionary &_dictionary);
-    */
+
+
+    /**
+      */
+    Dictionary &operator=(const Dictionary &_dictionary);
 
 
     /**
@@ -101,9 +107,26 @@ class CV_EXPORTS_W Dictionary {
     /**
      * @brief Given a matrix of bits. Returns whether if marker is identified or not.
      * It returns by reference the correct id (if any) and the correct rotation
+     *
+     * The result is the first marker of bytesList within the correction distance, as a linear
+     * scan would find it, but for markers of up to 8x8 bits it is looked up in tables built
+     * from bytesList on the first call, so the cost barely depends on the dictionary size. The
+     * tables are built again when another matrix is assigned to bytesList, markerSize or
+     * maxCorrectionBits change. Bytes edited in place in bytesList are not seen by this overload,
+     * only by the one identifying several matrices at once, which detectMarkers uses.
      */
     bool identify(const Mat &onlyBits, int &idx, int &rotation, double maxCorrectionRate) const;
 
+    /**
+     * @brief identify for several matrices of bits at once
+     *
+     * idx is -1 for the matrices that are not identified, or empty. bytesList is compared with
+     * the bytes the lookup tables were built from once for the whole batch, so bytes edited in
+     * place are seen.
+     */
+    void identify(const std::vector<Mat> &onlyBits, std::vector<int> &idx,
+                  std::vector<int> &rotation, double maxCorrectionRate) const;
+
     /**
       * @brief Returns the distance of the input bits to the specific id. If allRotations is true,
       * the four posible bits rotation are considered
@@ -127,6 +150,10 @@ class CV_EXPORTS_W Dictionary {
       * @brief Transform list of bytes to matrix of bits
       */
     CV_WRAP static Mat getBitsFromByteList(const Mat &byteList, int markerSize);
+
+    private:
+    struct Index;
+    Ptr<Index> index; // lookup tables of identify, built on first use
 };
 
 
@@ -0,0 +1,651 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+#include "perf_precomp.hpp"
+
+namespace opencv_test { namespace {
+
+/**
+ * @brief Rows of markers from small to large (2.5% to 10% of the image height), slightly
+ * rotated, on a noisy background
+ */
+static Mat makeScene(const Ptr<aruco::Dictionary> &dictionary, Size size, vector< int > &ids) {
+    RNG rng(0x1234);
+    Mat img(size, CV_8UC1, Scalar::all(128));
+    const double sideRates[] = { 0.025, 0.04, 0.06, 0.1 };
+    const int rows = 4;
+    int id = 0;
+    for(int r = 0; r < rows; r++) {
+        int side = max(cvRound(sideRates[r] * size.height), 8);
+        int cell = size.height / rows;
+        int y = r * cell + cell / 2;
+        for(int x = cell / 2; x + cell / 2 < size.width && id < dictionary->bytesList.rows; x += cell) {
+            Mat marker;
+            aruco::drawMarker(dictionary, id, side, marker);
+            cv::copyMakeBorder(marker, marker, side / 4, side / 4, side / 4, side / 4, BORDER_CONSTANT, Scalar::all(255));
+            Mat transform = getRotationMatrix2D(Point2f(marker.cols / 2.f, marker.rows / 2.f),
+                                                rng.uniform(-30., 30.), 1.);
+            transform.at< double >(0, 2) += x - marker.cols / 2.;
+            transform.at< double >(1, 2) += y - marker.rows / 2.;
+            warpAffine(marker, img, transform, size, INTER_LINEAR, BORDER_TRANSPARENT);
+            ids.push_back(id++);
+        }
+    }
+    Mat noise(size, CV_16SC1);
+    rng.fill(noise, RNG::NORMAL, 0, 3);
+    cv::add(img, noise, img, noArray(), CV_8U);
+    return img;
+}
+
+static double detectionRate(const vector< int > &groundTruth, const vector< int > &ids) {
+    int found = 0;
+    for(size_t i = 0; i < groundTruth.size(); i++)
+        found += std::find(ids.begin(), ids.end(), groundTruth[i]) != ids.end() ? 1 : 0;
+    return groundTruth.empty() ? 0. : (double)found / groundTruth.size();
+}
+
+/**
+ * @brief Average time of each detection stage, in ms per image, recorded next to the throughput
+ */
+static void recordStageTimes(const aruco::DetectorStatistics &stats) {
+    const double frames = max(stats.frames, 1);
+    ::testing::Test::RecordProperty("greyTime", cv::format("%.3f", stats.greyTime / frames));
+    ::testing::Test::RecordProperty("thresholdTime", cv::format("%.3f", stats.thresholdTime / frames));
+    ::testing::Test::RecordProperty("contourTime", cv::format("%.3f", stats.contourTime / frames));
+    ::testing::Test::RecordProperty("filterTime", cv::format("%.3f", stats.filterTime / frames));
+    ::testing::Test::RecordProperty("bitsTime", cv::format("%.3f", stats.bitsTime / frames));
+    ::testing::Test::RecordProperty("identifyTime", cv::format("%.3f", stats.identifyTime / frames));
+    ::testing::Test::RecordProperty("refineTime", cv::format("%.3f", stats.refineTime / frames));
+}
+
+typedef tuple<Size, float> Size_Decimate_t;
+typedef perf::TestBaseWithParam<Size_Decimate_t> Size_Decimate;
+
+PERF_TEST_P(Size_Decimate, detectMarkers_candidateDecimate,
+    testing::Combine(
+        testing::Values(perf::sz720p, perf::sz1080p, perf::sz2160p),
+        testing::Values(0.f, 2.f, 3.f, 4.f)
+    )
+)
+{
+    Size size = get<0>(GetParam());
+    float decimate = get<1>(GetParam());
+
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+    vector< int > groundTruth;
+    Mat img = makeScene(dictionary, size, groundTruth);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    params->candidateDecimate = decimate;
+    vector< vector< Point2f > > corners;
+    vector< int > ids;
+
+    Ptr<aruco::ArucoDetector> detector = aruco::ArucoDetector::create(dictionary, params);
+    TEST_CYCLE() detector->detectMarkers(img, corners, ids);
+
+    // the other half of the trade-off
+    RecordProperty("detection_rate", cv::format("%.3f", detectionRate(groundTruth, ids)));
+    recordStageTimes(detector->getStatistics());
+    SANITY_CHECK_NOTHING();
+}
+
+typedef tuple<Size, int> Size_WinStep_t;
+typedef perf::TestBaseWithParam<Size_WinStep_t> Size_WinStep;
+
+PERF_TEST_P(Size_WinStep, detectMarkers_adaptiveThreshWinSizeStep,
+    testing::Combine(
+        testing::Values(perf::sz720p, perf::sz1080p),
+        testing::Values(10, 4, 2)
+    )
+)
+{
+    Size size = get<0>(GetParam());
+    int step = get<1>(GetParam());
+
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+    vector< int > groundTruth;
+    Mat img = makeScene(dictionary, size, groundTruth);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    params->adaptiveThreshWinSizeStep = step;
+    vector< vector< Point2f > > corners;
+    vector< int > ids;
+
+    Ptr<aruco::ArucoDetector> detector = aruco::ArucoDetector::create(dictionary, params);
+    TEST_CYCLE() detector->detectMarkers(img, corners, ids);
+
+    RecordProperty("detection_rate", cv::format("%.3f", detectionRate(groundTruth, ids)));
+    recordStageTimes(detector->getStatistics());
+    SANITY_CHECK_NOTHING();
+}
+
+/**
+ * @brief A row of markers on a tiled background: each tile is a small dark square, which makes
+ * one candidate per tile and thresholding scale, most of them close to other ones
+ */
+static Mat makeClutteredScene(const Ptr<aruco::Dictionary> &dictionary, Size size, int tileSide,
+                              vector< int > &ids) {
+    RNG rng(0x1234);
+    Mat img(size, CV_8UC1, Scalar::all(200));
+    const int gap = 6;
+    for(int y = gap; y + tileSide < size.height; y += tileSide + gap) {
+        for(int x = gap; x + tileSide < size.width; x += tileSide + gap) {
+            RotatedRect tile(Point2f(x + tileSide / 2.f, y + tileSide / 2.f), Size2f((float)tileSide, (float)tileSide),
+                             rng.uniform(-10.f, 10.f));
+            Point2f corners[4];
+            tile.points(corners);
+            Point polygon[4];
+            for(int c = 0; c < 4; c++)
+                polygon[c] = corners[c];
+            fillConvexPoly(img, polygon, 4, Scalar::all(30));
+        }
+    }
+
+    const int side = size.height / 8;
+    for(int x = side / 2; x + 3 * side / 2 < size.width; x += 2 * side) {
+        Mat marker;
+        aruco::drawMarker(dictionary, (int)ids.size(), side, marker);
+        cv::copyMakeBorder(marker, marker, side / 4, side / 4, side / 4, side / 4, BORDER_CONSTANT, Scalar::all(255));
+        marker.copyTo(img(Rect(x, size.height / 2 - marker.rows / 2, marker.cols, marker.rows)));
+        ids.push_back((int)ids.size());
+    }
+
+    Mat noise(size, CV_16SC1);
+    rng.fill(noise, RNG::NORMAL, 0, 3);
+    cv::add(img, noise, img, noArray(), CV_8U);
+    return img;
+}
+
+typedef tuple<Size, int> Size_TileSide_t;
+typedef perf::TestBaseWithParam<Size_TileSide_t> Size_TileSide;
+
+PERF_TEST_P(Size_TileSide, detectMarkers_clutter,
+    testing::Combine(
+        testing::Values(perf::sz720p, perf::sz1080p),
+        testing::Values(12, 16, 24)
+    )
+)
+{
+    Size size = get<0>(GetParam());
+    int tileSide = get<1>(GetParam());
+
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+    vector< int > groundTruth;
+    Mat img = makeClutteredScene(dictionary, size, tileSide, groundTruth);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    vector< vector< Point2f > > corners, rejected;
+    vector< int > ids;
+
+    Ptr<aruco::ArucoDetector> detector = aruco::ArucoDetector::create(dictionary, params);
+    TEST_CYCLE() detector->detectMarkers(img, corners, ids, rejected);
+
+    RecordProperty("detection_rate", cv::format("%.3f", detectionRate(groundTruth, ids)));
+    RecordProperty("rejected", (int)rejected.size());
+    recordStageTimes(detector->getStatistics());
+    SANITY_CHECK_NOTHING();
+}
+
+/**
+ * @brief Pinhole camera of the synthetic board scenes, with a horizontal field of view of 53 degrees
+ */
+static Mat sceneCamera(Size size) {
+    return (Mat_<double>(3, 3) << size.width, 0, size.width / 2., 0, size.width, size.height / 2., 0, 0, 1);
+}
+
+/**
+ * @brief A board image seen by sceneCamera, tilted by 25 degrees and rolled by 10, filling about
+ * 70% of the frame height, blurred and with Gaussian noise
+ */
+static Mat makeBoardScene(const Mat &boardImage, Size size, double blurSigma, double noiseSigma) {
+    // the board image is a plane of its own size in pixels
+    const float w = (float)boardImage.cols, h = (float)boardImage.rows;
+    vector< Point3f > objCorners;
+    objCorners.push_back(Point3f(-w / 2, -h / 2, 0));
+    objCorners.push_back(Point3f(w / 2, -h / 2, 0));
+    objCorners.push_back(Point3f(w / 2, h / 2, 0));
+    objCorners.push_back(Point3f(-w / 2, h / 2, 0));
+    Mat cameraMatrix = sceneCamera(size);
+    Matx33d tilt, roll;
+    Rodrigues(Vec3d(25 * CV_PI / 180, 0, 0), tilt);
+    Rodrigues(Vec3d(0, 0, 10 * CV_PI / 180), roll);
+    Vec3d rvec, tvec(0, 0, cameraMatrix.at< double >(1, 1) * h / (0.7 * size.height));
+    Rodrigues(roll * tilt, rvec);
+    vector< Point2f > imgCorners;
+    projectPoints(objCorners, rvec, tvec, cameraMatrix, noArray(), imgCorners);
+
+    Point2f src[4] = { Point2f(0, 0), Point2f(w, 0), Point2f(w, h), Point2f(0, h) };
+    Mat img(size, CV_8UC1, Scalar::all(160));
+    warpPerspective(boardImage, img, getPerspectiveTransform(src, &imgCorners[0]), size, INTER_LINEAR,
+                    BORDER_TRANSPARENT);
+    if(blurSigma > 0)
+        GaussianBlur(img, img, Size(), blurSigma);
+    if(noiseSigma > 0) {
+        RNG rng(0x1234);
+        Mat noise(size, CV_16SC1);
+        rng.fill(noise, RNG::NORMAL, 0, noiseSigma);
+        cv::add(img, noise, img, noArray(), CV_8U);
+    }
+    return img;
+}
+
+/**
+ * @brief Image of a grid board of markersX x markersY markers, drawn at the frame width
+ */
+static Mat drawGridBoard(const Ptr<aruco::GridBoard> &board, Size size) {
+    Size boardSize = board->getGridSize();
+    Mat boardImage;
+    board->draw(Size(size.width, size.width * boardSize.height / boardSize.width), boardImage, size.width / 20);
+    return boardImage;
+}
+
+CV_ENUM(BoardDictionary, aruco::DICT_4X4_50, aruco::DICT_5X5_100, aruco::DICT_6X6_250, aruco::DICT_7X7_1000,
+        aruco::DICT_ARUCO_ORIGINAL, aruco::DICT_APRILTAG_36h11)
+
+typedef tuple<Size, BoardDictionary> Size_Dictionary_t;
+typedef perf::TestBaseWithParam<Size_Dictionary_t> Size_Dictionary;
+
+PERF_TEST_P(Size_Dictionary, detectMarkers_board,
+    testing::Combine(
+        testing::Values(perf::szVGA, perf::sz720p, perf::sz1080p),
+        BoardDictionary::all()
+    )
+)
+{
+    Size size = get<0>(GetParam());
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(get<1>(GetParam()));
+    Ptr<aruco::GridBoard> board = aruco::GridBoard::create(6, 4, 0.04f, 0.01f, dictionary);
+    Mat img = makeBoardScene(drawGridBoard(board, size), size, 0., 3.);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    vector< vector< Point2f > > corners;
+    vector< int > ids;
+
+    Ptr<aruco::ArucoDetector> detector = aruco::ArucoDetector::create(dictionary, params);
+    TEST_CYCLE() detector->detectMarkers(img, corners, ids);
+
+    RecordProperty("detection_rate", cv::format("%.3f", detectionRate(board->ids, ids)));
+    recordStageTimes(detector->getStatistics());
+    SANITY_CHECK_NOTHING();
+}
+
+typedef tuple<Size, Size> Size_GridSize_t;
+typedef perf::TestBaseWithParam<Size_GridSize_t> Size_GridSize;
+
+PERF_TEST_P(Size_GridSize, detectMarkers_markerCount,
+    testing::Combine(
+        testing::Values(perf::sz720p, perf::sz1080p),
+        testing::Values(Size(2, 2), Size(5, 4), Size(10, 7), Size(16, 10))
+    )
+)
+{
+    Size size = get<0>(GetParam());
+    Size gridSize = get<1>(GetParam());
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_4X4_250);
+    Ptr<aruco::GridBoard> board = aruco::GridBoard::create(gridSize.width, gridSize.height, 0.04f, 0.01f,
+                                                           dictionary);
+    Mat img = makeBoardScene(drawGridBoard(board, size), size, 0., 3.);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    vector< vector< Point2f > > corners;
+    vector< int > ids;
+
+    Ptr<aruco::ArucoDetector> detector = aruco::ArucoDetector::create(dictionary, params);
+    TEST_CYCLE() detector->detectMarkers(img, corners, ids);
+
+    RecordProperty("detection_rate", cv::format("%.3f", detectionRate(board->ids, ids)));
+    recordStageTimes(detector->getStatistics());
+    SANITY_CHECK_NOTHING();
+}
+
+typedef tuple<double, double> Blur_Noise_t;
+typedef perf::TestBaseWithParam<Blur_Noise_t> Blur_Noise;
+
+PERF_TEST_P(Blur_Noise, detectMarkers_degraded,
+    testing::Combine(
+        testing::Values(0., 1.5, 3.),
+        testing::Values(0., 6., 12.)
+    )
+)
+{
+    double blurSigma = get<0>(GetParam());
+    double noiseSigma = get<1>(GetParam());
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+    Ptr<aruco::GridBoard> board = aruco::GridBoard::create(8, 5, 0.04f, 0.01f, dictionary);
+    Mat img = makeBoardScene(drawGridBoard(board, perf::sz1080p), perf::sz1080p, blurSigma, noiseSigma);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    vector< vector< Point2f > > corners, rejected;
+    vector< int > ids;
+
+    Ptr<aruco::ArucoDetector> detector = aruco::ArucoDetector::create(dictionary, params);
+    TEST_CYCLE() detector->detectMarkers(img, corners, ids, rejected);
+
+    RecordProperty("detection_rate", cv::format("%.3f", detectionRate(board->ids, ids)));
+    RecordProperty("rejected", (int)rejected.size());
+    recordStageTimes(detector->getStatistics());
+    SANITY_CHECK_NOTHING();
+}
+
+CV_ENUM(CornerRefinement, aruco::CORNER_REFINE_NONE, aruco::CORNER_REFINE_SUBPIX, aruco::CORNER_REFINE_CONTOUR,
+        aruco::CORNER_REFINE_APRILTAG)
+
+typedef tuple<Size, CornerRefinement> Size_CornerRefinement_t;
+typedef perf::TestBaseWithParam<Size_CornerRefinement_t> Size_CornerRefinement;
+
+PERF_TEST_P(Size_CornerRefinement, detectMarkers_cornerRefinement,
+    testing::Combine(
+        testing::Values(perf::sz720p, perf::sz1080p),
+        CornerRefinement::all()
+    )
+)
+{
+    Size size = get<0>(GetParam());
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+    Ptr<aruco::GridBoard> board = aruco::GridBoard::create(6, 4, 0.04f, 0.01f, dictionary);
+    Mat img = makeBoardScene(drawGridBoard(board, size), size, 1., 3.);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    params->cornerRefinementMethod = get<1>(GetParam());
+    vector< vector< Point2f > > corners;
+    vector< int > ids;
+
+    Ptr<aruco::ArucoDetector> detector = aruco::ArucoDetector::create(dictionary, params);
+    TEST_CYCLE() detector->detectMarkers(img, corners, ids);
+
+    RecordProperty("detection_rate", cv::format("%.3f", detectionRate(board->ids, ids)));
+    recordStageTimes(detector->getStatistics());
+    SANITY_CHECK_NOTHING();
+}
+
+CV_ENUM(AprilTagDictionary, aruco::DICT_APRILTAG_16h5, aruco::DICT_APRILTAG_25h9, aruco::DICT_APRILTAG_36h10,
+        aruco::DICT_APRILTAG_36h11)
+
+typedef tuple<Size, AprilTagDictionary> Size_AprilTagDictionary_t;
+typedef perf::TestBaseWithParam<Size_AprilTagDictionary_t> Size_AprilTagDictionary;
+
+PERF_TEST_P(Size_AprilTagDictionary, detectMarkers_aprilTag,
+    testing::Combine(
+        testing::Values(perf::sz720p, perf::sz1080p, perf::sz2160p),
+        AprilTagDictionary::all()
+    )
+)
+{
+    Size size = get<0>(GetParam());
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(get<1>(GetParam()));
+    Ptr<aruco::GridBoard> board = aruco::GridBoard::create(6, 4, 0.04f, 0.01f, dictionary);
+    Mat img = makeBoardScene(drawGridBoard(board, size), size, 1., 3.);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    params->cornerRefinementMethod = aruco::CORNER_REFINE_APRILTAG;
+    vector< vector< Point2f > > corners;
+    vector< int > ids;
+
+    Ptr<aruco::ArucoDetector> detector = aruco::ArucoDetector::create(dictionary, params);
+    TEST_CYCLE() detector->detectMarkers(img, corners, ids);
+
+    RecordProperty("detection_rate", cv::format("%.3f", detectionRate(board->ids, ids)));
+    recordStageTimes(detector->getStatistics());
+    SANITY_CHECK_NOTHING();
+}
+
+/**
+ * @brief Detection where every third marker is missed and left among the rejected candidates, as
+ * refineDetectedMarkers is meant to recover them
+ */
+static void detectMissingMarkers(const Mat &img, const Ptr<aruco::Dictionary> &dictionary,
+                                 const Ptr<aruco::DetectorParameters> &params, vector< vector< Point2f > > &corners,
+                                 vector< int > &ids, vector< vector< Point2f > > &rejected) {
+    vector< vector< Point2f > > detectedCorners;
+    vector< int > detectedIds;
+    aruco::detectMarkers(img, dictionary, detectedCorners, detectedIds, params, rejected);
+
+    corners.clear();
+    ids.clear();
+    for(size_t i = 0; i < detectedIds.size(); i++) {
+        if(i % 3 == 0)
+            rejected.push_back(detectedCorners[i]);
+        else {
+            corners.push_back(detectedCorners[i]);
+            ids.push_back(detectedIds[i]);
+        }
+    }
+}
+
+typedef tuple<Size, bool> Size_UseCamera_t;
+typedef perf::TestBaseWithParam<Size_UseCamera_t> Size_UseCamera;
+
+PERF_TEST_P(Size_UseCamera, refineDetectedMarkers,
+    testing::Combine(
+        testing::Values(perf::sz720p, perf::sz1080p),
+        testing::Bool()
+    )
+)
+{
+    Size size = get<0>(GetParam());
+    bool useCamera = get<1>(GetParam());
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+    Ptr<aruco::GridBoard> board = aruco::GridBoard::create(8, 5, 0.04f, 0.01f, dictionary);
+    Mat img = makeBoardScene(drawGridBoard(board, size), size, 0., 3.);
+    Mat cameraMatrix = sceneCamera(size);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    vector< vector< Point2f > > missedCorners, missedRejected;
+    vector< int > missedIds;
+    detectMissingMarkers(img, dictionary, params, missedCorners, missedIds, missedRejected);
+
+    vector< vector< Point2f > > corners, rejected;
+    vector< int > ids;
+    TEST_CYCLE() {
+        corners = missedCorners;
+        ids = missedIds;
+        rejected = missedRejected;
+        aruco::refineDetectedMarkers(img, board, corners, ids, rejected, useCamera ? cameraMatrix : Mat(),
+                                     noArray(), 10.f, 3.f, true, noArray(), params);
+    }
+
+    RecordProperty("detection_rate", cv::format("%.3f", detectionRate(board->ids, ids)));
+    RecordProperty("recovered", (int)(ids.size() - missedIds.size()));
+    SANITY_CHECK_NOTHING();
+}
+
+typedef tuple<Size, double> GridSize_Noise_t;
+typedef perf::TestBaseWithParam<GridSize_Noise_t> GridSize_Noise;
+
+PERF_TEST_P(GridSize_Noise, refineDetectedMarkers_largeBoard,
+    testing::Combine(
+        testing::Values(Size(10, 7), Size(16, 10), Size(24, 16)),
+        testing::Values(0., 12.)
+    )
+)
+{
+    Size gridSize = get<0>(GetParam());
+    double noiseSigma = get<1>(GetParam());
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_1000);
+    Ptr<aruco::GridBoard> board = aruco::GridBoard::create(gridSize.width, gridSize.height, 0.04f, 0.01f,
+                                                           dictionary);
+    Mat img = makeBoardScene(drawGridBoard(board, perf::sz1080p), perf::sz1080p, 0., noiseSigma);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    vector< vector< Point2f > > missedCorners, missedRejected;
+    vector< int > missedIds;
+    detectMissingMarkers(img, dictionary, params, missedCorners, missedIds, missedRejected);
+
+    vector< vector< Point2f > > corners, rejected;
+    vector< int > ids;
+    TEST_CYCLE() {
+        corners = missedCorners;
+        ids = missedIds;
+        rejected = missedRejected;
+        aruco::refineDetectedMarkers(img, board, corners, ids, rejected, noArray(), noArray(), 10.f, 3.f, true,
+                                     noArray(), params);
+    }
+
+    RecordProperty("detection_rate", cv::format("%.3f", detectionRate(board->ids, ids)));
+    RecordProperty("recovered", (int)(ids.size() - missedIds.size()));
+    RecordProperty("rejected", (int)missedRejected.size());
+    SANITY_CHECK_NOTHING();
+}
+
+PERF_TEST_P(Size_UseCamera, interpolateCornersCharuco,
+    testing::Combine(
+        testing::Values(perf::sz720p, perf::sz1080p),
+        testing::Bool()
+    )
+)
+{
+    Size size = get<0>(GetParam());
+    bool useCamera = get<1>(GetParam());
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+    Ptr<aruco::CharucoBoard> board = aruco::CharucoBoard::create(10, 7, 0.04f, 0.03f, dictionary);
+    Mat boardImage;
+    board->draw(Size(size.width, size.width * 7 / 10), boardImage, size.width / 20);
+    Mat img = makeBoardScene(boardImage, size, 0., 3.);
+    Mat cameraMatrix = sceneCamera(size);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    vector< vector< Point2f > > markerCorners;
+    vector< int > markerIds;
+    aruco::detectMarkers(img, dictionary, markerCorners, markerIds, params);
+
+    vector< Point2f > charucoCorners;
+    vector< int > charucoIds;
+    TEST_CYCLE() aruco::interpolateCornersCharuco(markerCorners, markerIds, img, board, charucoCorners, charucoIds,
+                                                  useCamera ? cameraMatrix : Mat());
+
+    RecordProperty("detection_rate", cv::format("%.3f", (double)charucoIds.size() / board->chessboardCorners.size()));
+    SANITY_CHECK_NOTHING();
+}
+
+/**
+ * @brief Dictionary::identify as it was before packed codes: the byte list of the candidate is
+ * compared with every marker
+ */
+static bool identifyByteList(const Ptr<aruco::Dictionary> &dictionary, const Mat &bits,
+                             double maxCorrectionRate, int &idx, int &rotation) {
+    int maxCorrection = int(dictionary->maxCorrectionBits * maxCorrectionRate);
+    Mat candidate = aruco::Dictionary::getByteListFromBits(bits);
+    for(int m = 0; m < dictionary->bytesList.rows; m++) {
+        int minDistance = dictionary->markerSize * dictionary->markerSize + 1;
+        for(int r = 0; r < 4; r++) {
+            int distance = cv::hal::normHamming(dictionary->bytesList.ptr(m) + r * candidate.cols,
+                                                candidate.ptr(), candidate.cols);
+            if(distance < minDistance) {
+                minDistance = distance;
+                rotation = r;
+            }
+        }
+        if(minDistance <= maxCorrection) {
+            idx = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+enum { IDENTIFY_BYTE_LIST, IDENTIFY_PACKED, IDENTIFY_PACKED_BATCH };
+CV_ENUM(IdentifyMethod, IDENTIFY_BYTE_LIST, IDENTIFY_PACKED, IDENTIFY_PACKED_BATCH)
+CV_ENUM(DictionaryName, aruco::DICT_4X4_50, aruco::DICT_4X4_100, aruco::DICT_4X4_250, aruco::DICT_4X4_1000,
+        aruco::DICT_5X5_50, aruco::DICT_5X5_100, aruco::DICT_5X5_250, aruco::DICT_5X5_1000,
+        aruco::DICT_6X6_50, aruco::DICT_6X6_100, aruco::DICT_6X6_250, aruco::DICT_6X6_1000,
+        aruco::DICT_7X7_50, aruco::DICT_7X7_100, aruco::DICT_7X7_250, aruco::DICT_7X7_1000,
+        aruco::DICT_ARUCO_ORIGINAL, aruco::DICT_APRILTAG_16h5, aruco::DICT_APRILTAG_25h9,
+        aruco::DICT_APRILTAG_36h10, aruco::DICT_APRILTAG_36h11)
+
+typedef tuple<DictionaryName, IdentifyMethod> Dictionary_Method_t;
+typedef perf::TestBaseWithParam<Dictionary_Method_t> Dictionary_Method;
+
+PERF_TEST_P(Dictionary_Method, identify,
+    testing::Combine(DictionaryName::all(), IdentifyMethod::all())
+)
+{
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(get<0>(GetParam()));
+    int method = get<1>(GetParam());
+    const double maxCorrectionRate = 0.6; // DetectorParameters::errorCorrectionRate default
+    const int markerSize = dictionary->markerSize;
+
+    // markers with correctable errors, and as many random codes (mostly rejected)
+    RNG rng(0x1234);
+    vector< Mat > candidates(64);
+    for(size_t i = 0; i < candidates.size(); i++) {
+        if(i % 2 == 0) {
+            int id = rng.uniform(0, dictionary->bytesList.rows);
+            candidates[i] = aruco::Dictionary::getBitsFromByteList(dictionary->bytesList.row(id), markerSize);
+            int errors = int(dictionary->maxCorrectionBits * maxCorrectionRate);
+            for(int e = 0; e < errors; e++) {
+                uchar &bit = candidates[i].at< uchar >(rng.uniform(0, markerSize), rng.uniform(0, markerSize));
+                bit = (uchar)(1 - bit);
+            }
+        }
+        else {
+            candidates[i].create(markerSize, markerSize, CV_8UC1);
+            rng.fill(candidates[i], RNG::UNIFORM, 0, 2);
+        }
+    }
+    vector< int > ids(candidates.size(), -1), rotations(candidates.size(), -1);
+
+    TEST_CYCLE() {
+        if(method == IDENTIFY_PACKED_BATCH)
+            dictionary->identify(candidates, ids, rotations, maxCorrectionRate);
+        else {
+            for(size_t i = 0; i < candidates.size(); i++) {
+                if(method == IDENTIFY_BYTE_LIST)
+                    identifyByteList(dictionary, candidates[i], maxCorrectionRate, ids[i], rotations[i]);
+                else
+                    dictionary->identify(candidates[i], ids[i], rotations[i], maxCorrectionRate);
+            }
+        }
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+enum { POSE_SINGLE_MARKERS, POSE_SOLVEPNP_IPPE_SQUARE, POSE_SQUARE_MARKERS };
+CV_ENUM(PoseMethod, POSE_SINGLE_MARKERS, POSE_SOLVEPNP_IPPE_SQUARE, POSE_SQUARE_MARKERS)
+
+typedef tuple<int, PoseMethod> NMarkers_PoseMethod_t;
+typedef perf::TestBaseWithParam<NMarkers_PoseMethod_t> NMarkers_PoseMethod;
+
+PERF_TEST_P(NMarkers_PoseMethod, estimatePose,
+    testing::Combine(testing::Values(1, 5, 20, 100), PoseMethod::all())
+)
+{
+    const int nMarkers = get<0>(GetParam());
+    int method = get<1>(GetParam());
+    const float markerLength = 0.05f;
+    Mat cameraMatrix = (Mat_<double>(3, 3) << 900, 0, 640, 0, 900, 360, 0, 0, 1);
+    Mat distCoeffs = (Mat_<double>(1, 5) << 0.05, -0.1, 0, 0, 0);
+    vector< Point3f > objPoints;
+    objPoints.push_back(Point3f(-markerLength / 2.f, markerLength / 2.f, 0));
+    objPoints.push_back(Point3f(markerLength / 2.f, markerLength / 2.f, 0));
+    objPoints.push_back(Point3f(markerLength / 2.f, -markerLength / 2.f, 0));
+    objPoints.push_back(Point3f(-markerLength / 2.f, -markerLength / 2.f, 0));
+
+    // markers in front of the camera, with detection noise on the corners
+    RNG rng(0x5678);
+    vector< vector< Point2f > > corners(nMarkers);
+    for(int i = 0; i < nMarkers; i++) {
+        Vec3d rvec(rng.uniform(-0.8, 0.8), rng.uniform(-0.8, 0.8), rng.uniform(-3., 3.));
+        Vec3d tvec(rng.uniform(-0.2, 0.2), rng.uniform(-0.1, 0.1), rng.uniform(0.3, 1.));
+        projectPoints(objPoints, rvec, tvec, cameraMatrix, distCoeffs, corners[i]);
+        for(int c = 0; c < 4; c++)
+            corners[i][c] += Point2f((float)rng.gaussian(0.2), (float)rng.gaussian(0.2));
+    }
+    vector< Vec3d > rvecs(nMarkers), tvecs(nMarkers);
+
+    TEST_CYCLE() {
+        if(method == POSE_SINGLE_MARKERS)
+            aruco::estimatePoseSingleMarkers(corners, markerLength, cameraMatrix, distCoeffs, rvecs, tvecs);
+        else if(method == POSE_SOLVEPNP_IPPE_SQUARE) {
+            for(int i = 0; i < nMarkers; i++)
+                solvePnP(objPoints, corners[i], cameraMatrix, distCoeffs, rvecs[i], tvecs[i], false,
+                         SOLVEPNP_IPPE_SQUARE);
+        }
+        else
+            aruco::estimatePoseSquareMarkers(corners, markerLength, cameraMatrix, distCoeffs, rvecs, tvecs);
+    }
+
+    SANITY_CHECK_NOTHING();
+}
+
+}} // namespace
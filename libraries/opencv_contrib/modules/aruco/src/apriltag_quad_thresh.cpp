@@ -17,7 +17,10 @@
 // fractional bit.
 
 #include "precomp.hpp"
+#include <opencv2/imgproc.hpp>
+#include "opencv2/core/hal/intrin.hpp"
 #include "apriltag_quad_thresh.hpp"
+#include "aruco_internal.hpp"
 
 //#define APRIL_DEBUG
 #ifdef APRIL_DEBUG
@@ -572,7 +575,11 @@ int quad_segment_agg(int sz, struct line_fit_pt *lfps, int indices[4]){
 }
 
 #define DO_UNIONFIND(dx, dy) if (im.data[y*s + dy*s + x + dx] == v) unionfind_connect(uf, y*w + x, y*w + dy*w + x + dx);
-static void do_unionfind_line(unionfind_t *uf, Mat &im, int w, int s, int y){
+/**
+ * Joins the pixels of line y with their neighbours on the right (right)
+ * and on the next line (down).
+ */
+static void do_unionfind_line(unionfind_t *uf, const Mat &im, int w, int s, int y, bool right, bool down){
     CV_Assert(y+1 < im.rows);
     CV_Assert(!im.empty());
 
@@ -586,11 +593,15 @@ static void do_unionfind_line(unionfind_t *uf, Mat &im, int w, int s, int y){
         //          (REFERENCE) (1, 0)
         // (-1, 1)    (0, 1)    (1, 1)
         //
-        DO_UNIONFIND(1, 0);
-        DO_UNIONFIND(0, 1);
-        if (v == 255) {
-            DO_UNIONFIND(-1, 1);
-            DO_UNIONFIND(1, 1);
+        if (right) {
+            DO_UNIONFIND(1, 0);
+        }
+        if (down) {
+            DO_UNIONFIND(0, 1);
+            if (v == 255) {
+                DO_UNIONFIND(-1, 1);
+                DO_UNIONFIND(1, 1);
+            }
         }
     }
 }
@@ -1032,27 +1043,23 @@ int fit_quad(const Ptr<DetectorParameters> &_params, const Mat im, zarray_t *clu
  *
  * @param nCidx0
  * @param nCidx1
- * @param nClusters
+ * @param nClusters clusters, indexed by nCidx0 to nCidx1
  * @param nW
  * @param nH
- * @param nquads
+ * @param nquads quad of each cluster
+ * @param fitted set to 1 for the clusters a quad was fitted to, left as it is for the others
  * @param td
  * @param im
  */
-static void do_quad(int nCidx0, int nCidx1, zarray_t &nClusters, int nW, int nH, zarray_t *nquads, const Ptr<DetectorParameters> &td, const Mat im){
-
-    CV_Assert(nquads != NULL);
+static void do_quad(int nCidx0, int nCidx1, zarray_t *nClusters, int nW, int nH, struct sQuad *nquads, uchar *fitted, const Ptr<DetectorParameters> &td, const Mat im){
 
-    //struct quad_task *task = (struct quad_task*) p;
+    CV_Assert(nquads != NULL && fitted != NULL);
 
-    //zarray_t *clusters = nClusters;
-    zarray_t *quads = nquads;
     int w = nW, h = nH;
 
     for (int cidx = nCidx0; cidx < nCidx1; cidx++) {
 
-        zarray_t *cluster;
-        _zarray_get(&nClusters, cidx, &cluster);
+        zarray_t *cluster = &nClusters[cidx];
 
         if (_zarray_size(cluster) < td->aprilTagMinClusterPixels)
             continue;
@@ -1067,15 +1074,86 @@ static void do_quad(int nCidx0, int nCidx1, zarray_t &nClusters, int nW, int nH,
             continue;
         }
 
-        struct sQuad quad;
-        memset(&quad, 0, sizeof(struct sQuad));
+        struct sQuad *quad = &nquads[cidx];
+        memset(quad, 0, sizeof(struct sQuad));
 
-        if (fit_quad(td, im, cluster, &quad)) {
-            //pthread_mutex_lock(&td.mutex);
-            _zarray_add(quads, &quad);
-            //pthread_mutex_unlock(&td.mutex);
+        // each cluster has its own quad, so the clusters can be fitted in parallel
+        fitted[cidx] = fit_quad(td, im, cluster, quad) ? 1 : 0;
+    }
+}
+
+/**
+ * Minimum and maximum of each tile of the rows of tiles ty0 to ty1
+ */
+static void tile_extrema(const Mat &im, int tilesz, int ty0, int ty1, Mat &tileMax, Mat &tileMin){
+    const int tw = tileMax.cols;
+    const size_t s = im.step;
+
+    for (int ty = ty0; ty < ty1; ty++) {
+        const uchar *src = im.ptr<uchar>(ty*tilesz);
+        uchar *max_ = tileMax.ptr<uchar>(ty), *min_ = tileMin.ptr<uchar>(ty);
+
+        int tx = 0;
+#if CV_SIMD
+        if (tilesz == 4) {
+            // each vector holds lanes/4 tiles of a row. The 4 rows are
+            // reduced first, then the 4 bytes of each tile into its first
+            // byte, and the first bytes are packed into lanes tiles.
+            const int lanes = v_uint8::nlanes;
+            const v_uint32 firstByte = vx_setall_u32(0xff);
+            for (; tx <= tw - lanes; tx += lanes) {
+                v_uint32 tmax[4], tmin[4];
+                for (int l = 0; l < 4; l++) {
+                    const uchar *p = src + (tx + l*lanes/4)*4;
+                    v_uint8 r0 = vx_load(p), r1 = vx_load(p + s), r2 = vx_load(p + 2*s), r3 = vx_load(p + 3*s);
+                    v_uint8 vmax = v_max(v_max(r0, r1), v_max(r2, r3));
+                    v_uint8 vmin = v_min(v_min(r0, r1), v_min(r2, r3));
+                    vmax = v_max(vmax, v_reinterpret_as_u8(v_reinterpret_as_u16(vmax) >> 8));
+                    vmin = v_min(vmin, v_reinterpret_as_u8(v_reinterpret_as_u16(vmin) >> 8));
+                    vmax = v_max(vmax, v_reinterpret_as_u8(v_reinterpret_as_u32(vmax) >> 16));
+                    vmin = v_min(vmin, v_reinterpret_as_u8(v_reinterpret_as_u32(vmin) >> 16));
+                    tmax[l] = v_reinterpret_as_u32(vmax) & firstByte;
+                    tmin[l] = v_reinterpret_as_u32(vmin) & firstByte;
+                }
+                v_store(max_ + tx, v_pack(v_pack(tmax[0], tmax[1]), v_pack(tmax[2], tmax[3])));
+                v_store(min_ + tx, v_pack(v_pack(tmin[0], tmin[1]), v_pack(tmin[2], tmin[3])));
+            }
         }
+#endif
+        for (; tx < tw; tx++) {
+            uint8_t max = 0, min = 255;
+
+            for (int dy = 0; dy < tilesz; dy++) {
+                for (int dx = 0; dx < tilesz; dx++) {
+                    uint8_t v = src[dy*s + tx*tilesz + dx];
+                    if (v < min)
+                        min = v;
+                    if (v > max)
+                        max = v;
+                }
+            }
+            max_[tx] = max;
+            min_[tx] = min;
+        }
+    }
+}
+
+/**
+ * Binarizes a row of pixels: 127 where flat is set, otherwise 255 above
+ * thresh and 0 below or at it. flat is either 0 or 255.
+ */
+static void binarize_row(const uchar *src, const uchar *thresh, const uchar *flat, uchar *dst, int w){
+    int x = 0;
+#if CV_SIMD
+    const int lanes = v_uint8::nlanes;
+    const v_uint8 gray = vx_setall_u8(127);
+    for (; x <= w - lanes; x += lanes) {
+        v_uint8 binary = vx_load(src + x) > vx_load(thresh + x);
+        v_store(dst + x, v_select(vx_load(flat + x), gray, binary));
     }
+#endif
+    for (; x < w; x++)
+        dst[x] = flat[x] ? 127 : (src[x] > thresh[x] ? 255 : 0);
 }
 
 /**
@@ -1083,8 +1161,9 @@ static void do_quad(int nCidx0, int nCidx1, zarray_t &nClusters, int nW, int nH,
  * @param mIm
  * @param parameters
  * @param mThresh
+ * @param tiles buffers of the tiles, reused from one call to the next
  */
-void threshold(const Mat mIm, const Ptr<DetectorParameters> &parameters, Mat& mThresh){
+void threshold(const Mat mIm, const Ptr<DetectorParameters> &parameters, Mat& mThresh, ThresholdTiles &tiles){
     int w = mIm.cols, h = mIm.rows;
     int s = (unsigned) mIm.step;
     CV_Assert(w < 32768);
@@ -1122,144 +1201,59 @@ void threshold(const Mat mIm, const Ptr<DetectorParameters> &parameters, Mat& mT
     int tw = w / tilesz;
     int th = h / tilesz;
 
-    uint8_t *im_max = (uint8_t*)calloc(tw*th, sizeof(uint8_t));
-    uint8_t *im_min = (uint8_t*)calloc(tw*th, sizeof(uint8_t));
-
+    CV_Assert(tw > 0 && th > 0);
 
     // first, collect min/max statistics for each tile
-    for (int ty = 0; ty < th; ty++) {
-        for (int tx = 0; tx < tw; tx++) {
-            uint8_t max = 0, min = 255;
-
-            for (int dy = 0; dy < tilesz; dy++) {
-
-                for (int dx = 0; dx < tilesz; dx++) {
-
-                    uint8_t v = mIm.data[(ty*tilesz+dy)*s + tx*tilesz + dx];
-                    if (v < min)
-                        min = v;
-                    if (v > max)
-                        max = v;
-                }
-            }
-            im_max[ty*tw+tx] = max;
-            im_min[ty*tw+tx] = min;
-        }
-    }
+    tiles.max.create(th, tw, CV_8UC1);
+    tiles.min.create(th, tw, CV_8UC1);
+    parallel_for_(Range(0, th), [&](const Range &range) {
+        tile_extrema(mIm, tilesz, range.start, range.end, tiles.max, tiles.min);
+    });
 
     // second, apply 3x3 max/min convolution to "blur" these values
     // over larger areas. This reduces artifacts due to abrupt changes
-    // in the threshold value.
-    uint8_t *im_max_tmp = (uint8_t*)calloc(tw*th, sizeof(uint8_t));
-    uint8_t *im_min_tmp = (uint8_t*)calloc(tw*th, sizeof(uint8_t));
-
-    for (int ty = 0; ty < th; ty++) {
-        for (int tx = 0; tx < tw; tx++) {
-            uint8_t max = 0, min = 255;
-
-            for (int dy = -1; dy <= 1; dy++) {
-                if (ty+dy < 0 || ty+dy >= th)
-                    continue;
-                for (int dx = -1; dx <= 1; dx++) {
-                    if (tx+dx < 0 || tx+dx >= tw)
-                        continue;
-
-                    uint8_t m = im_max[(ty+dy)*tw+tx+dx];
-                    if (m > max)
-                        max = m;
-                    m = im_min[(ty+dy)*tw+tx+dx];
-                    if (m < min)
-                        min = m;
-                }
-            }
-
-            im_max_tmp[ty*tw + tx] = max;
-            im_min_tmp[ty*tw + tx] = min;
-        }
-    }
-    free(im_max);
-    free(im_min);
-    im_max = im_max_tmp;
-    im_min = im_min_tmp;
-
-    for (int ty = 0; ty < th; ty++) {
-        for (int tx = 0; tx < tw; tx++) {
-
-            int min_ = im_min[ty*tw + tx];
-            int max_ = im_max[ty*tw + tx];
-
-            // low contrast region? (no edges)
-            if (max_ - min_ < parameters->aprilTagMinWhiteBlackDiff) {
-                for (int dy = 0; dy < tilesz; dy++) {
-                    int y = ty*tilesz + dy;
-
-                    for (int dx = 0; dx < tilesz; dx++) {
-                        int x = tx*tilesz + dx;
-
-                        //threshim->buf[y*s+x] = 127;
-                        mThresh.data[y*s+x] = 127;
-                    }
-                }
-                continue;
+    // in the threshold value. The default border of dilate and erode
+    // leaves the tiles outside of the image out of the window.
+    dilate(tiles.max, tiles.blurredMax, Mat());
+    erode(tiles.min, tiles.blurredMin, Mat());
+
+    // then threshold each row of tiles, the non-full-sized tiles along
+    // the right and bottom borders included.
+    const int minDiff = parameters->aprilTagMinWhiteBlackDiff;
+    parallel_for_(Range(0, th), [&](const Range &range) {
+        AutoBuffer<uchar> _rowBuf(2*w);
+        uchar *thresh = _rowBuf.data(), *flat = thresh + w;
+
+        for (int ty = range.start; ty < range.end; ty++) {
+            const uchar *max_ = tiles.blurredMax.ptr<uchar>(ty);
+            const uchar *min_ = tiles.blurredMin.ptr<uchar>(ty);
+
+            for (int tx = 0; tx < tw; tx++) {
+                // low contrast region? (no edges) Otherwise, actually
+                // threshold this tile.
+                //
+                // argument for biasing towards dark; specular highlights
+                // can be substantially brighter than white tag parts
+                memset(thresh + tx*tilesz, (max_[tx] + min_[tx]) / 2, tilesz);
+                memset(flat + tx*tilesz, max_[tx] - min_[tx] < minDiff ? 255 : 0, tilesz);
             }
 
-            // otherwise, actually threshold this tile.
+            // the last partial tiles along each row just use the min/max
+            // value from the last full tile, whatever its contrast.
+            memset(thresh + tw*tilesz, thresh[tw*tilesz - 1], w - tw*tilesz);
+            memset(flat + tw*tilesz, 0, w - tw*tilesz);
 
-            // argument for biasing towards dark; specular highlights
-            // can be substantially brighter than white tag parts
-            uint8_t thresh = saturate_cast<uint8_t>((max_ + min_) / 2);
+            for (int y = ty*tilesz; y < (ty + 1)*tilesz; y++)
+                binarize_row(mIm.ptr<uchar>(y), thresh, flat, mThresh.ptr<uchar>(y), w);
 
-            for (int dy = 0; dy < tilesz; dy++) {
-                int y = ty*tilesz + dy;
-
-                for (int dx = 0; dx < tilesz; dx++) {
-                    int x = tx*tilesz + dx;
-
-                    uint8_t v = mIm.data[y*s+x];
-                    mThresh.data[y*s+x] = (v > thresh) ? 255 : 0;
-                }
+            // and so do the rows below the last full row of tiles
+            if (ty == th - 1) {
+                memset(flat, 0, w);
+                for (int y = th*tilesz; y < h; y++)
+                    binarize_row(mIm.ptr<uchar>(y), thresh, flat, mThresh.ptr<uchar>(y), w);
             }
         }
-    }
-
-    // we skipped over the non-full-sized tiles above. Fix those now.
-    for (int y = 0; y < h; y++) {
-
-        // what is the first x coordinate we need to process in this row?
-
-        int x0;
-
-        if (y >= th*tilesz) {
-            x0 = 0; // we're at the bottom; do the whole row.
-        } else {
-            x0 = tw*tilesz; // we only need to do the right most part.
-        }
-
-        // compute tile coordinates and clamp.
-        int ty = y / tilesz;
-        if (ty >= th)
-            ty = th - 1;
-
-        for (int x = x0; x < w; x++) {
-            int tx = x / tilesz;
-            if (tx >= tw)
-                tx = tw - 1;
-
-            int max = im_max[ty*tw + tx];
-            int min = im_min[ty*tw + tx];
-            int thresh = min + (max - min) / 2;
-
-            uint8_t v = mIm.data[y*s+x];
-            if (v > thresh){
-                mThresh.data[y*s+x] = 255;
-            }
-            else{
-                mThresh.data[y*s+x] = 0;
-            }
-        }
-    }
-    free(im_min);
-    free(im_max);
+    });
 
     // this is a dilate/erode deglitching scheme that does not improve
     // anything as far as I can tell.
@@ -1306,14 +1300,94 @@ static void _darken(const Mat &im){
 }
 #endif
 
+/**
+ * Doubles the table of the cluster ids, at least to 1024 slots, and inserts
+ * the ids again.
+ */
+static void cluster_map_grow(ClusterArena &arena){
+    std::vector< uint64_t > ids(std::max((size_t)1024, 2*arena.ids.size()), 0);
+    std::vector< int > slots(ids.size());
+    int shift = 64;
+    for (size_t n = ids.size(); n > 1; n >>= 1)
+        shift--;
+
+    const size_t mask = ids.size() - 1;
+    for (size_t i = 0; i < arena.ids.size(); i++) {
+        if (arena.ids[i] == 0)
+            continue;
+        size_t slot = (size_t)((arena.ids[i] * 0x9E3779B97F4A7C15ULL) >> shift);
+        while (ids[slot] != 0)
+            slot = (slot + 1) & mask;
+        ids[slot] = arena.ids[i];
+        slots[slot] = arena.slots[i];
+    }
+    arena.ids.swap(ids);
+    arena.slots.swap(slots);
+    arena.hashShift = shift;
+}
+
+/**
+ * Index of the cluster with the given id, a new one if the id was not seen
+ * yet. The table uses linear probing and is kept at most half full.
+ */
+static inline int cluster_index(ClusterArena &arena, uint64_t id, int &nclusters){
+    if (2*(size_t)(nclusters + 1) > arena.ids.size())
+        cluster_map_grow(arena);
+
+    const size_t mask = arena.ids.size() - 1;
+    size_t slot = (size_t)((id * 0x9E3779B97F4A7C15ULL) >> arena.hashShift);
+    while (arena.ids[slot] != id) {
+        if (arena.ids[slot] == 0) {
+            arena.ids[slot] = id;
+            arena.slots[slot] = nclusters;
+            return nclusters++;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return arena.slots[slot];
+}
+
+/**
+ * Groups the scanned points by cluster with a counting sort, keeping their
+ * scan order within a cluster, and points a view at each cluster.
+ */
+static void cluster_map_group(ClusterArena &arena, int nclusters){
+    std::vector< int > &offsets = arena.offsets;
+    offsets.assign(nclusters + 1, 0);
+    for (size_t i = 0; i < arena.pointClusters.size(); i++)
+        offsets[arena.pointClusters[i] + 1]++;
+    for (int c = 0; c < nclusters; c++)
+        offsets[c + 1] += offsets[c];
+
+    // offsets[c] moves from the first to the last point of cluster c,
+    // which is the first of c + 1, so they are shifted back afterwards
+    arena.points.resize(arena.scanned.size());
+    for (size_t i = 0; i < arena.scanned.size(); i++)
+        arena.points[offsets[arena.pointClusters[i]]++] = arena.scanned[i];
+    for (int c = nclusters; c > 0; c--)
+        offsets[c] = offsets[c - 1];
+    offsets[0] = 0;
+
+    arena.clusters.resize(nclusters);
+    for (int c = 0; c < nclusters; c++) {
+        zarray_t &cluster = arena.clusters[c];
+        cluster.el_sz = sizeof(struct pt);
+        cluster.size = cluster.alloc = offsets[c + 1] - offsets[c];
+        cluster.data = (char*) (arena.points.data() + offsets[c]);
+    }
+}
+
 /**
  *
  * @param parameters
  * @param mImg
  * @param contours
+ * @param arena buffers of the clusters, reused from one call to the next
+ * @param tiles buffers of the threshold tiles, reused from one call to the next
  * @return
  */
-zarray_t *apriltag_quad_thresh(const Ptr<DetectorParameters> &parameters, const Mat & mImg, std::vector< std::vector< Point > > &contours){
+zarray_t *apriltag_quad_thresh(const Ptr<DetectorParameters> &parameters, const Mat & mImg, std::vector< std::vector< Point > > &contours,
+                               ClusterArena &arena, ThresholdTiles &tiles){
 
     ////////////////////////////////////////////////////////
     // step 1. threshold the image, creating the edge image.
@@ -1321,7 +1395,7 @@ zarray_t *apriltag_quad_thresh(const Ptr<DetectorParameters> &parameters, const
     int w = mImg.cols, h = mImg.rows;
 
     Mat thold(h, w, mImg.type());
-    threshold(mImg, parameters, thold);
+    threshold(mImg, parameters, thold, tiles);
 
     int ts = thold.cols;
 
@@ -1332,17 +1406,40 @@ zarray_t *apriltag_quad_thresh(const Ptr<DetectorParameters> &parameters, const
     ////////////////////////////////////////////////////////
     // step 2. find connected components.
 
-    unionfind_t *uf = unionfind_create(w * h);
-
-    // TODO PARALLELIZE
-    for (int y = 0; y < h - 1; y++) {
-        do_unionfind_line(uf, thold, w, ts, y);
+    // each stripe of rows is labeled on its own, only its pixels are
+    // touched, then the stripes are joined along their seams. The sets,
+    // and their representatives, are the same however the rows are split.
+    unionfind_t *uf = unionfind_alloc(w * h);
+    const int nstripes = std::max(1, std::min((h - 1) / 16, 4 * getNumThreads()));
+    parallel_for_(Range(0, nstripes), [&](const Range &range) {
+        for (int stripe = range.start; stripe < range.end; stripe++) {
+            const int y0 = (int)((int64)h * stripe / nstripes), y1 = (int)((int64)h * (stripe + 1) / nstripes);
+            unionfind_reset(uf, y0*w, stripe + 1 < nstripes ? y1*w : w*h + 1);
+            for (int y = y0; y < y1 - 1; y++) {
+                do_unionfind_line(uf, thold, w, ts, y, true, true);
+            }
+            // the last row of the image is not joined with anything
+            if (y1 < h) {
+                do_unionfind_line(uf, thold, w, ts, y1 - 1, true, false);
+            }
+        }
+    });
+    for (int stripe = 1; stripe < nstripes; stripe++) {
+        do_unionfind_line(uf, thold, w, ts, (int)((int64)h * stripe / nstripes) - 1, false, true);
     }
 
-    // XXX sizing??
-    int nclustermap = 2*w*h - 1;
+    // step 2b. gather the points between adjacent white and black
+    // components into one cluster per pair of components. The points are
+    // appended in scan order with the index of their cluster, then grouped
+    // by cluster once they are all known.
+    std::fill(arena.ids.begin(), arena.ids.end(), (uint64_t)0);
+    arena.pointClusters.clear();
+    arena.scanned.clear();
+    int nclusters = 0;
 
-    struct uint64_zarray_entry **clustermap = (struct uint64_zarray_entry**)calloc(nclustermap, sizeof(struct uint64_zarray_entry*));
+    // consecutive points mostly belong to the same cluster
+    uint64_t lastid = 0;
+    int lastcluster = -1;
 
     for (int y = 1; y < h-1; y++) {
         for (int x = 1; x < w-1; x++) {
@@ -1386,19 +1483,9 @@ zarray_t *apriltag_quad_thresh(const Ptr<DetectorParameters> &parameters, const
                 else                                                \
                 clusterid = (rep0 << 32) + rep1;                \
                 \
-                /* XXX lousy hash function */                       \
-        uint32_t clustermap_bucket = u64hash_2(clusterid) % nclustermap; \
-        struct uint64_zarray_entry *entry = clustermap[clustermap_bucket]; \
-        while (entry && entry->id != clusterid)     {       \
-            entry = entry->next;                            \
-        }                                                   \
-        \
-        if (!entry) {                                       \
-            entry = (struct uint64_zarray_entry*)calloc(1, sizeof(struct uint64_zarray_entry)); \
-            entry->id = clusterid;                          \
-            entry->cluster = _zarray_create(sizeof(struct pt)); \
-            entry->next = clustermap[clustermap_bucket];    \
-            clustermap[clustermap_bucket] = entry;          \
+        if (clusterid != lastid) {                          \
+            lastcluster = cluster_index(arena, clusterid, nclusters); \
+            lastid = clusterid;                             \
         }                                                   \
         \
         struct pt p;                                        \
@@ -1406,7 +1493,8 @@ zarray_t *apriltag_quad_thresh(const Ptr<DetectorParameters> &parameters, const
         p.y = saturate_cast<uint16_t>(2*y + dy);            \
         p.gx = saturate_cast<uint16_t>(dx*((int) v1-v0));   \
         p.gy = saturate_cast<uint16_t>(dy*((int) v1-v0));   \
-        _zarray_add(entry->cluster, &p);                    \
+        arena.scanned.push_back(p);                         \
+        arena.pointClusters.push_back(lastcluster);         \
         }                                                   \
     }
 
@@ -1457,20 +1545,12 @@ out = Mat::zeros(h, w, CV_8UC3);
 
     ////////////////////////////////////////////////////////
     // step 3. process each connected component.
-    zarray_t *clusters = _zarray_create(sizeof(zarray_t*)); //, uint64_zarray_hash_size(clustermap));
-    CV_Assert(clusters != NULL);
-
-    for (int i = 0; i < nclustermap; i++) {
-        for (struct uint64_zarray_entry *entry = clustermap[i]; entry; entry = entry->next) {
-            // XXX reject clusters here?
-            _zarray_add(clusters, &entry->cluster);
-        }
-    }
+    cluster_map_group(arena, nclusters);
+    zarray_t *clusters = arena.clusters.data();
 
 #ifdef APRIL_DEBUG
-for (int i = 0; i < _zarray_size(clusters); i++) {
-    zarray_t *cluster;
-    _zarray_get(clusters, i, &cluster);
+for (int i = 0; i < nclusters; i++) {
+    zarray_t *cluster = &clusters[i];
 
     uint32_t r, g, b;
 
@@ -1495,10 +1575,23 @@ imwrite("2.4 debug_clusters.pnm", out);
 out = Mat::zeros(h, w, CV_8UC3);
 #endif
 
-    for (int i = 0; i < _zarray_size(clusters); i++) {
-        zarray_t *cluster;
-        _zarray_get(clusters, i, &cluster);
+    // fit the clusters in parallel, about 10 tasks per thread since the
+    // clusters differ a lot in size, then keep the quads in cluster order
+    // with the points of their cluster as contour
+    int sz = nclusters;
+    std::vector< struct sQuad > clusterQuads(sz);
+    std::vector< uchar > fitted(sz, 0);
+    parallel_for_(Range(0, sz), [&](const Range &range) {
+        do_quad(range.start, range.end, clusters, w, h, clusterQuads.data(), fitted.data(), parameters, mImg);
+    }, 10. * getNumThreads());
+
+    zarray_t *quads = _zarray_create(sizeof(struct sQuad));
+    for (int i = 0; i < sz; i++) {
+        if (!fitted[i])
+            continue;
+        _zarray_add(quads, &clusterQuads[i]);
 
+        zarray_t *cluster = &clusters[i];
         std::vector< Point > cnt;
         for (int j = 0; j < _zarray_size(cluster); j++) {
             struct pt *p;
@@ -1510,28 +1603,6 @@ out = Mat::zeros(h, w, CV_8UC3);
         contours.push_back(cnt);
     }
 
-    for (int i = 0; i < nclustermap; i++) {
-        struct uint64_zarray_entry *entry = clustermap[i];
-        while (entry) {
-            struct uint64_zarray_entry *tmp = entry->next;
-            free(entry);
-            entry = tmp;
-        }
-    }
-    free(clustermap);
-
-    zarray_t *quads = _zarray_create(sizeof(struct sQuad));
-
-    //int chunksize = 1 + sz / (APRILTAG_TASKS_PER_THREAD_TARGET * numberOfThreads);
-    int chunksize = h / (10 * getNumThreads());
-    int sz = _zarray_size(clusters);
-
-    // TODO PARALLELIZE
-    for (int i = 0; i < sz; i += chunksize) {
-        int min = sz < (i+chunksize)? sz: (i+chunksize);
-        do_quad(i, min, *clusters, w, h, quads, parameters, mImg);
-    }
-
 #ifdef APRIL_DEBUG
 mImg.copyTo(out);
 _darken(out);
@@ -1557,14 +1628,25 @@ imwrite("2.5 debug_lines.pnm", out);
 #endif
 
     unionfind_destroy(uf);
-
-    for (int i = 0; i < _zarray_size(clusters); i++) {
-        zarray_t *cluster;
-        _zarray_get(clusters, i, &cluster);
-        _zarray_destroy(cluster);
-    }
-    _zarray_destroy(clusters);
     return quads;
 }
 
+namespace internal {
+
+/**
+ */
+void aprilTagThreshold(const Mat &grey, int minWhiteBlackDiff, Mat &thresh){
+    CV_Assert(grey.type() == CV_8UC1);
+    Ptr<DetectorParameters> parameters = DetectorParameters::create();
+    parameters->aprilTagMinWhiteBlackDiff = minWhiteBlackDiff;
+
+    // threshold() writes its output with the step of its input
+    Mat buffer(grey.rows, (int)grey.step, CV_8UC1);
+    thresh = buffer.colRange(0, grey.cols);
+    ThresholdTiles tiles;
+    threshold(grey, parameters, thresh, tiles);
+}
+
+} // namespace internal
+
 }}
@@ -27,17 +27,6 @@
 namespace cv {
 namespace aruco {
 
-static inline uint32_t u64hash_2(uint64_t x) {
-    return uint32_t((2654435761UL * x) >> 32);
-}
-
-struct uint64_zarray_entry{
-    uint64_t id;
-    zarray_t *cluster;
-
-    struct uint64_zarray_entry *next;
-};
-
 struct pt{
     // Note: these represent 2*actual value.
     uint16_t x, y;
@@ -45,6 +34,33 @@ struct pt{
     int16_t gx, gy;
 };
 
+/**
+ * Boundary points of the clusters of one image, grouped by cluster in a
+ * single buffer. Its size follows the number of boundary points rather than
+ * the image area, and the buffers are kept from one image to the next.
+ */
+struct ClusterArena{
+    ClusterArena() : hashShift(64) {}
+
+    std::vector< uint64_t > ids;        // open addressing table of the cluster ids, 0 for a free slot
+    std::vector< int > slots;           // cluster index of each id
+    int hashShift;                      // 64 - log2 of the table size
+    std::vector< int > pointClusters;   // cluster index of each point, in scan order
+    std::vector< struct pt > scanned;   // points in scan order
+    std::vector< int > offsets;         // first point of each cluster in points, then the end
+    std::vector< struct pt > points;    // points grouped by cluster, in scan order within a cluster
+    std::vector< zarray_t > clusters;   // views of the points of each cluster, which do not own them
+};
+
+/**
+ * Minimum and maximum of the tiles of threshold(), kept from one image to
+ * the next.
+ */
+struct ThresholdTiles{
+    Mat max, min;                       // of each tile
+    Mat blurredMax, blurredMin;         // over the 3x3 surrounding tiles
+};
+
 struct remove_vertex{
     int i;           // which vertex to remove?
     int left, right; // left vertex, right vertex
@@ -109,17 +125,21 @@ int fit_quad(const Ptr<DetectorParameters> &_params, const Mat im, zarray_t *clu
  * @param mIm
  * @param parameters
  * @param mThresh
+ * @param tiles buffers of the tiles, reused from one call to the next
  */
-void threshold(const Mat mIm, const Ptr<DetectorParameters> &parameters, Mat& mThresh);
+void threshold(const Mat mIm, const Ptr<DetectorParameters> &parameters, Mat& mThresh, ThresholdTiles &tiles);
 
 /**
  *
  * @param parameters
  * @param mImg
  * @param contours
+ * @param arena buffers of the clusters, reused from one call to the next
+ * @param tiles buffers of the threshold tiles, reused from one call to the next
  * @return
  */
-zarray_t *apriltag_quad_thresh(const Ptr<DetectorParameters> &parameters, const Mat & mImg, std::vector< std::vector< Point > > &contours);
+zarray_t *apriltag_quad_thresh(const Ptr<DetectorParameters> &parameters, const Mat & mImg, std::vector< std::vector< Point > > &contours,
+                               ClusterArena &arena, ThresholdTiles &tiles);
 
 }}
 #endif
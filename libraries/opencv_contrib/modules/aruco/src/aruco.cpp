@@ -40,8 +40,11 @@ the use of this software, even if advised of the possibility of such damage.
 #include "opencv2/aruco.hpp"
 #include <opencv2/core.hpp>
 #include <opencv2/imgproc.hpp>
+#include "opencv2/core/hal/intrin.hpp"
+#include "opencv2/core/utils/tls.hpp"
 
 #include "apriltag_quad_thresh.hpp"
+#include "aruco_internal.hpp"
 #include "zarray.hpp"
 
 //#define APRIL_DEBUG
@@ -87,7 +90,8 @@ DetectorParameters::DetectorParameters()
       aprilTagMaxLineFitMse(10.0),
       aprilTagMinWhiteBlackDiff(5),
       aprilTagDeglitch(0),
-      detectInvertedMarker(false){}
+      detectInvertedMarker(false),
+      candidateDecimate(0.0){}
 
 
 /**
@@ -99,6 +103,35 @@ Ptr<DetectorParameters> DetectorParameters::create() {
 }
 
 
+/**
+  *
+  */
+DetectorStatistics::DetectorStatistics() {
+    reset();
+}
+
+
+/**
+  */
+void DetectorStatistics::reset() {
+    frames = 0;
+    greyTime = thresholdTime = contourTime = filterTime = bitsTime = identifyTime = refineTime = totalTime = 0;
+    contours = rejectedPerimeter = rejectedShape = rejectedCornerDistance = rejectedImageBorder = 0;
+    candidates = rejectedTooClose = rejectedBorderBits = rejectedDictionary = markers = 0;
+}
+
+
+/**
+  * @brief Milliseconds elapsed since tick, which is moved to now for the next stage
+  */
+static inline double _lapTime(int64 &tick) {
+    int64 now = getTickCount();
+    double ms = (double)(now - tick) * 1000. / getTickFrequency();
+    tick = now;
+    return ms;
+}
+
+
 /**
   * @brief Convert input image to gray if it is a 3-channels image
   */
@@ -114,98 +147,592 @@ static void _convertToGrey(InputArray _in, OutputArray _out) {
 
 
 /**
-  * @brief Threshold input image using adaptive thresholding
+  * @brief Mean of a box from its pixel sum, rounded exactly as boxFilter does for CV_8U
   */
-static void _threshold(InputArray _in, OutputArray _out, int winSize, double constant) {
+class _BoxMean {
+public:
+    enum { SHIFT = 23 };
+
+    explicit _BoxMean(int winSize) : area(winSize * winSize), divScale(1), divDelta(0) {
+        // boxFilter sums windows of up to 256 pixels in 16 bits and divides in fixed point
+        fixedPoint = area <= 256;
+        if(fixedPoint) {
+            double scalef = ((double)(1 << SHIFT)) / area;
+            divScale = cvFloor(scalef);
+            scalef -= divScale;
+            divDelta = area / 2;
+            if(scalef < 0.5)
+                divDelta++;
+            else
+                divScale++;
+        }
+    }
 
-    CV_Assert(winSize >= 3);
-    if(winSize % 2 == 0) winSize++; // win size must be odd
-    adaptiveThreshold(_in, _out, 255, ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV, winSize, constant);
-}
+    inline int operator()(unsigned sum) const {
+        if(fixedPoint)
+            return (int)(((sum + divDelta) * divScale) >> SHIFT);
+        return cvRound(sum * (1. / area));
+    }
+
+    int area;
+    bool fixedPoint;
+    unsigned divScale, divDelta;
+};
 
 
 /**
-  * @brief Given a tresholded image, find the contours, calculate their polygonal approximation
-  * and take those that accomplish some conditions
+  * @brief Buffers of _thresholdMultiScale for one thread
   */
-static void _findMarkerContours(InputArray _in, vector< vector< Point2f > > &candidates,
-                                vector< vector< Point > > &contoursOut, double minPerimeterRate,
-                                double maxPerimeterRate, double accuracyRate,
-                                double minCornerDistanceRate, int minDistanceToBorder) {
+struct _ThresholdScratch {
+    Mat padded;   // band of rows with replicated borders
+    Mat integral; // its integral
+};
 
-    CV_Assert(minPerimeterRate > 0 && maxPerimeterRate > 0 && accuracyRate > 0 &&
-              minCornerDistanceRate >= 0 && minDistanceToBorder >= 0);
 
-    // calculate maximum and minimum sizes in pixels
-    unsigned int minPerimeterPixels =
-        (unsigned int)(minPerimeterRate * max(_in.getMat().cols, _in.getMat().rows));
-    unsigned int maxPerimeterPixels =
-        (unsigned int)(maxPerimeterRate * max(_in.getMat().cols, _in.getMat().rows));
-
-    Mat contoursImg;
-    _in.getMat().copyTo(contoursImg);
-    vector< vector< Point > > contours;
-    findContours(contoursImg, contours, RETR_LIST, CHAIN_APPROX_NONE);
-    // now filter list of contours
-    for(unsigned int i = 0; i < contours.size(); i++) {
-        // check perimeter
-        if(contours[i].size() < minPerimeterPixels || contours[i].size() > maxPerimeterPixels)
-            continue;
+/**
+  * @brief Body of _thresholdMultiScale for a range of bands of rows
+  */
+class ThresholdBandsParallel : public ParallelLoopBody {
+public:
+    ThresholdBandsParallel(const Mat &_grey, const vector< int > &_winSizes, int _delta, uchar _maxValue,
+                           int _maxRadius, int _bandHeight, vector< Mat > &_thresholds,
+                           const TLSData< _ThresholdScratch > &_scratch)
+        : grey(_grey), winSizes(_winSizes), delta(_delta), maxValue(_maxValue), R(_maxRadius),
+          bandHeight(_bandHeight), thresholds(_thresholds), scratch(_scratch) {}
+
+    void operator()(const Range &range) const CV_OVERRIDE {
+        const int width = grey.cols, height = grey.rows;
+        const int nScales = (int)winSizes.size();
+
+        // kept by the thread from one band and one call to the next, the bands use their top rows
+        _ThresholdScratch &buffers = scratch.getRef();
+        buffers.padded.create(bandHeight + 2 * R, width + 2 * R, CV_8UC1);
+        buffers.integral.create(bandHeight + 2 * R + 1, width + 2 * R + 1, CV_32SC1);
+
+        for(int band = range.start; band < range.end; band++) {
+            const int y0 = band * bandHeight, y1 = min(height, y0 + bandHeight);
+            const int rows = y1 - y0 + 2 * R;
+
+            // rows y0 - R .. y1 + R - 1 and columns -R .. width + R - 1, the image being extended by
+            // replicating its border
+            Mat padded = buffers.padded.rowRange(0, rows);
+            for(int i = 0; i < rows; i++) {
+                const uchar *src = grey.ptr< uchar >(min(max(y0 - R + i, 0), height - 1));
+                uchar *dst = padded.ptr< uchar >(i);
+                memset(dst, src[0], R);
+                memcpy(dst + R, src, width);
+                memset(dst + R + width, src[width - 1], R);
+            }
+            // SIMD in cv::integral, the box sums below read it as unsigned
+            Mat integral = buffers.integral.rowRange(0, rows + 1);
+            cv::integral(padded, integral, CV_32S);
+
+            for(int k = 0; k < nScales; k++) {
+                const int r = (winSizes[k] | 1) / 2; // win size must be odd
+                const int w = 2 * r + 1;
+                const _BoxMean boxMean(w);
+                for(int y = y0; y < y1; y++) {
+                    // rows y - r and y + r + 1 of the integral, relative to the band
+                    const unsigned *top = integral.ptr< unsigned >(y - r - (y0 - R)) + R - r;
+                    const unsigned *bottom = integral.ptr< unsigned >(y + r + 1 - (y0 - R)) + R - r;
+                    const uchar *src = grey.ptr< uchar >(y);
+                    uchar *dst = thresholds[k].ptr< uchar >(y);
+
+                    int x = 0;
+#if CV_SIMD
+                    if(boxMean.fixedPoint) {
+                        const v_uint32 vdd = vx_setall_u32(boxMean.divDelta);
+                        const v_uint32 vds = vx_setall_u32(boxMean.divScale);
+                        const v_int32 vdelta = vx_setall_s32(delta);
+                        const v_uint8 vmax = vx_setall_u8(maxValue);
+                        const int lanes = v_uint32::nlanes;
+                        for(; x <= width - 4 * lanes; x += 4 * lanes) {
+                            v_int32 m[4];
+                            for(int l = 0; l < 4; l++) {
+                                int xl = x + l * lanes;
+                                v_uint32 sum = vx_load(bottom + xl + w) - vx_load(bottom + xl) -
+                                               vx_load(top + xl + w) + vx_load(top + xl);
+                                m[l] = v_reinterpret_as_s32(v_shr<_BoxMean::SHIFT>((sum + vdd) * vds));
+                            }
+                            v_uint16 s0, s1;
+                            v_expand(vx_load(src + x), s0, s1);
+                            v_uint32 p0, p1, p2, p3;
+                            v_expand(s0, p0, p1);
+                            v_expand(s1, p2, p3);
+                            v_int32 c0 = (v_reinterpret_as_s32(p0) + vdelta) <= m[0];
+                            v_int32 c1 = (v_reinterpret_as_s32(p1) + vdelta) <= m[1];
+                            v_int32 c2 = (v_reinterpret_as_s32(p2) + vdelta) <= m[2];
+                            v_int32 c3 = (v_reinterpret_as_s32(p3) + vdelta) <= m[3];
+                            // all-ones masks saturate to -1 through both packs, i.e. 255
+                            v_store(dst + x, v_reinterpret_as_u8(v_pack(v_pack(c0, c1), v_pack(c2, c3))) & vmax);
+                        }
+                    }
+#endif
+                    for(; x < width; x++) {
+                        unsigned sum = bottom[x + w] - bottom[x] - top[x + w] + top[x];
+                        dst[x] = src[x] + delta <= boxMean(sum) ? maxValue : 0;
+                    }
+                }
+            }
+        }
+    }
 
-        // check is square and is convex
-        vector< Point > approxCurve;
-        approxPolyDP(contours[i], approxCurve, double(contours[i].size()) * accuracyRate, true);
-        if(approxCurve.size() != 4 || !isContourConvex(approxCurve)) continue;
+private:
+    ThresholdBandsParallel &operator=(const ThresholdBandsParallel &); // to quiet MSVC
 
-        // check min distance between corners
-        double minDistSq =
-            max(contoursImg.cols, contoursImg.rows) * max(contoursImg.cols, contoursImg.rows);
-        for(int j = 0; j < 4; j++) {
-            double d = (double)(approxCurve[j].x - approxCurve[(j + 1) % 4].x) *
-                           (double)(approxCurve[j].x - approxCurve[(j + 1) % 4].x) +
-                       (double)(approxCurve[j].y - approxCurve[(j + 1) % 4].y) *
-                           (double)(approxCurve[j].y - approxCurve[(j + 1) % 4].y);
-            minDistSq = min(minDistSq, d);
+    const Mat &grey;
+    const vector< int > &winSizes;
+    int delta;
+    uchar maxValue;
+    int R, bandHeight;
+    vector< Mat > &thresholds;
+    const TLSData< _ThresholdScratch > &scratch;
+};
+
+
+/**
+  * @brief Threshold input image using adaptive thresholding for several window sizes at once
+  *
+  * Same output as adaptiveThreshold (ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV) for each window
+  * size, but all the box sums come from one integral image computed per band of rows (with
+  * replicated borders), so the input is read once however many window sizes are requested.
+  * Foreground pixels are set to maxValue. Outputs that already have the size of grey are
+  * written in place, so they can be views into larger buffers. The integral of each thread is
+  * kept in scratch for the next call.
+  */
+static void _thresholdMultiScale(const Mat &grey, const vector< int > &winSizes, double constant,
+                                 uchar maxValue, vector< Mat > &thresholds,
+                                 const TLSData< _ThresholdScratch > &scratch) {
+
+    CV_Assert(grey.type() == CV_8UC1 && !grey.empty());
+
+    const int nScales = (int)winSizes.size();
+    int maxRadius = 0;
+    for(int k = 0; k < nScales; k++) {
+        CV_Assert(winSizes[k] >= 3);
+        maxRadius = max(maxRadius, (winSizes[k] | 1) / 2);
+    }
+
+    thresholds.resize(nScales);
+    for(int k = 0; k < nScales; k++)
+        thresholds[k].create(grey.size(), CV_8UC1);
+
+    // pixels with grey + delta <= mean become maxValue, as adaptiveThreshold THRESH_BINARY_INV
+    const int delta = cvFloor(constant);
+    const int bandHeight = max(64, 4 * maxRadius);
+    const int nBands = (grey.rows + bandHeight - 1) / bandHeight;
+
+    parallel_for_(Range(0, nBands), ThresholdBandsParallel(grey, winSizes, delta, maxValue, maxRadius,
+                                                           bandHeight, thresholds, scratch));
+}
+
+
+/**
+  * @brief Polygonal approximation of a closed contour, as approxPolyDP with closed = true
+  *
+  * Same Douglas-Peucker steps, and so the same polygon, but the output and the stack of the
+  * recursion are buffers of the caller instead of memory allocated on each call.
+  */
+static void _approxClosedContour(const Point *src, int count, double eps, vector< Point > &dst,
+                                 vector< Range > &stack) {
+
+    dst.clear();
+    stack.clear();
+    if(count == 0)
+        return;
+    dst.resize(count);
+
+    eps *= eps;
+    Range slice(0, 0), rightSlice(0, 0);
+    Point startPt(-1000000, -1000000), endPt(0, 0), pt(0, 0);
+    int pos = 0, newCount = 0;
+    bool leEps = false;
+
+    // 1. find approximately two farthest points of the contour
+    for(int i = 0; i < 3; i++) {
+        double maxDist = 0;
+        pos = (pos + rightSlice.start) % count;
+        startPt = src[pos];
+        if(++pos >= count) pos = 0;
+        for(int j = 1; j < count; j++) {
+            pt = src[pos];
+            if(++pos >= count) pos = 0;
+            double dx = pt.x - startPt.x, dy = pt.y - startPt.y;
+            double dist = dx * dx + dy * dy;
+            if(dist > maxDist) {
+                maxDist = dist;
+                rightSlice.start = j;
+            }
+        }
+        leEps = maxDist <= eps;
+    }
+
+    // 2. initialize the stack
+    if(!leEps) {
+        rightSlice.end = slice.start = pos % count;
+        slice.end = rightSlice.start = (rightSlice.start + slice.start) % count;
+        stack.push_back(rightSlice);
+        stack.push_back(slice);
+    }
+    else
+        dst[newCount++] = startPt;
+
+    // 3. split the slices until their points are close enough to their chord
+    while(!stack.empty()) {
+        slice = stack.back();
+        stack.pop_back();
+        endPt = src[slice.end];
+        pos = slice.start;
+        startPt = src[pos];
+        if(++pos >= count) pos = 0;
+
+        if(pos != slice.end) {
+            double dx = endPt.x - startPt.x, dy = endPt.y - startPt.y, maxDist = 0;
+            while(pos != slice.end) {
+                pt = src[pos];
+                if(++pos >= count) pos = 0;
+                double dist = fabs((pt.y - startPt.y) * dx - (pt.x - startPt.x) * dy);
+                if(dist > maxDist) {
+                    maxDist = dist;
+                    rightSlice.start = (pos + count - 1) % count;
+                }
+            }
+            leEps = maxDist * maxDist <= eps * (dx * dx + dy * dy);
+        }
+        else {
+            leEps = true;
+            // read starting point
+            startPt = src[slice.start];
         }
-        double minCornerDistancePixels = double(contours[i].size()) * minCornerDistanceRate;
-        if(minDistSq < minCornerDistancePixels * minCornerDistancePixels) continue;
 
-        // check if it is too near to the image border
-        bool tooNearBorder = false;
-        for(int j = 0; j < 4; j++) {
-            if(approxCurve[j].x < minDistanceToBorder || approxCurve[j].y < minDistanceToBorder ||
-               approxCurve[j].x > contoursImg.cols - 1 - minDistanceToBorder ||
-               approxCurve[j].y > contoursImg.rows - 1 - minDistanceToBorder)
-                tooNearBorder = true;
+        if(leEps)
+            dst[newCount++] = startPt;
+        else {
+            rightSlice.end = slice.end;
+            slice.end = rightSlice.start;
+            stack.push_back(rightSlice);
+            stack.push_back(slice);
         }
-        if(tooNearBorder) continue;
+    }
 
-        // if it passes all the test, add to candidates vector
-        vector< Point2f > currentCandidate;
-        currentCandidate.resize(4);
-        for(int j = 0; j < 4; j++) {
-            currentCandidate[j] = Point2f((float)approxCurve[j].x, (float)approxCurve[j].y);
+    // 4. remove the extra points on almost straight lines
+    count = newCount;
+    pos = count - 1;
+    startPt = dst[pos];
+    if(++pos >= count) pos = 0;
+    int wpos = pos;
+    pt = dst[pos];
+    if(++pos >= count) pos = 0;
+    for(int i = 0; i < count && newCount > 2; i++) {
+        endPt = dst[pos];
+        if(++pos >= count) pos = 0;
+        double dx = endPt.x - startPt.x, dy = endPt.y - startPt.y;
+        double dist = fabs((pt.x - startPt.x) * dy - (pt.y - startPt.y) * dx);
+        double successiveInnerProduct =
+            (pt.x - startPt.x) * (endPt.x - pt.x) + (pt.y - startPt.y) * (endPt.y - pt.y);
+
+        if(dist * dist <= 0.5 * eps * (dx * dx + dy * dy) && dx != 0 && dy != 0 &&
+           successiveInnerProduct >= 0) {
+            newCount--;
+            dst[wpos] = startPt = endPt;
+            if(++wpos >= count) wpos = 0;
+            pt = dst[pos];
+            if(++pos >= count) pos = 0;
+            i++;
+            continue;
         }
-        candidates.push_back(currentCandidate);
-        contoursOut.push_back(contours[i]);
+        dst[wpos] = startPt = pt;
+        if(++wpos >= count) wpos = 0;
+        pt = endPt;
     }
+    dst.resize(newCount);
 }
 
 
 /**
-  * @brief Assure order of candidate corners is clockwise direction
+  * @brief Outcome of _isQuadCandidate, the check a contour fails first
   */
-static void _reorderCandidatesCorners(vector< vector< Point2f > > &candidates) {
+enum QuadCheck {
+    QUAD_ACCEPTED = 0,
+    QUAD_NOT_CONVEX_QUAD,       // not approximated by a convex quadrilateral
+    QUAD_CORNERS_TOO_CLOSE,
+    QUAD_NEAR_IMAGE_BORDER
+};
 
-    for(unsigned int i = 0; i < candidates.size(); i++) {
-        double dx1 = candidates[i][1].x - candidates[i][0].x;
-        double dy1 = candidates[i][1].y - candidates[i][0].y;
-        double dx2 = candidates[i][2].x - candidates[i][0].x;
-        double dy2 = candidates[i][2].y - candidates[i][0].y;
+
+/**
+  * @brief Check if a contour is a quadrilateral good enough to be a marker candidate
+  * (convex, without too close corners and far enough from the image border)
+  */
+static QuadCheck _isQuadCandidate(const Point *contour, int length, vector< Point > &approxCurve,
+                             vector< Range > &approxStack, Size imageSize, double accuracyRate,
+                             double minCornerDistanceRate, int minDistanceToBorder) {
+
+    // check is square and is convex
+    _approxClosedContour(contour, length, double(length) * accuracyRate, approxCurve, approxStack);
+    if(approxCurve.size() != 4 || !isContourConvex(approxCurve)) return QUAD_NOT_CONVEX_QUAD;
+
+    // check min distance between corners
+    double minDistSq =
+        max(imageSize.width, imageSize.height) * max(imageSize.width, imageSize.height);
+    for(int j = 0; j < 4; j++) {
+        double d = (double)(approxCurve[j].x - approxCurve[(j + 1) % 4].x) *
+                       (double)(approxCurve[j].x - approxCurve[(j + 1) % 4].x) +
+                   (double)(approxCurve[j].y - approxCurve[(j + 1) % 4].y) *
+                       (double)(approxCurve[j].y - approxCurve[(j + 1) % 4].y);
+        minDistSq = min(minDistSq, d);
+    }
+    double minCornerDistancePixels = double(length) * minCornerDistanceRate;
+    if(minDistSq < minCornerDistancePixels * minCornerDistancePixels) return QUAD_CORNERS_TOO_CLOSE;
+
+    // check if it is too near to the image border
+    for(int j = 0; j < 4; j++) {
+        if(approxCurve[j].x < minDistanceToBorder || approxCurve[j].y < minDistanceToBorder ||
+           approxCurve[j].x > imageSize.width - 1 - minDistanceToBorder ||
+           approxCurve[j].y > imageSize.height - 1 - minDistanceToBorder)
+            return QUAD_NEAR_IMAGE_BORDER;
+    }
+    return QUAD_ACCEPTED;
+}
+
+
+/**
+  * @brief Marker candidates and their contours, stored back to back so that clearing the list
+  * keeps its buffers
+  */
+struct _CandidateList {
+    vector< Point2f > corners;  // four corners of each candidate
+    vector< Point > points;     // contours of the candidates back to back
+    vector< int > ends;         // end of each contour in points
+
+    int size() const { return (int)ends.size(); }
+
+    void clear() {
+        corners.clear();
+        points.clear();
+        ends.clear();
+    }
+
+    Point2f *candidate(int i) { return &corners[4 * i]; }
+    const Point2f *candidate(int i) const { return &corners[4 * i]; }
+
+    int contourSize(int i) const { return ends[i] - (i > 0 ? ends[i - 1] : 0); }
+    const Point *contour(int i) const { return points.data() + (i > 0 ? ends[i - 1] : 0); }
+
+    void push_back(const Point2f *candidateCorners, const Point *contour, int contourSize) {
+        corners.insert(corners.end(), candidateCorners, candidateCorners + 4);
+        points.insert(points.end(), contour, contour + contourSize);
+        ends.push_back((int)points.size());
+    }
+
+    /** @brief Append candidate i of list, with its contour */
+    void push_back(const _CandidateList &list, int i) {
+        push_back(list.candidate(i), list.contour(i), list.contourSize(i));
+    }
+};
+
+
+/**
+  * @brief Buffers of _traceMarkerContours for one thresholding scale
+  */
+struct _ContourArena {
+    Mat labels;                 // 0/1 threshold with a zero frame of one pixel, traced in place
+    _CandidateList found;       // accepted contours, then in found.points the one being traced
+    vector< Point > approxCurve;
+    vector< Range > approxStack;
+    int traced;                 // borders followed
+    int rejectedPerimeter;
+    int rejected[4];            // by QuadCheck, of the borders within the perimeter limits
+
+    /** @brief Allocate labels for an image of the given size and clear its frame */
+    void create(Size size) {
+        labels.create(size.height + 2, size.width + 2, CV_8UC1);
+        labels.row(0).setTo(Scalar::all(0));
+        labels.row(labels.rows - 1).setTo(Scalar::all(0));
+        labels.col(0).setTo(Scalar::all(0));
+        labels.col(labels.cols - 1).setTo(Scalar::all(0));
+        found.clear();
+        traced = rejectedPerimeter = 0;
+        std::fill(rejected, rejected + 4, 0);
+    }
+
+    /** @brief The image the threshold has to be written into */
+    Mat interior() {
+        return labels(Rect(1, 1, labels.cols - 2, labels.rows - 2));
+    }
+};
+
+
+/**
+  * @brief Follow one border of the labels image from ptr and mark it, as findContours does
+  *
+  * Appends the points of the border to points, but stops storing them after maxPoints.
+  * Returns the length of the border.
+  */
+static size_t _followBorder(schar *ptr, int step, Point pt, bool isHole, vector< Point > &points,
+                            size_t maxPoints) {
+
+    static const Point chainDeltas[8] = { Point(1, 0),  Point(1, -1), Point(0, -1), Point(-1, -1),
+                                          Point(-1, 0), Point(-1, 1), Point(0, 1),  Point(1, 1) };
+    // neighbours in chain code order, twice so the search can run past direction 7
+    const int deltas[16] = { 1, -step + 1, -step, -step - 1, -1, step - 1, step, step + 1,
+                             1, -step + 1, -step, -step - 1, -1, step - 1, step, step + 1 };
+    const schar nbd = 2;
+    schar *i0 = ptr, *i1, *i3, *i4 = 0;
+    size_t length = 0;
+
+    int s, sEnd;
+    sEnd = s = isHole ? 0 : 4;
+    do {
+        s = (s - 1) & 7;
+        i1 = i0 + deltas[s];
+    } while(*i1 == 0 && s != sEnd);
+
+    if(s == sEnd) { // single pixel domain
+        *i0 = (schar)(nbd | -128);
+        points.push_back(pt);
+        return 1;
+    }
+
+    i3 = i0;
+    for(;;) {
+        sEnd = s;
+        do {
+            i4 = i3 + deltas[++s];
+        } while(*i4 == 0);
+        s &= 7;
+
+        // mark the pixel, on the right bound if the search went past the previous direction
+        if((unsigned)(s - 1) < (unsigned)sEnd)
+            *i3 = (schar)(nbd | -128);
+        else if(*i3 == 1)
+            *i3 = nbd;
+
+        if(length++ < maxPoints)
+            points.push_back(pt);
+        pt += chainDeltas[s];
+
+        if(i4 == i0 && i3 == i1)
+            break;
+
+        i3 = i4;
+        s = (s + 4) & 7;
+    }
+    return length;
+}
+
+
+/**
+  * @brief Trace the borders of a thresholded image and keep the ones that can be markers
+  *
+  * Same candidates and contours as findContours (RETR_LIST, CHAIN_APPROX_NONE) followed by the
+  * perimeter and shape checks, but the borders are followed directly on arena.labels, which is
+  * overwritten. Borders longer than the maximum perimeter are still followed (to mark them)
+  * without storing their points. The accepted candidates are left in arena.found, in the
+  * reverse of the order findContours lists them.
+  */
+static void _traceMarkerContours(_ContourArena &arena, double minPerimeterRate,
+                                 double maxPerimeterRate, double accuracyRate,
+                                 double minCornerDistanceRate, int minDistanceToBorder,
+                                 int referenceSize = 0) {
+
+    CV_Assert(minPerimeterRate > 0 && maxPerimeterRate > 0 && accuracyRate > 0 &&
+              minCornerDistanceRate >= 0 && minDistanceToBorder >= 0);
+    CV_Assert(arena.labels.type() == CV_8UC1 && arena.labels.rows > 2 && arena.labels.cols > 2);
+
+    const Size imageSize(arena.labels.cols - 2, arena.labels.rows - 2);
+    if(referenceSize <= 0)
+        referenceSize = max(imageSize.width, imageSize.height);
+
+    // calculate maximum and minimum sizes in pixels
+    unsigned int minPerimeterPixels = (unsigned int)(minPerimeterRate * referenceSize);
+    unsigned int maxPerimeterPixels = (unsigned int)(maxPerimeterRate * referenceSize);
+
+    const int step = (int)arena.labels.step;
+    const int width = arena.labels.cols - 1, height = arena.labels.rows - 1;
+    _CandidateList &found = arena.found;
+
+    // raster scan of findContours: an outer border starts at a 0 -> 1 transition and a hole
+    // border before a 1 -> 0 transition (or a marked pixel followed by 0)
+    for(int y = 1; y < height; y++) {
+        schar *row = arena.labels.ptr< schar >(y);
+        int prev = 0;
+        for(int x = 1; x < width; x++) {
+            int p = row[x];
+            if(p == prev) {
+#if CV_SIMD
+                const v_uint8 vprev = vx_setall_u8((uchar)prev);
+                for(; x <= width - v_uint8::nlanes; x += v_uint8::nlanes) {
+                    v_uint8 changed = vx_load((uchar *)row + x) != vprev;
+                    if(v_check_any(changed)) {
+                        x += v_scan_forward(changed);
+                        break;
+                    }
+                }
+#endif
+                for(; x < width && row[x] == prev; x++)
+                    ;
+                if(x >= width)
+                    break;
+                p = row[x];
+            }
+
+            bool isHole;
+            if(prev == 0 && p == 1)
+                isHole = false;
+            else if(p == 0 && prev >= 1)
+                isHole = true;
+            else {
+                prev = p;
+                continue;
+            }
+
+            int start = x - (isHole ? 1 : 0);
+            size_t begin = found.points.size();
+            size_t length = _followBorder(row + start, step, Point(start - 1, y - 1), isHole,
+                                          found.points, (size_t)maxPerimeterPixels + 1);
+            prev = row[x];
+            arena.traced++;
+
+            // check perimeter and shape
+            bool accepted = false;
+            if(length < minPerimeterPixels || length > maxPerimeterPixels)
+                arena.rejectedPerimeter++;
+            else {
+                QuadCheck check = _isQuadCandidate(&found.points[begin], (int)length, arena.approxCurve,
+                                                   arena.approxStack, imageSize, accuracyRate,
+                                                   minCornerDistanceRate, minDistanceToBorder);
+                arena.rejected[check]++;
+                accepted = check == QUAD_ACCEPTED;
+            }
+            if(accepted) {
+                found.ends.push_back((int)found.points.size());
+                for(int j = 0; j < 4; j++)
+                    found.corners.push_back(Point2f((float)arena.approxCurve[j].x,
+                                                    (float)arena.approxCurve[j].y));
+            }
+            else
+                found.points.resize(begin);
+        }
+    }
+}
+
+
+/**
+  * @brief Assure order of candidate corners is clockwise direction
+  */
+static void _reorderCandidatesCorners(_CandidateList &candidates) {
+
+    for(int i = 0; i < candidates.size(); i++) {
+        Point2f *corners = candidates.candidate(i);
+        double dx1 = corners[1].x - corners[0].x;
+        double dy1 = corners[1].y - corners[0].y;
+        double dx2 = corners[2].x - corners[0].x;
+        double dy2 = corners[2].y - corners[0].y;
         double crossProduct = (dx1 * dy2) - (dy1 * dx2);
 
         if(crossProduct < 0.0) { // not clockwise direction
-            swap(candidates[i][1], candidates[i][3]);
+            swap(corners[1], corners[3]);
         }
     }
 }
@@ -213,7 +740,7 @@ static void _reorderCandidatesCorners(vector< vector< Point2f > > &candidates) {
 /**
   * @brief to make sure that the corner's order of both candidates (default/white) is the same
   */
-static vector< Point2f > alignContourOrder( Point2f corner, vector< Point2f > candidate){
+static void alignContourOrder( Point2f corner, Point2f *candidate){
     uint8_t r=0;
     double min = cv::norm( Vec2f( corner - candidate[0] ), NORM_L2SQR);
     for(uint8_t pos=1; pos < 4; pos++) {
@@ -223,29 +750,169 @@ static vector< Point2f > alignContourOrder( Point2f corner, vector< Point2f > ca
             min =nDiff;
         }
     }
-    std::rotate(candidate.begin(), candidate.begin() + r, candidate.end());
-    return candidate;
+    std::rotate(candidate, candidate + r, candidate + 4);
 }
 
+/**
+  * @brief Groups of candidates too close to each other, as linked lists in the order their
+  * candidates were added
+  */
+struct _CandidateGroups {
+    vector< int > groupOf;  // group of each candidate, -1 if it is in none
+    vector< int > next;     // next candidate of the same group, -1 after the last one
+    vector< int > first;    // first candidate of each group
+    vector< int > last;     // last candidate of each group
+
+    void reset(int nCandidates) {
+        groupOf.assign(nCandidates, -1);
+        next.assign(nCandidates, -1);
+        first.clear();
+        last.clear();
+    }
+
+    int size() const { return (int)first.size(); }
+
+    void create(int a, int b) {
+        groupOf[a] = size();
+        first.push_back(a);
+        last.push_back(a);
+        add(groupOf[a], b);
+    }
+
+    void add(int group, int candidate) {
+        groupOf[candidate] = group;
+        next[last[group]] = candidate;
+        last[group] = candidate;
+    }
+};
+
+/**
+  * @brief Uniform grid of the candidate centers, to only compare candidates with their neighbours
+  */
+struct _CandidateGrid {
+    vector< Point2f > centers;
+    vector< int > cellStart;   // first item of each cell, then the end of the last one
+    vector< int > items;       // candidates sorted by cell, increasing in each cell
+    Point2f origin;
+    float cellSize;
+    int cols, rows;
+
+    /** @brief Sort the candidates into cells of about the given size */
+    void build(const _CandidateList &candidates, float minCellSize) {
+        const int n = candidates.size();
+        centers.resize(n);
+        Point2f tl(FLT_MAX, FLT_MAX), br(-FLT_MAX, -FLT_MAX);
+        for(int i = 0; i < n; i++) {
+            const Point2f *c = candidates.candidate(i);
+            centers[i] = (c[0] + c[1] + c[2] + c[3]) * 0.25f;
+            tl = Point2f(min(tl.x, centers[i].x), min(tl.y, centers[i].y));
+            br = Point2f(max(br.x, centers[i].x), max(br.y, centers[i].y));
+        }
+        origin = tl;
+
+        // at most 2n + 2 cells, however small the cells are asked to be and however spread the
+        // centers are: (width / size + 1) * (height / size + 1) <= maxCells for the size below,
+        // also when the centers are (almost) on a line, e.g. with one far away
+        const double width = max(br.x - tl.x, 0.f), height = max(br.y - tl.y, 0.f);
+        const double maxCells = 2. * max(n, 1) + 2;
+        const double fewCellsSize = (width + height + std::sqrt((width + height) * (width + height) +
+                                    4. * width * height * (maxCells - 1))) / (2. * (maxCells - 1));
+        cellSize = (float)max(max((double)minCellSize, fewCellsSize), 1.);
+        cols = (int)(width / cellSize) + 1;
+        rows = (int)(height / cellSize) + 1;
+
+        // counting sort of the candidates by cell, filling each cell from its end
+        cellStart.assign((size_t)cols * rows + 1, 0);
+        for(int i = 0; i < n; i++)
+            cellStart[cellOf(centers[i])]++;
+        for(size_t k = 1; k < cellStart.size(); k++)
+            cellStart[k] += cellStart[k - 1];
+        items.resize(n);
+        for(int i = n - 1; i >= 0; i--)
+            items[--cellStart[cellOf(centers[i])]] = i;
+    }
+
+    /**
+     * @brief The candidates after i whose center is less than radius away from the center of i on
+     * both axes, in increasing order
+     */
+    void neighbours(int i, float radius, vector< int > &out) const {
+        near(centers[i], radius, i, out);
+    }
+
+    /**
+     * @brief The candidates after the index after whose center is less than radius away from p
+     * on both axes, in increasing order
+     */
+    void near(Point2f p, float radius, int after, vector< int > &out) const {
+        out.clear();
+        const Point2f c = p - origin;
+        const int x0 = max(cellFloor((c.x - radius) / cellSize, cols), 0);
+        const int x1 = min(cellFloor((c.x + radius) / cellSize, cols), cols - 1);
+        const int y0 = max(cellFloor((c.y - radius) / cellSize, rows), 0);
+        const int y1 = min(cellFloor((c.y + radius) / cellSize, rows), rows - 1);
+        for(int y = y0; y <= y1; y++) {
+            for(int x = x0; x <= x1; x++) {
+                const int cell = y * cols + x;
+                for(int k = cellStart[cell]; k < cellStart[cell + 1]; k++) {
+                    if(items[k] > after)
+                        out.push_back(items[k]);
+                }
+            }
+        }
+        std::sort(out.begin(), out.end());
+    }
+
+    /** @brief Floor of a cell coordinate, clamped to -1 .. n first so that far points do not overflow */
+    static int cellFloor(float v, int n) {
+        return v < 0 ? -1 : v >= n ? n : cvFloor(v);
+    }
+
+    int cellOf(Point2f center) const {
+        int x = min((int)((center.x - origin.x) / cellSize), cols - 1);
+        int y = min((int)((center.y - origin.y) / cellSize), rows - 1);
+        return y * cols + x;
+    }
+};
+
 /**
   * @brief Check candidates that are too close to each other, save the potential candidates
   *        (i.e. biggest/smallest contour) and remove the rest
+  *
+  * Two candidates are too close when the mean square distance of their corners is small, and
+  * then the distance of their centers (the mean of the corner differences) is small as well, so
+  * each candidate is only compared with the ones around it in grid. The pairs are visited in
+  * the same order as when comparing all of them, and so the groups are the same.
   */
-static void _filterTooCloseCandidates(const vector< vector< Point2f > > &candidatesIn,
-                                      vector< vector< vector< Point2f > > > &candidatesSetOut,
-                                      const vector< vector< Point > > &contoursIn,
-                                      vector< vector< vector< Point > > > &contoursSetOut,
+static void _filterTooCloseCandidates(const _CandidateList &candidatesIn, _CandidateGroups &groups,
+                                      _CandidateGrid &grid, vector< int > &neighbours,
+                                      _CandidateList &biggerCandidates, _CandidateList &smallerCandidates,
                                       double minMarkerDistanceRate, bool detectInvertedMarker) {
 
     CV_Assert(minMarkerDistanceRate >= 0);
 
-    vector<int> candGroup;
-    candGroup.resize(candidatesIn.size(), -1);
-    vector< vector<unsigned int> > groupedCandidates;
-    for(unsigned int i = 0; i < candidatesIn.size(); i++) {
-        for(unsigned int j = i + 1; j < candidatesIn.size(); j++) {
+    const int nCandidates = candidatesIn.size();
+    groups.reset(nCandidates);
+
+    // cells of the mean distance under which candidates are too close
+    double meanPerimeter = 0;
+    for(int i = 0; i < nCandidates; i++)
+        meanPerimeter += candidatesIn.contourSize(i);
+    meanPerimeter /= max(nCandidates, 1);
+    grid.build(candidatesIn, (float)(meanPerimeter * minMarkerDistanceRate));
+
+    for(int i = 0; i < nCandidates; i++) {
+        const Point2f *ci = candidatesIn.candidate(i);
+        // with a margin for the rounding of the corner distances
+        grid.neighbours(i, (float)(candidatesIn.contourSize(i) * minMarkerDistanceRate * 1.001 + 0.5), neighbours);
+        for(size_t k = 0; k < neighbours.size(); k++) {
+            const int j = neighbours[k];
+            // a pair of candidates already in groups is left as it is
+            if(groups.groupOf[i] > -1 && groups.groupOf[j] > -1)
+                continue;
+            const Point2f *cj = candidatesIn.candidate(j);
 
-            int minimumPerimeter = min((int)contoursIn[i].size(), (int)contoursIn[j].size() );
+            int minimumPerimeter = min(candidatesIn.contourSize(i), candidatesIn.contourSize(j));
 
             // fc is the first corner considered on one of the markers, 4 combinations are possible
             for(int fc = 0; fc < 4; fc++) {
@@ -253,69 +920,41 @@ static void _filterTooCloseCandidates(const vector< vector< Point2f > > &candida
                 for(int c = 0; c < 4; c++) {
                     // modC is the corner considering first corner is fc
                     int modC = (c + fc) % 4;
-                    distSq += (candidatesIn[i][modC].x - candidatesIn[j][c].x) *
-                                  (candidatesIn[i][modC].x - candidatesIn[j][c].x) +
-                              (candidatesIn[i][modC].y - candidatesIn[j][c].y) *
-                                  (candidatesIn[i][modC].y - candidatesIn[j][c].y);
+                    distSq += (ci[modC].x - cj[c].x) * (ci[modC].x - cj[c].x) +
+                              (ci[modC].y - cj[c].y) * (ci[modC].y - cj[c].y);
                 }
                 distSq /= 4.;
 
                 // if mean square distance is too low, remove the smaller one of the two markers
                 double minMarkerDistancePixels = double(minimumPerimeter) * minMarkerDistanceRate;
                 if(distSq < minMarkerDistancePixels * minMarkerDistancePixels) {
-
                     // i and j are not related to a group
-                    if(candGroup[i]<0 && candGroup[j]<0){
-                        // mark candidates with their corresponding group number
-                        candGroup[i] = candGroup[j] = (int)groupedCandidates.size();
-
-                        // create group
-                        vector<unsigned int> grouped;
-                        grouped.push_back(i);
-                        grouped.push_back(j);
-                        groupedCandidates.push_back( grouped );
-                    }
+                    if(groups.groupOf[i] < 0 && groups.groupOf[j] < 0)
+                        groups.create(i, j);
                     // i is related to a group
-                    else if(candGroup[i] > -1 && candGroup[j] == -1){
-                        int group = candGroup[i];
-                        candGroup[j] = group;
-
-                        // add to group
-                        groupedCandidates[group].push_back( j );
-                    }
+                    else if(groups.groupOf[j] < 0)
+                        groups.add(groups.groupOf[i], j);
                     // j is related to a group
-                    else if(candGroup[j] > -1 && candGroup[i] == -1){
-                        int group = candGroup[j];
-                        candGroup[i] = group;
-
-                        // add to group
-                        groupedCandidates[group].push_back( i );
-                    }
+                    else
+                        groups.add(groups.groupOf[j], i);
+                    break;
                 }
             }
         }
     }
 
     // save possible candidates
-    candidatesSetOut.clear();
-    contoursSetOut.clear();
-
-    vector< vector< Point2f > > biggerCandidates;
-    vector< vector< Point > > biggerContours;
-    vector< vector< Point2f > > smallerCandidates;
-    vector< vector< Point > > smallerContours;
-
-    // save possible candidates
-    for(unsigned int i = 0; i < groupedCandidates.size(); i++) {
-        unsigned int smallerIdx = groupedCandidates[i][0];
-        unsigned int biggerIdx = smallerIdx;
-        double smallerArea = contourArea(candidatesIn[smallerIdx]);
+    biggerCandidates.clear();
+    smallerCandidates.clear();
+    for(int i = 0; i < groups.size(); i++) {
+        int smallerIdx = groups.first[i];
+        int biggerIdx = smallerIdx;
+        double smallerArea = contourArea(Mat(4, 1, CV_32FC2, (void *)candidatesIn.candidate(smallerIdx)));
         double biggerArea = smallerArea;
 
         // evaluate group elements
-        for(unsigned int j = 1; j < groupedCandidates[i].size(); j++) {
-            unsigned int currIdx = groupedCandidates[i][j];
-            double currArea = contourArea(candidatesIn[currIdx]);
+        for(int currIdx = groups.next[smallerIdx]; currIdx > -1; currIdx = groups.next[currIdx]) {
+            double currArea = contourArea(Mat(4, 1, CV_32FC2, (void *)candidatesIn.candidate(currIdx)));
 
             // check if current contour is bigger
             if(currArea >= biggerArea) {
@@ -330,108 +969,328 @@ static void _filterTooCloseCandidates(const vector< vector< Point2f > > &candida
             }
         }
 
-        // add contours and candidates
-        biggerCandidates.push_back(candidatesIn[biggerIdx]);
-        biggerContours.push_back(contoursIn[biggerIdx]);
+        // add contours and candidates, the structure is < defaultCandidates, whiteCandidates >
+        biggerCandidates.push_back(candidatesIn, biggerIdx);
         if(detectInvertedMarker) {
-            smallerCandidates.push_back(alignContourOrder(candidatesIn[biggerIdx][0], candidatesIn[smallerIdx]));
-            smallerContours.push_back(contoursIn[smallerIdx]);
+            smallerCandidates.push_back(candidatesIn, smallerIdx);
+            alignContourOrder(candidatesIn.candidate(biggerIdx)[0],
+                              smallerCandidates.candidate(smallerCandidates.size() - 1));
         }
     }
-    // to preserve the structure :: candidateSet< defaultCandidates, whiteCandidates >
-    // default candidates
-    candidatesSetOut.push_back(biggerCandidates);
-    contoursSetOut.push_back(biggerContours);
-    // white candidates
-    candidatesSetOut.push_back(smallerCandidates);
-    contoursSetOut.push_back(smallerContours);
 }
 
+
+/**
+ * @brief Buffers of the detection, reused from one image to the next by ArucoDetector
+ */
+struct _DetectorWorkspace {
+    Mat grey;                                       // the input converted to grey if it is not
+    vector< int > winSizes;                         // thresholding window sizes
+    vector< _ContourArena > arenas;                 // one per window size
+    vector< Mat > thresholds;                       // interiors of the arenas
+    TLSData< _ThresholdScratch > thresholdScratch;  // integral of each thread
+    _CandidateList candidates;                      // candidates of all the window sizes
+    _CandidateGroups groups;
+    _CandidateGrid grid;                            // centers of the candidates
+    vector< int > neighbours;
+    _CandidateList candidatesSet[2];                // default and white candidates
+    vector< uchar > bits;                           // bits of the candidates, with their border
+    vector< Mat > innerBits;                        // views of bits without the border
+    vector< uint8_t > validCandidates;
+    vector< int > candidateIds, rotations;
+    _CandidateList accepted;                        // identified markers
+    vector< int > ids;
+    _CandidateList rejected;                        // only corners, without contours
+    _CandidateList regionAccepted, regionRejected;  // markers of all the regions, full image coordinates
+    vector< int > regionIds;
+    ClusterArena clusterArena;                      // boundary points of the AprilTag clusters
+    ThresholdTiles thresholdTiles;                  // tile extrema of the AprilTag threshold
+    DetectorStatistics stats;                       // summed over the detections
+};
+
+
+/**
+ * @brief Trace candidates in the threshold of one window size per arena
+ */
+class DetectInitialCandidatesParallel : public ParallelLoopBody {
+public:
+    DetectInitialCandidatesParallel(vector< _ContourArena > &_arenas, const Ptr<DetectorParameters> &_params,
+                                    int _referenceSize)
+        : arenas(_arenas), params(_params), referenceSize(_referenceSize) {}
+
+    void operator()(const Range &range) const CV_OVERRIDE {
+        for(int i = range.start; i < range.end; i++) {
+            // detect rectangles
+            _traceMarkerContours(arenas[i], params->minMarkerPerimeterRate, params->maxMarkerPerimeterRate,
+                                 params->polygonalApproxAccuracyRate, params->minCornerDistanceRate,
+                                 params->minDistanceToBorder, referenceSize);
+        }
+    }
+
+private:
+    DetectInitialCandidatesParallel &operator=(const DetectInitialCandidatesParallel &); // to quiet MSVC
+
+    vector< _ContourArena > &arenas;
+    const Ptr<DetectorParameters> &params;
+    int referenceSize;
+};
+
+
 /**
- * @brief Initial steps on finding square candidates
+ * @brief Initial steps on finding square candidates, into ws.candidates
  */
-static void _detectInitialCandidates(const Mat &grey, vector< vector< Point2f > > &candidates,
-                                     vector< vector< Point > > &contours,
-                                     const Ptr<DetectorParameters> &params) {
+static void _detectInitialCandidates(_DetectorWorkspace &ws, const Mat &grey,
+                                     const Ptr<DetectorParameters> &params, int referenceSize) {
 
     CV_Assert(params->adaptiveThreshWinSizeMin >= 3 && params->adaptiveThreshWinSizeMax >= 3);
     CV_Assert(params->adaptiveThreshWinSizeMax >= params->adaptiveThreshWinSizeMin);
     CV_Assert(params->adaptiveThreshWinSizeStep > 0);
+    int64 tick = getTickCount();
 
     // number of window sizes (scales) to apply adaptive thresholding
     int nScales =  (params->adaptiveThreshWinSizeMax - params->adaptiveThreshWinSizeMin) /
                       params->adaptiveThreshWinSizeStep + 1;
 
-    vector< vector< vector< Point2f > > > candidatesArrays((size_t) nScales);
-    vector< vector< vector< Point > > > contoursArrays((size_t) nScales);
+    // threshold for every window size in the interval from a single integral image
+    ws.winSizes.resize((size_t) nScales);
+    for(int i = 0; i < nScales; i++)
+        ws.winSizes[i] = params->adaptiveThreshWinSizeMin + i * params->adaptiveThreshWinSizeStep;
+    // the 0/1 thresholds are written straight into the images the contours are traced on
+    ws.arenas.resize((size_t) nScales);
+    ws.thresholds.resize((size_t) nScales);
+    for(int i = 0; i < nScales; i++) {
+        ws.arenas[i].create(grey.size());
+        ws.thresholds[i] = ws.arenas[i].interior();
+    }
+    _thresholdMultiScale(grey, ws.winSizes, params->adaptiveThreshConstant, 1, ws.thresholds,
+                         ws.thresholdScratch);
+    ws.stats.thresholdTime += _lapTime(tick);
 
     ////for each value in the interval of thresholding window sizes
-    parallel_for_(Range(0, nScales), [&](const Range& range) {
-        const int begin = range.start;
-        const int end = range.end;
-
-        for (int i = begin; i < end; i++) {
-            int currScale = params->adaptiveThreshWinSizeMin + i * params->adaptiveThreshWinSizeStep;
-            // threshold
-            Mat thresh;
-            _threshold(grey, thresh, currScale, params->adaptiveThreshConstant);
+    parallel_for_(Range(0, nScales), DetectInitialCandidatesParallel(ws.arenas, params, referenceSize));
 
-            // detect rectangles
-            _findMarkerContours(thresh, candidatesArrays[i], contoursArrays[i],
-                                params->minMarkerPerimeterRate, params->maxMarkerPerimeterRate,
-                                params->polygonalApproxAccuracyRate, params->minCornerDistanceRate,
-                                params->minDistanceToBorder);
-        }
-    });
-
-    // join candidates
+    // join candidates, findContours lists the borders from the last found to the first
+    ws.candidates.clear();
     for(int i = 0; i < nScales; i++) {
-        for(unsigned int j = 0; j < candidatesArrays[i].size(); j++) {
-            candidates.push_back(candidatesArrays[i][j]);
-            contours.push_back(contoursArrays[i][j]);
-        }
+        const _ContourArena &arena = ws.arenas[i];
+        for(int j = arena.found.size() - 1; j >= 0; j--)
+            ws.candidates.push_back(arena.found, j);
+        ws.stats.contours += arena.traced;
+        ws.stats.rejectedPerimeter += arena.rejectedPerimeter;
+        ws.stats.rejectedShape += arena.rejected[QUAD_NOT_CONVEX_QUAD];
+        ws.stats.rejectedCornerDistance += arena.rejected[QUAD_CORNERS_TOO_CLOSE];
+        ws.stats.rejectedImageBorder += arena.rejected[QUAD_NEAR_IMAGE_BORDER];
     }
+    ws.stats.candidates += ws.candidates.size();
+    ws.stats.contourTime += _lapTime(tick);
 }
 
 
 /**
- * @brief Detect square candidates in the input image
+ * @brief Detect square candidates in a grey image, into ws.candidatesSet
  */
-static void _detectCandidates(InputArray _image, vector< vector< vector< Point2f > > >& candidatesSetOut,
-                              vector< vector< vector< Point > > >& contoursSetOut, const Ptr<DetectorParameters> &_params) {
+static void _detectCandidates(_DetectorWorkspace &ws, const Mat &grey, const Ptr<DetectorParameters> &_params,
+                              int referenceSize = 0) {
 
-    Mat image = _image.getMat();
-    CV_Assert(image.total() != 0);
-
-    /// 1. CONVERT TO GRAY
-    Mat grey;
-    _convertToGrey(image, grey);
+    CV_Assert(grey.total() != 0);
 
-    vector< vector< Point2f > > candidates;
-    vector< vector< Point > > contours;
-    /// 2. DETECT FIRST SET OF CANDIDATES
-    _detectInitialCandidates(grey, candidates, contours, _params);
+    /// 1. DETECT FIRST SET OF CANDIDATES
+    _detectInitialCandidates(ws, grey, _params, referenceSize);
 
-    /// 3. SORT CORNERS
-    _reorderCandidatesCorners(candidates);
+    /// 2. SORT CORNERS
+    int64 tick = getTickCount();
+    _reorderCandidatesCorners(ws.candidates);
 
-    /// 4. FILTER OUT NEAR CANDIDATE PAIRS
+    /// 3. FILTER OUT NEAR CANDIDATE PAIRS
     // save the outter/inner border (i.e. potential candidates)
-    _filterTooCloseCandidates(candidates, candidatesSetOut, contours, contoursSetOut,
+    _filterTooCloseCandidates(ws.candidates, ws.groups, ws.grid, ws.neighbours, ws.candidatesSet[0], ws.candidatesSet[1],
                               _params->minMarkerDistanceRate, _params->detectInvertedMarker);
+    ws.stats.rejectedTooClose += ws.candidates.size() - ws.candidatesSet[0].size();
+    ws.stats.filterTime += _lapTime(tick);
+}
+
+
+/**
+ * @brief Detect square candidates on a decimated copy of the image, then scale them back and
+ * refine their corners on the full resolution image
+ */
+static void _detectCandidatesDecimated(_DetectorWorkspace &ws, const Mat &grey,
+                                       const Ptr<DetectorParameters> &_params, int referenceSize) {
+
+    const float decimate = _params->candidateDecimate;
+    CV_Assert(decimate > 1.f);
+
+    int64 tick = getTickCount();
+    Mat small;
+    resize(grey, small, Size(), 1. / decimate, 1. / decimate, INTER_AREA);
+    ws.stats.greyTime += _lapTime(tick);
+
+    // the border distance is given in full resolution pixels
+    Ptr<DetectorParameters> smallParams = makePtr<DetectorParameters>(*_params);
+    smallParams->minDistanceToBorder = cvFloor(_params->minDistanceToBorder / decimate);
+    _detectCandidates(ws, small, smallParams, referenceSize > 0 ? cvRound(referenceSize / decimate) : 0);
+    tick = getTickCount();
+
+    // back to full resolution, keeping pixel centers aligned
+    const double sx = (double)grey.cols / small.cols, sy = (double)grey.rows / small.rows;
+    for(int s = 0; s < 2; s++) {
+        for(size_t c = 0; c < ws.candidatesSet[s].corners.size(); c++) {
+            Point2f &p = ws.candidatesSet[s].corners[c];
+            p = Point2f((float)((p.x + 0.5) * sx - 0.5), (float)((p.y + 0.5) * sy - 0.5));
+        }
+        for(size_t c = 0; c < ws.candidatesSet[s].points.size(); c++) {
+            Point &p = ws.candidatesSet[s].points[c];
+            p = Point(cvRound((p.x + 0.5) * sx - 0.5), cvRound((p.y + 0.5) * sy - 0.5));
+        }
+    }
+
+    // the corners are only accurate to about one decimated pixel, which is not enough to
+    // sample the marker bits
+    CV_Assert(_params->cornerRefinementWinSize > 0 && _params->cornerRefinementMaxIterations > 0 &&
+              _params->cornerRefinementMinAccuracy > 0);
+    const int winSize = max(_params->cornerRefinementWinSize, cvCeil(decimate));
+    for(int s = 0; s < 2; s++) {
+        _CandidateList &candidates = ws.candidatesSet[s];
+        parallel_for_(Range(0, candidates.size()), [&](const Range& range) {
+            for(int i = range.start; i < range.end; i++) {
+                cornerSubPix(grey, Mat(4, 1, CV_32FC2, candidates.candidate(i)), Size(winSize, winSize),
+                             Size(-1, -1),
+                             TermCriteria(TermCriteria::MAX_ITER | TermCriteria::EPS,
+                                          _params->cornerRefinementMaxIterations,
+                                          _params->cornerRefinementMinAccuracy));
+            }
+        });
+    }
+    ws.stats.refineTime += _lapTime(tick);
+}
+
+
+/**
+ * @brief Transformation from the candidate corners to the corners of a square of the given side,
+ * computed as getPerspectiveTransform does but on the stack
+ */
+static Matx33d _getSquareTransform(const Point2f *corners, float side) {
+    const Point2f square[4] = { Point2f(0, 0), Point2f(side, 0), Point2f(side, side), Point2f(0, side) };
+
+    Matx33d M;
+    double a[8][8], b[8];
+    Mat A(8, 8, CV_64F, a), B(8, 1, CV_64F, b), X(8, 1, CV_64F, M.val);
+    for(int i = 0; i < 4; i++) {
+        a[i][0] = a[i + 4][3] = corners[i].x;
+        a[i][1] = a[i + 4][4] = corners[i].y;
+        a[i][2] = a[i + 4][5] = 1;
+        a[i][3] = a[i][4] = a[i][5] = a[i + 4][0] = a[i + 4][1] = a[i + 4][2] = 0;
+        a[i][6] = -corners[i].x * square[i].x;
+        a[i][7] = -corners[i].y * square[i].x;
+        a[i + 4][6] = -corners[i].x * square[i].y;
+        a[i + 4][7] = -corners[i].y * square[i].y;
+        b[i] = square[i].x;
+        b[i + 4] = square[i].y;
+    }
+    solve(A, B, X, DECOMP_LU);
+    M.val[8] = 1.;
+    return M;
+}
+
+
+/**
+ * @brief Image coordinates of a run of pixels of a row of the marker image, given the inverse
+ * transformation M and the homogeneous coordinates (X0, Y0, W0) of the first pixel. Rounding is
+ * the one of warpPerspective with INTER_NEAREST.
+ */
+static void _mapRowNearest(const double *M, double X0, double Y0, double W0, int width, int *xs,
+                           int *ys) {
+    int x = 0;
+#if CV_SIMD_64F
+    const int step = v_float64::nlanes;
+    double offsets[v_float64::nlanes];
+    for(int i = 0; i < step; i++)
+        offsets[i] = i;
+    v_float64 vx = vx_load(offsets), vstep = vx_setall_f64((double)step);
+    v_float64 vM0 = vx_setall_f64(M[0]), vM3 = vx_setall_f64(M[3]), vM6 = vx_setall_f64(M[6]);
+    v_float64 vX0 = vx_setall_f64(X0), vY0 = vx_setall_f64(Y0), vW0 = vx_setall_f64(W0);
+    v_float64 zero = vx_setzero_f64(), one = vx_setall_f64(1.);
+    v_float64 intMin = vx_setall_f64((double)INT_MIN), intMax = vx_setall_f64((double)INT_MAX);
+    for(; x <= width - 2 * step; x += 2 * step) {
+        v_float64 w0 = vM6 * vx + vW0;
+        w0 = v_select(w0 == zero, zero, one / w0);
+        v_float64 fx0 = v_max(intMin, v_min(intMax, (vX0 + vM0 * vx) * w0));
+        v_float64 fy0 = v_max(intMin, v_min(intMax, (vY0 + vM3 * vx) * w0));
+        vx += vstep;
+        v_float64 w1 = vM6 * vx + vW0;
+        w1 = v_select(w1 == zero, zero, one / w1);
+        v_float64 fx1 = v_max(intMin, v_min(intMax, (vX0 + vM0 * vx) * w1));
+        v_float64 fy1 = v_max(intMin, v_min(intMax, (vY0 + vM3 * vx) * w1));
+        vx += vstep;
+        v_store(xs + x, v_round(fx0, fx1));
+        v_store(ys + x, v_round(fy0, fy1));
+    }
+#endif
+    for(; x < width; x++) {
+        double W = W0 + M[6] * x;
+        W = W ? 1. / W : 0;
+        xs[x] = saturate_cast< int >(std::max((double)INT_MIN, std::min((double)INT_MAX, (X0 + M[0] * x) * W)));
+        ys[x] = saturate_cast< int >(std::max((double)INT_MIN, std::min((double)INT_MAX, (Y0 + M[3] * x) * W)));
+    }
+}
+
+
+/**
+ * @brief Otsu threshold of a 256 bins histogram, as threshold() with THRESH_OTSU computes it
+ *
+ * Bins before the first and after the last non empty one never pass the q1/q2 check, so only the
+ * occupied range is scanned.
+ */
+static int _otsuThreshold(const int *hist, int total) {
+    int first = 0, last = 255;
+    while(first < last && hist[first] == 0)
+        first++;
+    while(last > first && hist[last] == 0)
+        last--;
+
+    double mu = 0, scale = 1. / total;
+    for(int i = first; i <= last; i++)
+        mu += i * (double)hist[i];
+    mu *= scale;
+
+    double mu1 = 0, q1 = 0, maxSigma = 0;
+    int maxVal = 0;
+    for(int i = first; i < last; i++) {
+        double p_i = hist[i] * scale;
+        mu1 *= q1;
+        q1 += p_i;
+        double q2 = 1. - q1;
+        if(std::min(q1, q2) < FLT_EPSILON || std::max(q1, q2) > 1. - FLT_EPSILON)
+            continue;
+        mu1 = (mu1 + i * p_i) / q1;
+        double mu2 = (mu - q1 * mu1) / q2;
+        double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+        if(sigma > maxSigma) {
+            maxSigma = sigma;
+            maxVal = i;
+        }
+    }
+    return maxVal;
 }
 
 
 /**
   * @brief Given an input image and candidate corners, extract the bits of the candidate, including
   * the border bits
+  *
+  * The marker is sampled through the candidate homography straight into a stack buffer, pixel by
+  * pixel as warpPerspective with INTER_NEAREST would, and the inner region moments and the Otsu
+  * histogram are accumulated in the same pass. The bits are the same as warping, meanStdDev,
+  * Otsu threshold and countNonZero on each cell, without their intermediate images. _bits is
+  * written in place when it already has the right size and type.
   */
-static Mat _extractBits(InputArray _image, InputArray _corners, int markerSize,
-                        int markerBorderBits, int cellSize, double cellMarginRate,
-                        double minStdDevOtsu) {
+static void _extractBits(InputArray _image, InputArray _corners, int markerSize,
+                         int markerBorderBits, int cellSize, double cellMarginRate,
+                         double minStdDevOtsu, OutputArray _bits) {
 
-    CV_Assert(_image.getMat().channels() == 1);
-    CV_Assert(_corners.total() == 4);
+    Mat image = _image.getMat(), corners = _corners.getMat();
+    CV_Assert(image.type() == CV_8UC1);
+    CV_Assert(corners.checkVector(2, CV_32F) == 4 && corners.isContinuous());
     CV_Assert(markerBorderBits > 0 && cellSize > 0 && cellMarginRate >= 0 && cellMarginRate <= 1);
     CV_Assert(minStdDevOtsu >= 0);
 
@@ -439,56 +1298,104 @@ static Mat _extractBits(InputArray _image, InputArray _corners, int markerSize,
     int markerSizeWithBorders = markerSize + 2 * markerBorderBits;
     int cellMarginPixels = int(cellMarginRate * cellSize);
 
-    Mat resultImg; // marker image after removing perspective
+    // marker image after removing perspective
     int resultImgSize = markerSizeWithBorders * cellSize;
-    Mat resultImgCorners(4, 1, CV_32FC2);
-    resultImgCorners.ptr< Point2f >(0)[0] = Point2f(0, 0);
-    resultImgCorners.ptr< Point2f >(0)[1] = Point2f((float)resultImgSize - 1, 0);
-    resultImgCorners.ptr< Point2f >(0)[2] =
-        Point2f((float)resultImgSize - 1, (float)resultImgSize - 1);
-    resultImgCorners.ptr< Point2f >(0)[3] = Point2f(0, (float)resultImgSize - 1);
-
-    // remove perspective
-    Mat transformation = getPerspectiveTransform(_corners, resultImgCorners);
-    warpPerspective(_image, resultImg, transformation, Size(resultImgSize, resultImgSize),
-                    INTER_NEAREST);
+    AutoBuffer< uchar, 4096 > resultImg(resultImgSize * resultImgSize);
+    AutoBuffer< int, 256 > coords(2 * resultImgSize);
+    int *xs = coords.data(), *ys = xs + resultImgSize;
+
+    // pixels of the marker image are mapped back into the image
+    Matx33d transformation =
+        _getSquareTransform(corners.ptr< Point2f >(), (float)resultImgSize - 1).inv(DECOMP_LU);
+    const double *M = transformation.val;
+
+    // warpPerspective maps each row in blocks, and restarts from the block origin for each
+    const int blockHeight = std::min(16, resultImgSize);
+    const int blockWidth = std::min(1024 / blockHeight, resultImgSize);
+
+    // Remove some border just to avoid border noise from perspective transformation
+    int innerStart = cellSize / 2, innerEnd = resultImgSize - cellSize / 2;
+    int64 innerSum = 0, innerSqSum = 0;
+    // interleaved histograms, so that runs of equal pixels do not serialize the increments
+    int hist[4][256] = { { 0 } };
+
+    for(int y = 0; y < resultImgSize; y++) {
+        for(int x = 0; x < resultImgSize; x += blockWidth) {
+            double X0 = M[0] * x + M[1] * y + M[2];
+            double Y0 = M[3] * x + M[4] * y + M[5];
+            double W0 = M[6] * x + M[7] * y + M[8];
+            _mapRowNearest(M, X0, Y0, W0, std::min(blockWidth, resultImgSize - x), xs + x, ys + x);
+        }
+
+        // outside of the image is black, as BORDER_CONSTANT
+        uchar *row = resultImg.data() + y * resultImgSize;
+        for(int x = 0; x < resultImgSize; x++) {
+            int sx = xs[x], sy = ys[x];
+            uchar value = 0;
+            if((unsigned)sx < (unsigned)image.cols && (unsigned)sy < (unsigned)image.rows)
+                value = image.ptr(sy)[sx];
+            row[x] = value;
+            hist[x & 3][value]++;
+        }
+        if(y >= innerStart && y < innerEnd) {
+            for(int x = innerStart; x < innerEnd; x++) {
+                innerSum += row[x];
+                innerSqSum += row[x] * row[x];
+            }
+        }
+    }
 
     // output image containing the bits
-    Mat bits(markerSizeWithBorders, markerSizeWithBorders, CV_8UC1, Scalar::all(0));
+    _bits.create(markerSizeWithBorders, markerSizeWithBorders, CV_8UC1);
+    Mat bits = _bits.getMat();
+    bits.setTo(Scalar::all(0));
 
     // check if standard deviation is enough to apply Otsu
     // if not enough, it probably means all bits are the same color (black or white)
-    Mat mean, stddev;
-    // Remove some border just to avoid border noise from perspective transformation
-    Mat innerRegion = resultImg.colRange(cellSize / 2, resultImg.cols - cellSize / 2)
-                          .rowRange(cellSize / 2, resultImg.rows - cellSize / 2);
-    meanStdDev(innerRegion, mean, stddev);
-    if(stddev.ptr< double >(0)[0] < minStdDevOtsu) {
+    double innerScale = 1. / ((innerEnd - innerStart) * (innerEnd - innerStart));
+    double mean = (double)innerSum * innerScale;
+    double stddev = std::sqrt(std::max((double)innerSqSum * innerScale - mean * mean, 0.));
+    if(stddev < minStdDevOtsu) {
         // all black or all white, depending on mean value
-        if(mean.ptr< double >(0)[0] > 127)
+        if(mean > 127)
             bits.setTo(1);
-        else
-            bits.setTo(0);
-        return bits;
+        return;
     }
 
     // now extract code, first threshold using Otsu
-    threshold(resultImg, resultImg, 125, 255, THRESH_BINARY | THRESH_OTSU);
+    for(int i = 0; i < 256; i++)
+        hist[0][i] += hist[1][i] + hist[2][i] + hist[3][i];
+    int otsu = _otsuThreshold(hist[0], resultImgSize * resultImgSize);
 
-    // for each cell
+    // white pixels of each column over the rows of a cell, then of each cell
+    int cellInnerSize = cellSize - 2 * cellMarginPixels;
+    AutoBuffer< ushort, 256 > columnCounts(resultImgSize);
     for(int y = 0; y < markerSizeWithBorders; y++) {
+        ushort *counts = columnCounts.data();
+        std::fill(counts, counts + resultImgSize, (ushort)0);
+        for(int cy = 0; cy < cellInnerSize; cy++) {
+            const uchar *row = resultImg.data() + (y * cellSize + cellMarginPixels + cy) * resultImgSize;
+            int x = 0;
+#if CV_SIMD
+            v_uint8 vthresh = vx_setall_u8((uchar)otsu), vone = vx_setall_u8(1);
+            for(; x <= resultImgSize - v_uint8::nlanes; x += v_uint8::nlanes) {
+                v_uint16 white0, white1;
+                v_expand((vx_load(row + x) > vthresh) & vone, white0, white1);
+                v_store(counts + x, vx_load(counts + x) + white0);
+                v_store(counts + x + v_uint16::nlanes, vx_load(counts + x + v_uint16::nlanes) + white1);
+            }
+#endif
+            for(; x < resultImgSize; x++)
+                counts[x] += row[x] > otsu;
+        }
         for(int x = 0; x < markerSizeWithBorders; x++) {
-            int Xstart = x * (cellSize) + cellMarginPixels;
-            int Ystart = y * (cellSize) + cellMarginPixels;
-            Mat square = resultImg(Rect(Xstart, Ystart, cellSize - 2 * cellMarginPixels,
-                                        cellSize - 2 * cellMarginPixels));
             // count white pixels on each cell to assign its value
-            size_t nZ = (size_t) countNonZero(square);
-            if(nZ > square.total() / 2) bits.at< unsigned char >(y, x) = 1;
+            int nZ = 0;
+            for(int cx = x * cellSize + cellMarginPixels; cx < (x + 1) * cellSize - cellMarginPixels; cx++)
+                nZ += counts[cx];
+            if(nZ > cellInnerSize * cellInnerSize / 2) bits.at< unsigned char >(y, x) = 1;
         }
     }
-
-    return bits;
 }
 
 
@@ -520,25 +1427,25 @@ static int _getBorderErrors(const Mat &bits, int markerSize, int borderSize) {
 
 
 /**
- * @brief Tries to identify one candidate given the dictionary
+ * @brief Extracts the inner bits of one candidate, to be identified with the dictionary
+ * @param candidateBits bits with the border, of the size of the marker with its border
+ * @param onlyBits view of the inner bits of candidateBits, set if the border is right
  * @return candidate typ. zero if the candidate is not valid,
  *                           1 if the candidate is a black candidate (default candidate)
  *                           2 if the candidate is a white candidate
  */
-static uint8_t _identifyOneCandidate(const Ptr<Dictionary>& dictionary, InputArray _image,
-                                  vector<Point2f>& _corners, int& idx,
-                                  const Ptr<DetectorParameters>& params, int& rotation)
+static uint8_t _extractCandidateBits(const Ptr<Dictionary>& dictionary, const Mat &grey,
+                                     const Point2f *corners, Mat &candidateBits, Mat& onlyBits,
+                                     const Ptr<DetectorParameters>& params)
 {
-    CV_Assert(_corners.size() == 4);
-    CV_Assert(_image.getMat().total() != 0);
+    CV_Assert(grey.total() != 0);
     CV_Assert(params->markerBorderBits > 0);
 
     uint8_t typ=1;
     // get bits
-    Mat candidateBits =
-        _extractBits(_image, _corners, dictionary->markerSize, params->markerBorderBits,
-                     params->perspectiveRemovePixelPerCell,
-                     params->perspectiveRemoveIgnoredMarginPerCell, params->minOtsuStdDev);
+    _extractBits(grey, Mat(4, 1, CV_32FC2, (void *)corners), dictionary->markerSize,
+                 params->markerBorderBits, params->perspectiveRemovePixelPerCell,
+                 params->perspectiveRemoveIgnoredMarginPerCell, params->minOtsuStdDev, candidateBits);
 
     // analyze border bits
     int maximumErrorsInBorder =
@@ -548,56 +1455,57 @@ static uint8_t _identifyOneCandidate(const Ptr<Dictionary>& dictionary, InputArr
 
     // check if it is a white marker
     if(params->detectInvertedMarker){
-        // to get from 255 to 1
-        Mat invertedImg = ~candidateBits-254;
-        int invBError = _getBorderErrors(invertedImg, dictionary->markerSize, params->markerBorderBits);
+        // every right bit of the border is wrong once inverted
+        int invBError = candidateBits.rows * candidateBits.cols -
+                        dictionary->markerSize * dictionary->markerSize - borderErrors;
         // white marker
         if(invBError<borderErrors){
             borderErrors = invBError;
-            invertedImg.copyTo(candidateBits);
+            for(int y = 0; y < candidateBits.rows; y++) {
+                uchar *row = candidateBits.ptr(y);
+                for(int x = 0; x < candidateBits.cols; x++)
+                    row[x] ^= 1;
+            }
             typ=2;
         }
     }
     if(borderErrors > maximumErrorsInBorder) return 0; // border is wrong
 
     // take only inner bits
-    Mat onlyBits =
+    onlyBits =
         candidateBits.rowRange(params->markerBorderBits,
                                candidateBits.rows - params->markerBorderBits)
             .colRange(params->markerBorderBits, candidateBits.cols - params->markerBorderBits);
 
-    // try to indentify the marker
-    if(!dictionary->identify(onlyBits, idx, rotation, params->errorCorrectionRate))
-        return 0;
-
     return typ;
 }
 
 /**
- * @brief Copy the contents of a corners vector to an OutputArray, settings its size.
+ * @brief Copy the corners of a candidate list to an OutputArray, settings its size.
  */
-static void _copyVector2Output(vector< vector< Point2f > > &vec, OutputArrayOfArrays out) {
-    out.create((int)vec.size(), 1, CV_32FC2);
+static void _copyVector2Output(const _CandidateList &list, OutputArrayOfArrays out) {
+    out.create(list.size(), 1, CV_32FC2);
 
+    // each marker is output as a row of its four corners
     if(out.isMatVector()) {
-        for (unsigned int i = 0; i < vec.size(); i++) {
-            out.create(4, 1, CV_32FC2, i);
+        for (int i = 0; i < list.size(); i++) {
+            out.create(1, 4, CV_32FC2, i);
             Mat &m = out.getMatRef(i);
-            Mat(Mat(vec[i]).t()).copyTo(m);
+            Mat(1, 4, CV_32FC2, (void *)list.candidate(i)).copyTo(m);
         }
     }
     else if(out.isUMatVector()) {
-        for (unsigned int i = 0; i < vec.size(); i++) {
-            out.create(4, 1, CV_32FC2, i);
+        for (int i = 0; i < list.size(); i++) {
+            out.create(1, 4, CV_32FC2, i);
             UMat &m = out.getUMatRef(i);
-            Mat(Mat(vec[i]).t()).copyTo(m);
+            Mat(1, 4, CV_32FC2, (void *)list.candidate(i)).copyTo(m);
         }
     }
     else if(out.kind() == _OutputArray::STD_VECTOR_VECTOR){
-        for (unsigned int i = 0; i < vec.size(); i++) {
-            out.create(4, 1, CV_32FC2, i);
+        for (int i = 0; i < list.size(); i++) {
+            out.create(1, 4, CV_32FC2, i);
             Mat m = out.getMat(i);
-            Mat(Mat(vec[i]).t()).copyTo(m);
+            Mat(1, 4, CV_32FC2, (void *)list.candidate(i)).copyTo(m);
         }
     }
     else {
@@ -607,82 +1515,94 @@ static void _copyVector2Output(vector< vector< Point2f > > &vec, OutputArrayOfAr
 }
 
 /**
- * @brief rotate the initial corner to get to the right position
+ * @brief Extract the bits of a range of candidates, each into its own part of a common buffer
  */
-static void correctCornerPosition( vector< Point2f >& _candidate, int rotate){
-    std::rotate(_candidate.begin(), _candidate.begin() + 4 - rotate, _candidate.end());
-}
-
-/**
- * @brief Identify square candidates according to a marker dictionary
- */
-static void _identifyCandidates(InputArray _image, vector< vector< vector< Point2f > > >& _candidatesSet,
-                                vector< vector< vector<Point> > >& _contoursSet, const Ptr<Dictionary> &_dictionary,
-                                vector< vector< Point2f > >& _accepted, vector< vector<Point> >& _contours, vector< int >& ids,
-                                const Ptr<DetectorParameters> &params,
-                                OutputArrayOfArrays _rejected = noArray()) {
+class IdentifyCandidatesParallel : public ParallelLoopBody {
+public:
+    IdentifyCandidatesParallel(const Mat &_grey, const _CandidateList &_candidates,
+                               const Ptr<Dictionary> &_dictionary, const Ptr<DetectorParameters> &_params,
+                               vector< uchar > &_bits, vector< Mat > &_innerBits,
+                               vector< uint8_t > &_validCandidates)
+        : grey(_grey), candidates(_candidates), dictionary(_dictionary), params(_params), bits(_bits),
+          innerBits(_innerBits), validCandidates(_validCandidates) {}
+
+    void operator()(const Range &range) const CV_OVERRIDE {
+        const int sizeWithBorders = dictionary->markerSize + 2 * params->markerBorderBits;
+        for(int i = range.start; i < range.end; i++) {
+            Mat candidateBits(sizeWithBorders, sizeWithBorders, CV_8UC1,
+                              &bits[(size_t)i * sizeWithBorders * sizeWithBorders]);
+            validCandidates[i] = _extractCandidateBits(dictionary, grey, candidates.candidate(i),
+                                                       candidateBits, innerBits[i], params);
+            if(validCandidates[i] == 0)
+                innerBits[i].release();
+        }
+    }
 
-    int ncandidates = (int)_candidatesSet[0].size();
-    vector< vector< Point2f > > accepted;
-    vector< vector< Point2f > > rejected;
+private:
+    IdentifyCandidatesParallel &operator=(const IdentifyCandidatesParallel &); // to quiet MSVC
 
-    vector< vector< Point > > contours;
+    const Mat &grey;
+    const _CandidateList &candidates;
+    const Ptr<Dictionary> &dictionary;
+    const Ptr<DetectorParameters> &params;
+    vector< uchar > &bits;
+    vector< Mat > &innerBits;
+    vector< uint8_t > &validCandidates;
+};
 
-    CV_Assert(_image.getMat().total() != 0);
+/**
+ * @brief Identify the candidates of ws.candidatesSet according to a marker dictionary, into
+ * ws.accepted, ws.ids and ws.rejected
+ */
+static void _identifyCandidates(_DetectorWorkspace &ws, const Mat &grey, const Ptr<Dictionary> &_dictionary,
+                                const Ptr<DetectorParameters> &params) {
 
-    Mat grey;
-    _convertToGrey(_image.getMat(), grey);
+    CV_Assert(grey.total() != 0);
 
-    vector< int > idsTmp(ncandidates, -1);
-    vector< int > rotated(ncandidates, 0);
-    vector< uint8_t > validCandidates(ncandidates, 0);
+    const int ncandidates = ws.candidatesSet[0].size();
+    const int sizeWithBorders = _dictionary->markerSize + 2 * params->markerBorderBits;
+    ws.bits.resize((size_t)ncandidates * sizeWithBorders * sizeWithBorders);
+    ws.innerBits.resize(ncandidates);
+    ws.validCandidates.assign(ncandidates, 0);
 
     //// Analyze each of the candidates
-    parallel_for_(Range(0, ncandidates), [&](const Range &range) {
-        const int begin = range.start;
-        const int end = range.end;
-
-        vector< vector< Point2f > >& candidates = params->detectInvertedMarker ? _candidatesSet[1] : _candidatesSet[0];
-
-        for(int i = begin; i < end; i++) {
-            int currId;
-            validCandidates[i] = _identifyOneCandidate(_dictionary, grey, candidates[i], currId, params, rotated[i]);
-
-            if(validCandidates[i] > 0)
-                idsTmp[i] = currId;
-        }
-    });
-
+    int64 tick = getTickCount();
+    const _CandidateList &candidates = params->detectInvertedMarker ? ws.candidatesSet[1] : ws.candidatesSet[0];
+    parallel_for_(Range(0, ncandidates), IdentifyCandidatesParallel(grey, candidates, _dictionary, params,
+                                                                    ws.bits, ws.innerBits, ws.validCandidates));
+    ws.stats.bitsTime += _lapTime(tick);
+
+    // try to identify the markers, all at once so the dictionary is prepared only once
+    _dictionary->identify(ws.innerBits, ws.candidateIds, ws.rotations, params->errorCorrectionRate);
+
+    ws.accepted.clear();
+    ws.ids.clear();
+    ws.rejected.clear();
     for(int i = 0; i < ncandidates; i++) {
-        if(validCandidates[i] > 0) {
+        if(ws.validCandidates[i] > 0 && ws.candidateIds[i] >= 0) {
             // to choose the right set of candidates :: 0 for default, 1 for white markers
-            uint8_t set = validCandidates[i]-1;
+            uint8_t set = ws.validCandidates[i]-1;
 
             // shift corner positions to the correct rotation
-            correctCornerPosition(_candidatesSet[set][i], rotated[i]);
+            Point2f *corners = ws.candidatesSet[set].candidate(i);
+            std::rotate(corners, corners + 4 - ws.rotations[i], corners + 4);
 
-            if( !params->detectInvertedMarker && validCandidates[i] == 2 )
+            if( !params->detectInvertedMarker && ws.validCandidates[i] == 2 )
                 continue;
 
             // add valid candidate
-            accepted.push_back(_candidatesSet[set][i]);
-            ids.push_back(idsTmp[i]);
-
-            contours.push_back(_contoursSet[set][i]);
+            ws.accepted.push_back(ws.candidatesSet[set], i);
+            ws.ids.push_back(ws.candidateIds[i]);
 
         } else {
-            rejected.push_back(_candidatesSet[0][i]);
+            ws.rejected.push_back(ws.candidatesSet[0].candidate(i), 0, 0);
+            if(ws.validCandidates[i] == 0)
+                ws.stats.rejectedBorderBits++;
+            else
+                ws.stats.rejectedDictionary++;
         }
     }
-
-    // parse output
-    _accepted = accepted;
-
-    _contours= contours;
-
-    if(_rejected.needed()) {
-        _copyVector2Output(rejected, _rejected);
-    }
+    ws.stats.identifyTime += _lapTime(tick);
 }
 
 
@@ -861,9 +1781,11 @@ static void _darken(const Mat &im){
  * @param _params
  * @param candidates
  * @param contours
+ * @param arena buffers of the clusters, reused from one image to the next
+ * @param tiles buffers of the threshold, reused from one image to the next
  */
 static void _apriltag(Mat im_orig, const Ptr<DetectorParameters> & _params, std::vector< std::vector< Point2f > > &candidates,
-        std::vector< std::vector< Point > > &contours){
+        std::vector< std::vector< Point > > &contours, ClusterArena &arena, ThresholdTiles &tiles){
 
     ///////////////////////////////////////////////////////////
     /// Step 1. Detect quads according to requested image decimation
@@ -924,7 +1846,7 @@ static void _apriltag(Mat im_orig, const Ptr<DetectorParameters> & _params, std:
 
     ///////////////////////////////////////////////////////////
     /// Step 2. do the Threshold :: get the set of candidate quads
-    zarray_t *quads = apriltag_quad_thresh(_params, quad_im, contours);
+    zarray_t *quads = apriltag_quad_thresh(_params, quad_im, contours, arena, tiles);
 
     CV_Assert(quads != NULL);
 
@@ -976,47 +1898,46 @@ static void _apriltag(Mat im_orig, const Ptr<DetectorParameters> & _params, std:
         candidates.push_back(corners);
     }
 
-    _zarray_destroy(quads);
-}
-
-
-/**
-  */
-void detectMarkers(InputArray _image, const Ptr<Dictionary> &_dictionary, OutputArrayOfArrays _corners,
-                   OutputArray _ids, const Ptr<DetectorParameters> &_params,
-                   OutputArrayOfArrays _rejectedImgPoints, InputArrayOfArrays camMatrix, InputArrayOfArrays distCoeff) {
+    _zarray_destroy(quads);
+}
 
-    CV_Assert(!_image.empty());
 
-    Mat grey;
-    _convertToGrey(_image.getMat(), grey);
+/**
+ * @brief Candidate detection, identification and subpixel refinement on a grey image, into
+ * ws.accepted, ws.ids and ws.rejected
+ * @param referenceSize size the perimeter rates are relative to, the largest side of grey if 0
+ */
+static void _detectAndIdentify(_DetectorWorkspace &ws, const Mat &grey, const Ptr<Dictionary> &_dictionary,
+                               const Ptr<DetectorParameters> &_params, int referenceSize) {
 
     /// STEP 1: Detect marker candidates
-    vector< vector< Point2f > > candidates;
-    vector< vector< Point > > contours;
-    vector< int > ids;
-
-    vector< vector< vector< Point2f > > > candidatesSet;
-    vector< vector< vector< Point > > > contoursSet;
     /// STEP 1.a Detect marker candidates :: using AprilTag
     if(_params->cornerRefinementMethod == CORNER_REFINE_APRILTAG){
-        _apriltag(grey, _params, candidates, contours);
-
-        candidatesSet.push_back(candidates);
-        contoursSet.push_back(contours);
+        int64 tick = getTickCount();
+        vector< vector< Point2f > > candidates;
+        vector< vector< Point > > contours;
+        _apriltag(grey, _params, candidates, contours, ws.clusterArena, ws.thresholdTiles);
+        ws.stats.candidates += (int)candidates.size();
+
+        // the quads are both the default and the white candidates
+        for(int s = 0; s < 2; s++) {
+            ws.candidatesSet[s].clear();
+            for(size_t i = 0; i < candidates.size(); i++) {
+                const vector< Point > &contour = contours[i];
+                ws.candidatesSet[s].push_back(&candidates[i][0], contour.data(), (int)contour.size());
+            }
+        }
+        ws.stats.contourTime += _lapTime(tick);
     }
 
-    /// STEP 1.b Detect marker candidates :: traditional way
+    /// STEP 1.b Detect marker candidates :: traditional way, optionally on a decimated image
+    else if(_params->candidateDecimate > 1.f)
+        _detectCandidatesDecimated(ws, grey, _params, referenceSize);
     else
-        _detectCandidates(grey, candidatesSet, contoursSet, _params);
+        _detectCandidates(ws, grey, _params, referenceSize);
 
     /// STEP 2: Check candidate codification (identify markers)
-    _identifyCandidates(grey, candidatesSet, contoursSet, _dictionary, candidates, contours, ids, _params,
-                        _rejectedImgPoints);
-
-    // copy to output arrays
-    _copyVector2Output(candidates, _corners);
-    Mat(ids).copyTo(_ids);
+    _identifyCandidates(ws, grey, _dictionary, _params);
 
     /// STEP 3: Corner refinement :: use corner subpix
     if( _params->cornerRefinementMethod == CORNER_REFINE_SUBPIX ) {
@@ -1024,12 +1945,14 @@ void detectMarkers(InputArray _image, const Ptr<Dictionary> &_dictionary, Output
                   _params->cornerRefinementMinAccuracy > 0);
 
         //// do corner refinement for each of the detected markers
-        parallel_for_(Range(0, _corners.cols()), [&](const Range& range) {
+        int64 tick = getTickCount();
+        _CandidateList &candidates = ws.accepted;
+        parallel_for_(Range(0, candidates.size()), [&](const Range& range) {
             const int begin = range.start;
             const int end = range.end;
 
             for (int i = begin; i < end; i++) {
-                cornerSubPix(grey, _corners.getMat(i),
+                cornerSubPix(grey, Mat(4, 1, CV_32FC2, candidates.candidate(i)),
                              Size(_params->cornerRefinementWinSize, _params->cornerRefinementWinSize),
                              Size(-1, -1),
                              TermCriteria(TermCriteria::MAX_ITER | TermCriteria::EPS,
@@ -1037,27 +1960,255 @@ void detectMarkers(InputArray _image, const Ptr<Dictionary> &_dictionary, Output
                                           _params->cornerRefinementMinAccuracy));
             }
         });
+        ws.stats.refineTime += _lapTime(tick);
+    }
+}
+
+
+/**
+ * @brief Optional step 3 of detectMarkers :: corner refinement using the contour container
+ */
+static void _refineCornersWithContours(_CandidateList &candidates, InputArray camMatrix, InputArray distCoeff) {
+    // do corner refinement using the contours for each detected markers
+    parallel_for_(Range(0, candidates.size()), [&](const Range& range) {
+        for (int i = range.start; i < range.end; i++) {
+            vector< Point > contour(candidates.contour(i), candidates.contour(i) + candidates.contourSize(i));
+            vector< Point2f > corners(candidates.candidate(i), candidates.candidate(i) + 4);
+            _refineCandidateLines(contour, corners, camMatrix.getMat(), distCoeff.getMat());
+            std::copy(corners.begin(), corners.end(), candidates.candidate(i));
+        }
+    });
+}
+
+
+/**
+ * @brief detectMarkers with the buffers of ws
+ */
+static void _detectMarkers(_DetectorWorkspace &ws, InputArray _image, const Ptr<Dictionary> &_dictionary,
+                           OutputArrayOfArrays _corners, OutputArray _ids, const Ptr<DetectorParameters> &_params,
+                           OutputArrayOfArrays _rejectedImgPoints, InputArrayOfArrays camMatrix,
+                           InputArrayOfArrays distCoeff) {
+
+    CV_Assert(!_image.empty());
+    Mat image = _image.getMat();
+    CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+    const int64 start = getTickCount();
+    int64 tick = start;
+
+    // a grey image is only viewed
+    Mat grey = image;
+    if(image.type() == CV_8UC3) {
+        cvtColor(image, ws.grey, COLOR_BGR2GRAY);
+        grey = ws.grey;
     }
+    ws.stats.greyTime += _lapTime(tick);
+
+    _detectAndIdentify(ws, grey, _dictionary, _params, 0);
 
     /// STEP 3, Optional : Corner refinement :: use contour container
-    if( _params->cornerRefinementMethod == CORNER_REFINE_CONTOUR){
+    if( _params->cornerRefinementMethod == CORNER_REFINE_CONTOUR && _params->candidateDecimate <= 1.f &&
+        !ws.ids.empty()) {
+        tick = getTickCount();
+        _refineCornersWithContours(ws.accepted, camMatrix, distCoeff);
+        ws.stats.refineTime += _lapTime(tick);
+    }
 
-        if(! _ids.empty()){
+    // copy to output arrays
+    _copyVector2Output(ws.accepted, _corners);
+    Mat(ws.ids).copyTo(_ids);
+    if(_rejectedImgPoints.needed())
+        _copyVector2Output(ws.rejected, _rejectedImgPoints);
+
+    ws.stats.frames++;
+    ws.stats.markers += (int)ws.ids.size();
+    ws.stats.totalTime += (double)(getTickCount() - start) * 1000. / getTickFrequency();
+}
 
-            // do corner refinement using the contours for each detected markers
-            parallel_for_(Range(0, _corners.cols()), [&](const Range& range) {
-                for (int i = range.start; i < range.end; i++) {
-                    _refineCandidateLines(contours[i], candidates[i], camMatrix.getMat(),
-                                          distCoeff.getMat());
-                }
-            });
 
-            // copy the corners to the output array
-            _copyVector2Output(candidates, _corners);
+/**
+  */
+void detectMarkers(InputArray _image, const Ptr<Dictionary> &_dictionary, OutputArrayOfArrays _corners,
+                   OutputArray _ids, const Ptr<DetectorParameters> &_params,
+                   OutputArrayOfArrays _rejectedImgPoints, InputArrayOfArrays camMatrix, InputArrayOfArrays distCoeff) {
+
+    _DetectorWorkspace ws;
+    _detectMarkers(ws, _image, _dictionary, _corners, _ids, _params, _rejectedImgPoints, camMatrix, distCoeff);
+}
+
+
+/**
+ * @brief Clip regions to the image and replace overlapping regions by their bounding box
+ */
+static vector< Rect > _mergeRegions(const vector< Rect > &regions, Size imageSize) {
+
+    vector< Rect > merged;
+    for(size_t i = 0; i < regions.size(); i++) {
+        Rect region = regions[i] & Rect(Point(0, 0), imageSize);
+        if(!region.empty())
+            merged.push_back(region);
+    }
+
+    // a union can overlap regions it did not overlap before, so repeat until stable
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(size_t i = 0; i < merged.size() && !changed; i++) {
+            for(size_t j = i + 1; j < merged.size(); j++) {
+                if((merged[i] & merged[j]).empty())
+                    continue;
+                merged[i] |= merged[j];
+                merged.erase(merged.begin() + j);
+                changed = true;
+                break;
+            }
+        }
+    }
+    return merged;
+}
+
+
+/**
+ * @brief detectMarkers restricted to regions with the buffers of ws
+ */
+static void _detectMarkersInRegions(_DetectorWorkspace &ws, InputArray _image, const Ptr<Dictionary> &_dictionary,
+                                    OutputArrayOfArrays _corners, OutputArray _ids, const std::vector<Rect> &regions,
+                                    const Ptr<DetectorParameters> &_params, OutputArrayOfArrays _rejectedImgPoints,
+                                    InputArray camMatrix, InputArray distCoeff) {
+
+    CV_Assert(!_image.empty());
+    Mat image = _image.getMat();
+    CV_Assert(image.type() == CV_8UC1 || image.type() == CV_8UC3);
+    const int64 start = getTickCount();
+
+    // perimeter limits as if the whole image was searched
+    const int referenceSize = max(image.cols, image.rows);
+
+    // the buffers are shared by the regions
+    _CandidateList &candidates = ws.regionAccepted, &rejected = ws.regionRejected;
+    vector< int > &ids = ws.regionIds;
+    candidates.clear();
+    rejected.clear();
+    ids.clear();
+
+    vector< Rect > merged = _mergeRegions(regions, image.size());
+    for(size_t r = 0; r < merged.size(); r++) {
+        const Rect &region = merged[r];
+
+        // a grey image is only viewed, a color one is converted inside the region only
+        int64 tick = getTickCount();
+        Mat grey;
+        if(image.type() == CV_8UC1)
+            grey = image(region);
+        else
+            cvtColor(image(region), grey, COLOR_BGR2GRAY);
+        ws.stats.greyTime += _lapTime(tick);
+
+        _detectAndIdentify(ws, grey, _dictionary, _params, referenceSize);
+
+        // back to full image coordinates
+        const Point offset = region.tl();
+        const Point2f offsetf((float)offset.x, (float)offset.y);
+        for(size_t c = 0; c < ws.accepted.corners.size(); c++)
+            ws.accepted.corners[c] += offsetf;
+        for(size_t c = 0; c < ws.accepted.points.size(); c++)
+            ws.accepted.points[c] += offset;
+        for(int i = 0; i < ws.accepted.size(); i++) {
+            candidates.push_back(ws.accepted, i);
+            ids.push_back(ws.ids[i]);
+        }
+        if(_rejectedImgPoints.needed()) {
+            for(int i = 0; i < ws.rejected.size(); i++) {
+                Point2f corners[4];
+                for(int c = 0; c < 4; c++)
+                    corners[c] = ws.rejected.candidate(i)[c] + offsetf;
+                rejected.push_back(corners, 0, 0);
+            }
         }
     }
+
+    /// Optional : Corner refinement :: use contour container, after the offset since the
+    /// camera matrix is given in full image coordinates
+    if( _params->cornerRefinementMethod == CORNER_REFINE_CONTOUR && _params->candidateDecimate <= 1.f &&
+        !ids.empty()) {
+        int64 tick = getTickCount();
+        _refineCornersWithContours(candidates, camMatrix, distCoeff);
+        ws.stats.refineTime += _lapTime(tick);
+    }
+
+    // copy to output arrays
+    _copyVector2Output(candidates, _corners);
+    Mat(ids).copyTo(_ids);
+    if(_rejectedImgPoints.needed())
+        _copyVector2Output(rejected, _rejectedImgPoints);
+
+    ws.stats.frames++;
+    ws.stats.markers += (int)ids.size();
+    ws.stats.totalTime += (double)(getTickCount() - start) * 1000. / getTickFrequency();
+}
+
+
+/**
+  */
+void detectMarkers(InputArray _image, const Ptr<Dictionary> &_dictionary, OutputArrayOfArrays _corners,
+                   OutputArray _ids, const std::vector<Rect> &regions, const Ptr<DetectorParameters> &_params,
+                   OutputArrayOfArrays _rejectedImgPoints, InputArray camMatrix, InputArray distCoeff) {
+
+    _DetectorWorkspace ws;
+    _detectMarkersInRegions(ws, _image, _dictionary, _corners, _ids, regions, _params, _rejectedImgPoints,
+                            camMatrix, distCoeff);
+}
+
+
+/**
+  * @brief Buffers of ArucoDetector, kept from one image to the next
+  */
+struct ArucoDetector::Workspace : public _DetectorWorkspace {};
+
+/**
+  */
+ArucoDetector::ArucoDetector(const Ptr<Dictionary> &_dictionary, const Ptr<DetectorParameters> &_parameters)
+    : dictionary(_dictionary), parameters(_parameters), workspace(makePtr<Workspace>()) {}
+
+/**
+  */
+Ptr<ArucoDetector> ArucoDetector::create(const Ptr<Dictionary> &_dictionary,
+                                         const Ptr<DetectorParameters> &_parameters) {
+    return makePtr<ArucoDetector>(_dictionary, _parameters);
+}
+
+/**
+  */
+void ArucoDetector::detectMarkers(InputArray image, OutputArrayOfArrays corners, OutputArray ids,
+                                  OutputArrayOfArrays rejectedImgPoints, InputArray cameraMatrix,
+                                  InputArray distCoeff) {
+    CV_Assert(!dictionary.empty() && !parameters.empty());
+    _detectMarkers(*workspace, image, dictionary, corners, ids, parameters, rejectedImgPoints, cameraMatrix,
+                   distCoeff);
+}
+
+/**
+  */
+void ArucoDetector::detectMarkers(InputArray image, OutputArrayOfArrays corners, OutputArray ids,
+                                  const std::vector<Rect> &regions, OutputArrayOfArrays rejectedImgPoints,
+                                  InputArray cameraMatrix, InputArray distCoeff) {
+    CV_Assert(!dictionary.empty() && !parameters.empty());
+    _detectMarkersInRegions(*workspace, image, dictionary, corners, ids, regions, parameters, rejectedImgPoints,
+                            cameraMatrix, distCoeff);
+}
+
+/**
+  */
+DetectorStatistics ArucoDetector::getStatistics() const {
+    return workspace->stats;
+}
+
+/**
+  */
+void ArucoDetector::resetStatistics() {
+    workspace->stats.reset();
 }
 
+
 /**
   */
 void estimatePoseSingleMarkers(InputArrayOfArrays _corners, float markerLength,
@@ -1091,6 +2242,317 @@ void estimatePoseSingleMarkers(InputArrayOfArrays _corners, float markerLength,
 }
 
 
+/**
+ * @brief Arithmetic of _solveSquarePoses on one double at a time
+ */
+struct _ScalarOps {
+    typedef double T;
+    static inline T all(double value) { return value; }
+    static inline T sqrt(T value) { return std::sqrt(value); }
+    static inline T abs(T value) { return std::fabs(value); }
+    /** @brief a < b ? x : y */
+    static inline T selectLess(T a, T b, T x, T y) { return a < b ? x : y; }
+};
+
+#if CV_SIMD_64F
+/**
+ * @brief Arithmetic of _solveSquarePoses on a SIMD register of doubles, one marker per lane
+ */
+struct _VectorOps {
+    typedef v_float64 T;
+    static inline T all(double value) { return vx_setall_f64(value); }
+    static inline T sqrt(const T &value) { return v_sqrt(value); }
+    static inline T abs(const T &value) { return v_abs(value); }
+    static inline T selectLess(const T &a, const T &b, const T &x, const T &y) { return v_select(a < b, x, y); }
+};
+#endif
+
+/**
+ * @brief Rotation of an IPPE solution, from the 2x2 block rt of the rotation before it is turned
+ * by rv and the last components b0, b1 of its first two columns
+ */
+template<typename Ops>
+static inline void _squareRotation(const typename Ops::T rt[4], const typename Ops::T rv[9],
+                                   const typename Ops::T &b0, const typename Ops::T &b1,
+                                   typename Ops::T R[9]) {
+    typedef typename Ops::T T;
+    const T c0 = b1 * rt[2] - b0 * rt[3], c1 = b0 * rt[1] - b1 * rt[0], c2 = rt[0] * rt[3] - rt[1] * rt[2];
+    for(int r = 0; r < 3; r++) {
+        R[3 * r] = rt[0] * rv[3 * r] + rt[2] * rv[3 * r + 1] + b0 * rv[3 * r + 2];
+        R[3 * r + 1] = rt[1] * rv[3 * r] + rt[3] * rv[3 * r + 1] + b1 * rv[3 * r + 2];
+        R[3 * r + 2] = c0 * rv[3 * r] + c1 * rv[3 * r + 1] + c2 * rv[3 * r + 2];
+    }
+}
+
+/**
+ * @brief IPPE of a square (calib3d PoseSolver::solveSquare) from the normalized corners x, y
+ *
+ * Gives both poses, the best one first, and their reprojection errors in pixels, which are
+ * infinite if the corners are degenerate. The steps are those of the PoseSolver, in closed form
+ * and without branches so that several markers are solved at once when Ops works on registers.
+ */
+template<typename Ops>
+static void _solveSquarePoses(const typename Ops::T x[4], const typename Ops::T y[4], double halfLength,
+                              double fx, double fy, typename Ops::T R[2][9], typename Ops::T t[2][3],
+                              typename Ops::T err[2]) {
+    typedef typename Ops::T T;
+    const T zero = Ops::all(0.), one = Ops::all(1.), h = Ops::all(halfLength);
+
+    // homography from the square to the corners (homographyFromSquarePoints)
+    const T p1x = zero - x[0], p1y = zero - y[0], p2x = zero - x[1], p2y = zero - y[1];
+    const T p3x = zero - x[2], p3y = zero - y[2], p4x = zero - x[3], p4y = zero - y[3];
+    const T det = h * (p1x * p2y - p2x * p1y - p1x * p4y + p2x * p3y - p3x * p2y + p4x * p1y + p3x * p4y - p4x * p3y);
+    const T detsInv = Ops::all(-1.) / det;
+    const T H00 = detsInv * (p1x * p3x * p2y - p2x * p3x * p1y - p1x * p4x * p2y + p2x * p4x * p1y - p1x * p3x * p4y + p1x * p4x * p3y + p2x * p3x * p4y - p2x * p4x * p3y);
+    const T H01 = detsInv * (p1x * p2x * p3y - p1x * p3x * p2y - p1x * p2x * p4y + p2x * p4x * p1y + p1x * p3x * p4y - p3x * p4x * p1y - p2x * p4x * p3y + p3x * p4x * p2y);
+    const T H02 = detsInv * h * (p1x * p2x * p3y - p2x * p3x * p1y - p1x * p2x * p4y + p1x * p4x * p2y - p1x * p4x * p3y + p3x * p4x * p1y + p2x * p3x * p4y - p3x * p4x * p2y);
+    const T H10 = detsInv * (p1x * p2y * p3y - p2x * p1y * p3y - p1x * p2y * p4y + p2x * p1y * p4y - p3x * p1y * p4y + p4x * p1y * p3y + p3x * p2y * p4y - p4x * p2y * p3y);
+    const T H11 = detsInv * (p2x * p1y * p3y - p3x * p1y * p2y - p1x * p2y * p4y + p4x * p1y * p2y + p1x * p3y * p4y - p4x * p1y * p3y - p2x * p3y * p4y + p3x * p2y * p4y);
+    const T H12 = detsInv * h * (p1x * p2y * p3y - p3x * p1y * p2y - p2x * p1y * p4y + p4x * p1y * p2y - p1x * p3y * p4y + p3x * p1y * p4y + p2x * p3y * p4y - p4x * p2y * p3y);
+    const T H20 = (zero - detsInv) * (p1x * p3y - p3x * p1y - p1x * p4y - p2x * p3y + p3x * p2y + p4x * p1y + p2x * p4y - p4x * p2y);
+    const T H21 = detsInv * (p1x * p2y - p2x * p1y - p1x * p3y + p3x * p1y + p2x * p4y - p4x * p2y - p3x * p4y + p4x * p3y);
+
+    // Jacobian of the homography at the center of the square (solveCanonicalForm)
+    const T j00 = H00 - H20 * H02, j01 = H01 - H21 * H02, j10 = H10 - H20 * H12, j11 = H11 - H21 * H12;
+    const T p = H02, q = H12;
+
+    // rotation of (p, q, 1) to the Z axis, transposed (rotateVec2ZAxis, whose special case
+    // needs a negative third component)
+    const T nrm = Ops::sqrt(p * p + q * q + one);
+    const T ax = p / nrm, ay = q / nrm, d = one / (one + one / nrm);
+    const T ax2 = ax * ax, ay2 = ay * ay, axay = ax * ay;
+    const T rv[9] = { one - ax2 * d, zero - axay * d, ax,
+                      zero - axay * d, one - ay2 * d, ay,
+                      zero - ax, zero - ay, one - (ax2 + ay2) * d };
+
+    // the two rotations (computeRotations)
+    const T b00 = rv[0] - p * rv[6], b01 = rv[1] - p * rv[7], b10 = rv[3] - q * rv[6], b11 = rv[4] - q * rv[7];
+    const T dtinv = one / (b00 * b11 - b01 * b10);
+    const T binv00 = dtinv * b11, binv01 = (zero - dtinv) * b01, binv10 = (zero - dtinv) * b10, binv11 = dtinv * b00;
+    const T a00 = binv00 * j00 + binv01 * j10, a01 = binv00 * j01 + binv01 * j11;
+    const T a10 = binv10 * j00 + binv11 * j10, a11 = binv10 * j01 + binv11 * j11;
+    const T ata00 = a00 * a00 + a01 * a01, ata01 = a00 * a10 + a01 * a11, ata11 = a10 * a10 + a11 * a11;
+    const T gamma = Ops::sqrt(Ops::all(0.5) * (ata00 + ata11 + Ops::sqrt((ata00 - ata11) * (ata00 - ata11) +
+                                                                          Ops::all(4.) * ata01 * ata01)));
+    const T rt[4] = { a00 / gamma, a01 / gamma, a10 / gamma, a11 / gamma };
+    const T b0 = Ops::sqrt(zero - rt[0] * rt[0] - rt[2] * rt[2] + one);
+    T b1 = Ops::sqrt(zero - rt[1] * rt[1] - rt[3] * rt[3] + one);
+    b1 = Ops::selectLess((zero - rt[0]) * rt[1] - rt[2] * rt[3], zero, zero - b1, b1);
+    T Rs[2][9];
+    _squareRotation<Ops>(rt, rv, b0, b1, Rs[0]);
+    _squareRotation<Ops>(rt, rv, zero - b0, zero - b1, Rs[1]);
+
+    // translations by least squares, the normal equations only depend on the corners
+    // (computeTranslation)
+    const T X[4] = { zero - h, h, h, zero - h }, Y[4] = { h, h, zero - h, zero - h };
+    const T ATA00 = Ops::all(4.), ATA11 = Ops::all(4.);
+    T ATA02 = zero, ATA12 = zero, ATA22 = zero;
+    for(int k = 0; k < 4; k++) {
+        ATA02 = ATA02 - x[k];
+        ATA12 = ATA12 - y[k];
+        ATA22 = ATA22 + x[k] * x[k] + y[k] * y[k];
+    }
+    const T ATA20 = ATA02, ATA21 = ATA12;
+    const T detAInv = one / (ATA00 * ATA11 * ATA22 - ATA00 * ATA12 * ATA21 - ATA02 * ATA11 * ATA20);
+    const T S00 = ATA11 * ATA22 - ATA12 * ATA21, S01 = ATA02 * ATA21, S02 = (zero - ATA02) * ATA11;
+    const T S10 = ATA12 * ATA20, S11 = ATA00 * ATA22 - ATA02 * ATA20, S12 = (zero - ATA00) * ATA12;
+    const T S20 = (zero - ATA11) * ATA20, S21 = (zero - ATA00) * ATA21, S22 = ATA00 * ATA11;
+
+    T ts[2][3], errs[2];
+    for(int s = 0; s < 2; s++) {
+        const T *Rm = Rs[s];
+        T ATb0 = zero, ATb1 = zero, ATb2 = zero;
+        for(int k = 0; k < 4; k++) {
+            T rx = Rm[0] * X[k] + Rm[1] * Y[k], ry = Rm[3] * X[k] + Rm[4] * Y[k], rz = Rm[6] * X[k] + Rm[7] * Y[k];
+            T bx = x[k] * rz - rx, by = y[k] * rz - ry;
+            ATb0 = ATb0 + bx;
+            ATb1 = ATb1 + by;
+            ATb2 = ATb2 - x[k] * bx - y[k] * by;
+        }
+        ts[s][0] = detAInv * (S00 * ATb0 + S01 * ATb1 + S02 * ATb2);
+        ts[s][1] = detAInv * (S10 * ATb0 + S11 * ATb1 + S12 * ATb2);
+        ts[s][2] = detAInv * (S20 * ATb0 + S21 * ATb1 + S22 * ATb2);
+
+        // reprojection error, in pixels
+        T sum = zero;
+        for(int k = 0; k < 4; k++) {
+            T cx = Rm[0] * X[k] + Rm[1] * Y[k] + ts[s][0];
+            T cy = Rm[3] * X[k] + Rm[4] * Y[k] + ts[s][1];
+            T cz = Rm[6] * X[k] + Rm[7] * Y[k] + ts[s][2];
+            T dx = (cx / cz - x[k]) * Ops::all(fx), dy = (cy / cz - y[k]) * Ops::all(fy);
+            sum = sum + dx * dx + dy * dy;
+        }
+        errs[s] = Ops::sqrt(sum * Ops::all(1. / 8));
+
+        // the corners are degenerate (homographyFromSquarePoints and computeRotations errors)
+        const T inf = Ops::all(std::numeric_limits< double >::infinity());
+        errs[s] = Ops::selectLess(Ops::abs(det), Ops::all(1e-9), inf, errs[s]);
+        errs[s] = Ops::selectLess(gamma, Ops::all(std::numeric_limits< float >::epsilon()), inf, errs[s]);
+    }
+
+    // the pose with the smallest error first (sortPosesByReprojError)
+    for(int k = 0; k < 9; k++) {
+        R[0][k] = Ops::selectLess(errs[0], errs[1], Rs[0][k], Rs[1][k]);
+        R[1][k] = Ops::selectLess(errs[0], errs[1], Rs[1][k], Rs[0][k]);
+    }
+    for(int k = 0; k < 3; k++) {
+        t[0][k] = Ops::selectLess(errs[0], errs[1], ts[0][k], ts[1][k]);
+        t[1][k] = Ops::selectLess(errs[0], errs[1], ts[1][k], ts[0][k]);
+    }
+    err[0] = Ops::selectLess(errs[0], errs[1], errs[0], errs[1]);
+    err[1] = Ops::selectLess(errs[0], errs[1], errs[1], errs[0]);
+}
+
+/**
+ * @brief Rotation vector of a rotation matrix
+ *
+ * PoseSolver::rot2vec divides by the sine of the angle, which loses the axis near pi: the angle
+ * comes from atan2 instead, and the axis from the symmetric part of R near pi.
+ */
+static Vec3d _rotationMatrixToVector(const double R[9]) {
+    // 2 sin(angle) axis
+    Vec3d antisymmetric(R[7] - R[5], R[2] - R[6], R[3] - R[1]);
+    double twiceSin = norm(antisymmetric), cosAngle = (R[0] + R[4] + R[8] - 1.0) / 2.0;
+    double angle = std::atan2(twiceSin / 2, cosAngle);
+    if(angle < std::numeric_limits< float >::epsilon()) // rotation is the identity
+        return Vec3d(0, 0, 0);
+    if(cosAngle > -0.9)
+        return antisymmetric * (angle / twiceSin);
+
+    // R + R^t = 2 cos(angle) I + 2 (1 - cos(angle)) axis axis^t, whose column of largest diagonal
+    // element is the best conditioned
+    int k = 0;
+    for(int j = 1; j < 3; j++)
+        if(R[4 * j] > R[4 * k])
+            k = j;
+    Vec3d axis;
+    for(int j = 0; j < 3; j++)
+        axis[j] = j == k ? R[4 * k] - cosAngle : (R[3 * j + k] + R[3 * k + j]) / 2;
+    axis *= 1. / norm(axis);
+    if(axis.dot(antisymmetric) < 0)
+        axis = -axis;
+    return axis * angle;
+}
+
+/**
+  */
+void estimatePoseSquareMarkers(InputArrayOfArrays _corners, float markerLength, InputArray _cameraMatrix,
+                               InputArray _distCoeffs, OutputArray _rvecs, OutputArray _tvecs,
+                               OutputArray _rvecs2, OutputArray _tvecs2, OutputArray _reprojectionErrors) {
+
+    CV_Assert(markerLength > 0);
+
+    // the corners of all the markers, one after the other
+    Mat corners;
+    if(_corners.kind() == _InputArray::MAT || _corners.kind() == _InputArray::STD_VECTOR) {
+        Mat all = _corners.getMat();
+        CV_Assert(all.isContinuous() && all.total() * all.channels() % 8 == 0);
+        all.reshape(2, (int)(all.total() * all.channels() / 2)).convertTo(corners, CV_64F);
+    }
+    else {
+        int nMarkers = (int)_corners.total();
+        corners.create(4 * nMarkers, 1, CV_64FC2);
+        for(int i = 0; i < nMarkers; i++) {
+            Mat marker = _corners.getMat(i);
+            CV_Assert(marker.total() == 4 && marker.channels() == 2 && marker.isContinuous());
+            Mat rows = corners.rowRange(4 * i, 4 * i + 4);
+            marker.reshape(2, 4).convertTo(rows, CV_64F);
+        }
+    }
+    CV_Assert(corners.depth() == CV_64F);
+    const int n = corners.rows / 4;
+
+    // undistorted together, to normalized coordinates
+    Mat normalized;
+    if(n > 0)
+        undistortPoints(corners, normalized, _cameraMatrix, _distCoeffs);
+    Matx33d cameraMatrix;
+    _cameraMatrix.getMat().convertTo(cameraMatrix, CV_64F);
+    const double fx = cameraMatrix(0, 0), fy = cameraMatrix(1, 1);
+
+    // x and y of each corner of all the markers, so that consecutive markers can be loaded together
+    AutoBuffer< double > coords(8 * max(n, 1));
+    for(int i = 0; i < n; i++) {
+        const Point2d *pts = normalized.ptr< Point2d >(4 * i);
+        for(int k = 0; k < 4; k++) {
+            coords[k * n + i] = pts[k].x;
+            coords[(4 + k) * n + i] = pts[k].y;
+        }
+    }
+
+    // both rotations, translations and errors of each marker, in the same layout
+    enum { R_OFFSET = 0, T_OFFSET = 18, ERR_OFFSET = 24, N_VALUES = 26 };
+    AutoBuffer< double > poses(N_VALUES * max(n, 1));
+    const double halfLength = markerLength / 2.0;
+    int i = 0;
+#if CV_SIMD_64F
+    for(; i <= n - v_float64::nlanes; i += v_float64::nlanes) {
+        v_float64 x[4], y[4], R[2][9], t[2][3], err[2];
+        for(int k = 0; k < 4; k++) {
+            x[k] = vx_load(&coords[k * n + i]);
+            y[k] = vx_load(&coords[(4 + k) * n + i]);
+        }
+        _solveSquarePoses<_VectorOps>(x, y, halfLength, fx, fy, R, t, err);
+        for(int s = 0; s < 2; s++) {
+            for(int k = 0; k < 9; k++)
+                v_store(&poses[(R_OFFSET + 9 * s + k) * n + i], R[s][k]);
+            for(int k = 0; k < 3; k++)
+                v_store(&poses[(T_OFFSET + 3 * s + k) * n + i], t[s][k]);
+            v_store(&poses[(ERR_OFFSET + s) * n + i], err[s]);
+        }
+    }
+#endif
+    for(; i < n; i++) {
+        double x[4], y[4], R[2][9], t[2][3], err[2];
+        for(int k = 0; k < 4; k++) {
+            x[k] = coords[k * n + i];
+            y[k] = coords[(4 + k) * n + i];
+        }
+        _solveSquarePoses<_ScalarOps>(x, y, halfLength, fx, fy, R, t, err);
+        for(int s = 0; s < 2; s++) {
+            for(int k = 0; k < 9; k++)
+                poses[(R_OFFSET + 9 * s + k) * n + i] = R[s][k];
+            for(int k = 0; k < 3; k++)
+                poses[(T_OFFSET + 3 * s + k) * n + i] = t[s][k];
+            poses[(ERR_OFFSET + s) * n + i] = err[s];
+        }
+    }
+
+    // rotation vectors, which need atan2 and a separate branch near pi, one marker at a time
+    Mat rvecs[2], tvecs[2], errors;
+    for(int s = 0; s < 2; s++) {
+        rvecs[s].create(n, 1, CV_64FC3);
+        tvecs[s].create(n, 1, CV_64FC3);
+    }
+    errors.create(n, 1, CV_64FC2);
+    for(i = 0; i < n; i++) {
+        const double err0 = poses[ERR_OFFSET * n + i], err1 = poses[(ERR_OFFSET + 1) * n + i];
+        const bool valid = err0 <= DBL_MAX; // neither infinite nor NaN
+        for(int s = 0; s < 2; s++) {
+            double R[9];
+            Vec3d t;
+            for(int k = 0; k < 9; k++)
+                R[k] = poses[(R_OFFSET + 9 * s + k) * n + i];
+            for(int k = 0; k < 3; k++)
+                t[k] = poses[(T_OFFSET + 3 * s + k) * n + i];
+            rvecs[s].at< Vec3d >(i) = valid ? _rotationMatrixToVector(R) : Vec3d(0, 0, 0);
+            tvecs[s].at< Vec3d >(i) = valid ? t : Vec3d(0, 0, 0);
+        }
+        const double inf = std::numeric_limits< double >::infinity();
+        errors.at< Vec2d >(i) = valid ? Vec2d(err0, err1 <= DBL_MAX ? err1 : inf) : Vec2d(inf, inf);
+    }
+
+    rvecs[0].copyTo(_rvecs);
+    tvecs[0].copyTo(_tvecs);
+    if(_rvecs2.needed())
+        rvecs[1].copyTo(_rvecs2);
+    if(_tvecs2.needed())
+        tvecs[1].copyTo(_tvecs2);
+    if(_reprojectionErrors.needed())
+        errors.copyTo(_reprojectionErrors);
+}
+
+
 
 void getBoardObjectAndImagePoints(const Ptr<Board> &board, InputArrayOfArrays detectedCorners,
     InputArray detectedIds, OutputArray objPoints, OutputArray imgPoints) {
@@ -1239,6 +2701,91 @@ static void _projectUndetectedMarkers(const Ptr<Board> &_board, InputOutputArray
 
 
 
+/**
+ * @brief Rejected candidate recovered for one missing marker by refineDetectedMarkers
+ *
+ * Among the candidates with all their corners less than minRepDistance away from the projected
+ * ones and a code close enough to the marker, the closest one, or the first one of equally close
+ * candidates.
+ * @param candidates indexes in rejected of the candidates to consider, in increasing order
+ * @param taken candidates already recovered for another marker, which are skipped, or null
+ * @param rotated output corners of the recovered candidate, in the order of the projected ones
+ * @return index of the recovered candidate in rejected, -1 if none matches
+ */
+static int _recoverMarker(const Mat &grey, const _CandidateList &rejected, const vector< int > &candidates,
+                          const uchar *taken, const Point2f *projected, int id, const Dictionary &dictionary,
+                          const DetectorParameters &params, float minRepDistance, float errorCorrectionRate,
+                          bool checkAllOrders, Point2f *rotated) {
+
+    // maximum bits that can be corrected
+    int maxCorrectionRecalculated =
+        int(double(dictionary.maxCorrectionBits) * errorCorrectionRate);
+
+    // best match at the moment
+    int closestCandidateIdx = -1;
+    double closestCandidateDistance = minRepDistance * minRepDistance + 1;
+
+    for(size_t n = 0; n < candidates.size(); n++) {
+        const int j = candidates[n];
+        if(taken && taken[j]) continue;
+        const Point2f *rejCorners = rejected.candidate(j);
+
+        // check distance
+        double minDistance = closestCandidateDistance + 1;
+        bool valid = false;
+        int validRot = 0;
+        for(int c = 0; c < 4; c++) { // first corner in rejected candidate
+            double currentMaxDistance = 0;
+            for(int k = 0; k < 4; k++) {
+                Point2f distVector = projected[k] - rejCorners[(c + k) % 4];
+                double cornerDist = distVector.x * distVector.x + distVector.y * distVector.y;
+                currentMaxDistance = max(currentMaxDistance, cornerDist);
+            }
+            // if distance is better than current best distance
+            if(currentMaxDistance < closestCandidateDistance) {
+                valid = true;
+                validRot = c;
+                minDistance = currentMaxDistance;
+            }
+            if(!checkAllOrders) break;
+        }
+
+        if(!valid) continue;
+
+        // apply rotation
+        Point2f rotatedMarker[4];
+        for(int c = 0; c < 4; c++)
+            rotatedMarker[c] = rejCorners[(c + validRot) % 4];
+
+        // last filter, check if inner code is close enough to the assigned marker code
+        int codeDistance = 0;
+        // if errorCorrectionRate, dont check code
+        if(errorCorrectionRate >= 0) {
+
+            // extract bits
+            Mat bits;
+            _extractBits(grey, Mat(4, 1, CV_32FC2, rotatedMarker), dictionary.markerSize, params.markerBorderBits,
+                         params.perspectiveRemovePixelPerCell, params.perspectiveRemoveIgnoredMarginPerCell,
+                         params.minOtsuStdDev, bits);
+
+            Mat onlyBits =
+                bits.rowRange(params.markerBorderBits, bits.rows - params.markerBorderBits)
+                    .colRange(params.markerBorderBits, bits.rows - params.markerBorderBits);
+
+            codeDistance = dictionary.getDistanceToId(onlyBits, id, false);
+        }
+
+        // if everythin is ok, assign values to current best match
+        if(errorCorrectionRate < 0 || codeDistance < maxCorrectionRecalculated) {
+            closestCandidateIdx = j;
+            closestCandidateDistance = minDistance;
+            std::copy(rotatedMarker, rotatedMarker + 4, rotated);
+        }
+    }
+    return closestCandidateIdx;
+}
+
+
 /**
   */
 void refineDetectedMarkers(InputArray _image, const Ptr<Board> &_board,
@@ -1268,125 +2815,87 @@ void refineDetectedMarkers(InputArray _image, const Ptr<Board> &_board,
                                   undetectedMarkersIds);
     }
 
-    // list of missing markers indicating if they have been assigned to a candidate
-    vector< bool > alreadyIdentified(_rejectedCorners.total(), false);
-
-    // maximum bits that can be corrected
     Dictionary &dictionary = *(_board->dictionary);
-    int maxCorrectionRecalculated =
-        int(double(dictionary.maxCorrectionBits) * errorCorrectionRate);
 
     Mat grey;
     _convertToGrey(_image, grey);
 
-    // vector of final detected marker corners and ids
-    vector< Mat > finalAcceptedCorners;
-    vector< int > finalAcceptedIds;
-    // fill with the current markers
-    finalAcceptedCorners.resize(_detectedCorners.total());
-    finalAcceptedIds.resize(_detectedIds.total());
-    for(unsigned int i = 0; i < _detectedIds.total(); i++) {
-        finalAcceptedCorners[i] = _detectedCorners.getMat(i).clone();
-        finalAcceptedIds[i] = _detectedIds.getMat().ptr< int >()[i];
-    }
-    vector< int > recoveredIdxs; // original indexes of accepted markers in _rejectedCorners
-
-    // for each missing marker, try to find a correspondence
-    for(unsigned int i = 0; i < undetectedMarkersIds.size(); i++) {
-
-        // best match at the moment
-        int closestCandidateIdx = -1;
-        double closestCandidateDistance = minRepDistance * minRepDistance + 1;
-        Mat closestRotatedMarker;
-
-        for(unsigned int j = 0; j < _rejectedCorners.total(); j++) {
-            if(alreadyIdentified[j]) continue;
-
-            // check distance
-            double minDistance = closestCandidateDistance + 1;
-            bool valid = false;
-            int validRot = 0;
-            for(int c = 0; c < 4; c++) { // first corner in rejected candidate
-                double currentMaxDistance = 0;
-                for(int k = 0; k < 4; k++) {
-                    Point2f rejCorner = _rejectedCorners.getMat(j).ptr< Point2f >()[(c + k) % 4];
-                    Point2f distVector = undetectedMarkersCorners[i][k] - rejCorner;
-                    double cornerDist = distVector.x * distVector.x + distVector.y * distVector.y;
-                    currentMaxDistance = max(currentMaxDistance, cornerDist);
-                }
-                // if distance is better than current best distance
-                if(currentMaxDistance < closestCandidateDistance) {
-                    valid = true;
-                    validRot = c;
-                    minDistance = currentMaxDistance;
-                }
-                if(!checkAllOrders) break;
-            }
-
-            if(!valid) continue;
-
-            // apply rotation
-            Mat rotatedMarker;
-            if(checkAllOrders) {
-                rotatedMarker = Mat(4, 1, CV_32FC2);
-                for(int c = 0; c < 4; c++)
-                    rotatedMarker.ptr< Point2f >()[c] =
-                        _rejectedCorners.getMat(j).ptr< Point2f >()[(c + 4 + validRot) % 4];
-            }
-            else rotatedMarker = _rejectedCorners.getMat(j);
-
-            // last filter, check if inner code is close enough to the assigned marker code
-            int codeDistance = 0;
-            // if errorCorrectionRate, dont check code
-            if(errorCorrectionRate >= 0) {
-
-                // extract bits
-                Mat bits = _extractBits(
-                    grey, rotatedMarker, dictionary.markerSize, params.markerBorderBits,
-                    params.perspectiveRemovePixelPerCell,
-                    params.perspectiveRemoveIgnoredMarginPerCell, params.minOtsuStdDev);
-
-                Mat onlyBits =
-                    bits.rowRange(params.markerBorderBits, bits.rows - params.markerBorderBits)
-                        .colRange(params.markerBorderBits, bits.rows - params.markerBorderBits);
-
-                codeDistance =
-                    dictionary.getDistanceToId(onlyBits, undetectedMarkersIds[i], false);
-            }
-
-            // if everythin is ok, assign values to current best match
-            if(errorCorrectionRate < 0 || codeDistance < maxCorrectionRecalculated) {
-                closestCandidateIdx = j;
-                closestCandidateDistance = minDistance;
-                closestRotatedMarker = rotatedMarker;
-            }
+    // the rejected candidates, in a grid of their centers: every corner of a match is less than
+    // minRepDistance away from the projected one, and so is its center (with a margin for the
+    // rounding of the distances), so each missing marker only looks at the candidates around it
+    _CandidateList rejected;
+    for(int j = 0; j < (int)_rejectedCorners.total(); j++)
+        rejected.push_back(_rejectedCorners.getMat(j).ptr< Point2f >(), 0, 0);
+    const float radius = (float)(std::sqrt(minRepDistance * minRepDistance + 1.) * 1.001 + 0.5);
+    _CandidateGrid grid;
+    grid.build(rejected, radius);
+
+    // search of each missing marker, as if no candidate was recovered for another one
+    const int nMissing = (int)undetectedMarkersIds.size();
+    vector< vector< int > > nearCandidates(nMissing);
+    vector< int > recoveredCandidate(nMissing);
+    vector< Point2f > recoveredCorners(4 * (size_t)nMissing);
+    parallel_for_(Range(0, nMissing), [&](const Range &range) {
+        for(int i = range.start; i < range.end; i++) {
+            const Point2f *projected = &undetectedMarkersCorners[i][0];
+            grid.near((projected[0] + projected[1] + projected[2] + projected[3]) * 0.25f, radius, -1,
+                      nearCandidates[i]);
+            recoveredCandidate[i] = _recoverMarker(grey, rejected, nearCandidates[i], 0, projected,
+                                                   undetectedMarkersIds[i], dictionary, params, minRepDistance,
+                                                   errorCorrectionRate, checkAllOrders, &recoveredCorners[4 * i]);
         }
+    });
 
-        // if at least one good match, we have rescue the missing marker
-        if(closestCandidateIdx >= 0) {
+    // a candidate is recovered by the first missing marker that matches it, so a marker near a
+    // candidate already taken is searched again without it, as the markers are searched in order
+    vector< uchar > alreadyIdentified(rejected.size(), 0);
+    vector< int > recoveredMarkers;
+    vector< int > recoveredIdxs; // original indexes of accepted markers in _rejectedCorners
+    for(int i = 0; i < nMissing; i++) {
+        bool nearTaken = false;
+        for(size_t k = 0; k < nearCandidates[i].size() && !nearTaken; k++)
+            nearTaken = alreadyIdentified[nearCandidates[i][k]] != 0;
+        if(nearTaken)
+            recoveredCandidate[i] =
+                _recoverMarker(grey, rejected, nearCandidates[i], alreadyIdentified.data(),
+                               &undetectedMarkersCorners[i][0], undetectedMarkersIds[i], dictionary, params,
+                               minRepDistance, errorCorrectionRate, checkAllOrders, &recoveredCorners[4 * i]);
+        if(recoveredCandidate[i] < 0)
+            continue;
+        alreadyIdentified[recoveredCandidate[i]] = 1;
+        recoveredMarkers.push_back(i);
+        recoveredIdxs.push_back(recoveredCandidate[i]);
+    }
 
-            // subpixel refinement
-            if(_params->cornerRefinementMethod == CORNER_REFINE_SUBPIX) {
-                CV_Assert(params.cornerRefinementWinSize > 0 &&
-                          params.cornerRefinementMaxIterations > 0 &&
-                          params.cornerRefinementMinAccuracy > 0);
-                cornerSubPix(grey, closestRotatedMarker,
+    // subpixel refinement
+    if(_params->cornerRefinementMethod == CORNER_REFINE_SUBPIX && !recoveredMarkers.empty()) {
+        CV_Assert(params.cornerRefinementWinSize > 0 &&
+                  params.cornerRefinementMaxIterations > 0 &&
+                  params.cornerRefinementMinAccuracy > 0);
+        parallel_for_(Range(0, (int)recoveredMarkers.size()), [&](const Range &range) {
+            for(int k = range.start; k < range.end; k++) {
+                cornerSubPix(grey, Mat(4, 1, CV_32FC2, &recoveredCorners[4 * recoveredMarkers[k]]),
                              Size(params.cornerRefinementWinSize, params.cornerRefinementWinSize),
                              Size(-1, -1), TermCriteria(TermCriteria::MAX_ITER | TermCriteria::EPS,
                                                         params.cornerRefinementMaxIterations,
                                                         params.cornerRefinementMinAccuracy));
             }
+        });
+    }
 
-            // remove from rejected
-            alreadyIdentified[closestCandidateIdx] = true;
-
-            // add to detected
-            finalAcceptedCorners.push_back(closestRotatedMarker);
-            finalAcceptedIds.push_back(undetectedMarkersIds[i]);
-
-            // add the original index of the candidate
-            recoveredIdxs.push_back(closestCandidateIdx);
-        }
+    // vector of final detected marker corners and ids
+    vector< Mat > finalAcceptedCorners;
+    vector< int > finalAcceptedIds;
+    // fill with the current markers, then the recovered ones
+    finalAcceptedCorners.resize(_detectedCorners.total());
+    finalAcceptedIds.resize(_detectedIds.total());
+    for(unsigned int i = 0; i < _detectedIds.total(); i++) {
+        finalAcceptedCorners[i] = _detectedCorners.getMat(i).clone();
+        finalAcceptedIds[i] = _detectedIds.getMat().ptr< int >()[i];
+    }
+    for(size_t k = 0; k < recoveredMarkers.size(); k++) {
+        finalAcceptedCorners.push_back(Mat(4, 1, CV_32FC2, &recoveredCorners[4 * recoveredMarkers[k]]));
+        finalAcceptedIds.push_back(undetectedMarkersIds[recoveredMarkers[k]]);
     }
 
     // parse output
@@ -1760,6 +3269,57 @@ double calibrateCameraAruco(InputArrayOfArrays _corners, InputArray _ids, InputA
 }
 
 
+namespace internal {
+
+/**
+ */
+void thresholdMultiScale(const Mat &grey, const vector< int > &winSizes, double constant,
+                         vector< Mat > &thresholds) {
+    TLSData< _ThresholdScratch > scratch;
+    _thresholdMultiScale(grey, winSizes, constant, 255, thresholds, scratch);
+}
+
+
+/**
+ */
+void approxClosedContour(const vector< Point > &contour, double eps, vector< Point > &approx) {
+    vector< Range > stack;
+    _approxClosedContour(contour.data(), (int)contour.size(), eps, approx, stack);
+}
+
+
+/**
+ */
+void traceMarkerContours(const Mat &binary, double minPerimeterRate, double maxPerimeterRate,
+                         double accuracyRate, double minCornerDistanceRate, int minDistanceToBorder,
+                         vector< vector< Point2f > > &candidates, vector< vector< Point > > &contours) {
+    CV_Assert(binary.type() == CV_8UC1 && !binary.empty());
+    _ContourArena arena;
+    arena.create(binary.size());
+    Mat interior = arena.interior();
+    cv::min(binary, 1, interior);
+    _traceMarkerContours(arena, minPerimeterRate, maxPerimeterRate, accuracyRate, minCornerDistanceRate,
+                         minDistanceToBorder);
+
+    // in the order of findContours, as _detectInitialCandidates joins them
+    candidates.clear();
+    contours.clear();
+    for(int i = arena.found.size() - 1; i >= 0; i--) {
+        candidates.push_back(vector< Point2f >(arena.found.candidate(i), arena.found.candidate(i) + 4));
+        contours.push_back(vector< Point >(arena.found.contour(i),
+                                           arena.found.contour(i) + arena.found.contourSize(i)));
+    }
+}
+
+
+/**
+ */
+void extractBits(const Mat &image, const vector< Point2f > &corners, int markerSize, int markerBorderBits,
+                 int cellSize, double cellMarginRate, double minStdDevOtsu, Mat &bits) {
+    _extractBits(image, corners, markerSize, markerBorderBits, cellSize, cellMarginRate, minStdDevOtsu, bits);
+}
+
+} // namespace internal
 
 }
 }
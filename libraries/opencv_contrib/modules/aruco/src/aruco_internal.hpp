@@ -0,0 +1,51 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+
+#ifndef __OPENCV_ARUCO_INTERNAL_HPP__
+#define __OPENCV_ARUCO_INTERNAL_HPP__
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+namespace cv {
+namespace aruco {
+namespace internal {
+
+/**
+ * Steps of the marker detection that replace a library call with an equivalent of their own,
+ * exported so that the tests can compare them with the call they replace.
+ */
+
+/** @brief Thresholds of grey for each window size, as adaptiveThreshold with
+ * ADAPTIVE_THRESH_MEAN_C and THRESH_BINARY_INV computes them (foreground 255) */
+CV_EXPORTS void thresholdMultiScale(const Mat &grey, const std::vector<int> &winSizes, double constant,
+                                    std::vector<Mat> &thresholds);
+
+/** @brief Polygonal approximation of a closed contour, as approxPolyDP with closed = true */
+CV_EXPORTS void approxClosedContour(const std::vector<Point> &contour, double eps, std::vector<Point> &approx);
+
+/** @brief Candidates traced on a binary image (foreground non zero) with their contours, as
+ * findContours (RETR_LIST, CHAIN_APPROX_NONE) followed by the perimeter and shape checks of the
+ * detection lists them */
+CV_EXPORTS void traceMarkerContours(const Mat &binary, double minPerimeterRate, double maxPerimeterRate,
+                                    double accuracyRate, double minCornerDistanceRate,
+                                    int minDistanceToBorder,
+                                    std::vector< std::vector<Point2f> > &candidates,
+                                    std::vector< std::vector<Point> > &contours);
+
+/** @brief Bits of the candidate with the given corners, borders included, as warping the marker with
+ * warpPerspective (INTER_NEAREST), then thresholding it with Otsu and counting each cell gives them */
+CV_EXPORTS void extractBits(const Mat &image, const std::vector<Point2f> &corners, int markerSize,
+                            int markerBorderBits, int cellSize, double cellMarginRate, double minStdDevOtsu,
+                            Mat &bits);
+
+/** @brief AprilTag edge image of grey, written with the step of grey: 127 on the tiles with less than
+ * minWhiteBlackDiff of contrast around them, otherwise 255 above the mid-range of the tiles and 0 */
+CV_EXPORTS void aprilTagThreshold(const Mat &grey, int minWhiteBlackDiff, Mat &thresh);
+
+} // namespace internal
+} // namespace aruco
+} // namespace cv
+
+#endif
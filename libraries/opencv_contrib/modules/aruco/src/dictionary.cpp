@@ -43,6 +43,7 @@ the use of this software, even if advised of the possibility of such damage.
 #include "predefined_dictionaries.hpp"
 #include "predefined_dictionaries_apriltag.hpp"
 #include "opencv2/core/hal/hal.hpp"
+#include "opencv2/core/hal/intrin.hpp"
 
 namespace cv {
 namespace aruco {
@@ -50,12 +51,337 @@ namespace aruco {
 using namespace std;
 
 
+static inline int _hammingDistance(uint64 a, uint64 b) {
+#if defined __GNUC__
+    return __builtin_popcountll(a ^ b);
+#else
+    uint64 x = a ^ b;
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+
+/**
+ * @brief Packed codes of a dictionary of up to 8x8 bits, and Hamming search tables over them
+ *
+ * Every rotation of every marker is packed in a 64 bit code, byte j of the byte list in bits
+ * 8j to 8j+7, so the Hamming distance of two codes is the one of their byte lists. The codes
+ * are stored rotation after rotation (codes[r * nMarkers + m]), so that the candidate is
+ * compared with several markers at once with SIMD popcounts.
+ *
+ * When that still is a lot of codes, the bits of the marker are also split into
+ * maxCorrectionBits + 1 disjoint chunks, with a table per chunk of the codes sorted by their
+ * bits in that chunk. A code within a distance d of the candidate differs from it in at most d
+ * chunks, so it equals the candidate in one of any d + 1 chunks, and only the codes found in
+ * those d + 1 tables need to be compared.
+ */
+class MarkerCodeIndex {
+public:
+    explicit MarkerCodeIndex(const Dictionary &dictionary)
+        : bytesList(dictionary.bytesList), markerSize(dictionary.markerSize),
+          maxCorrectionBits(dictionary.maxCorrectionBits), nMarkers(0) {
+
+        const int nbits = markerSize * markerSize;
+        const int nbytes = (nbits + 7) / 8;
+        if(markerSize <= 0 || nbits > 64 || bytesList.rows == 0 || maxCorrectionBits < 0 ||
+           bytesList.type() != CV_8UC4 || bytesList.cols != nbytes)
+            return; // left empty, identify falls back to the byte list scan
+
+        nMarkers = bytesList.rows;
+        packedBytes = bytesList.clone();
+        codes.resize((size_t)nMarkers * 4);
+        for(int m = 0; m < nMarkers; m++) {
+            const uchar *bytes = bytesList.ptr(m);
+            for(int r = 0; r < 4; r++)
+                codes[r * nMarkers + m] = pack(bytes + r * nbytes, nbytes);
+        }
+
+        // positions of the marker bits in the codes, the last byte only holds the last bits
+        vector< int > positions;
+        for(int i = 0; i < nbits; i++) {
+            int byte = i / 8;
+            int bitsInByte = min(8, nbits - byte * 8);
+            positions.push_back(byte * 8 + bitsInByte - 1 - i % 8);
+        }
+
+        const int nChunks = min(maxCorrectionBits + 1, nbits);
+        masks.assign(nChunks, 0);
+        tables.resize(nChunks);
+        // estimated cost of searching the first c tables, in codes compared by the scan
+        tablesCost.assign(nChunks + 1, 0.);
+        for(int c = 0; c < nChunks; c++) {
+            for(int i = c * nbits / nChunks; i < (c + 1) * nbits / nChunks; i++)
+                masks[c] |= (uint64)1 << positions[i];
+            tables[c].resize(codes.size());
+            for(size_t e = 0; e < codes.size(); e++)
+                tables[c][e] = make_pair(codes[e] & masks[c], (int)(e % nMarkers));
+            std::sort(tables[c].begin(), tables[c].end());
+
+            // a binary search, then a scattered read per code with the candidate's key, for a
+            // candidate that is one of the markers
+            double probes = 0;
+            for(size_t e = 0, next; e < tables[c].size(); e = next) {
+                for(next = e + 1; next < tables[c].size() && tables[c][next].first == tables[c][e].first; next++)
+                    ;
+                probes += double(next - e) * (next - e) / tables[c].size();
+            }
+            tablesCost[c + 1] = tablesCost[c] + TABLE_SEARCH_COST + probes * TABLE_PROBE_COST;
+        }
+    }
+
+    /**
+     * @brief Whether the codes were packed from the current byte list of the dictionary. Only the
+     * buffer and the shape are compared, so that the check does not depend on the dictionary size:
+     * a new byte list assigned to bytesList is seen, an edit of its bytes in place is not.
+     */
+    bool matches(const Dictionary &dictionary) const {
+        const Mat &current = dictionary.bytesList;
+        return current.data == bytesList.data && current.u == bytesList.u &&
+               current.rows == bytesList.rows && current.cols == bytesList.cols &&
+               current.type() == bytesList.type() && current.step[0] == bytesList.step[0] &&
+               markerSize == dictionary.markerSize && maxCorrectionBits == dictionary.maxCorrectionBits;
+    }
+
+    /**
+     * @brief Whether the byte list of the dictionary still holds the bytes the codes were packed
+     * from. bytesList is public and can be edited in place, which matches() does not see, so every
+     * byte is compared: once for a batch of candidates, that is much less than identifying them.
+     */
+    bool matchesContent(const Dictionary &dictionary) const {
+        if(!matches(dictionary))
+            return false;
+        const size_t rowBytes = packedBytes.cols * packedBytes.elemSize();
+        for(int m = 0; m < packedBytes.rows; m++) {
+            if(memcmp(bytesList.ptr(m), packedBytes.ptr(m), rowBytes) != 0)
+                return false;
+        }
+        return true;
+    }
+
+    /** @brief Whether the dictionary fits in packed codes */
+    bool packed() const {
+        return nMarkers > 0;
+    }
+
+    /**
+     * @brief Same result as the byte list scan of Dictionary::identify: the first marker with a
+     * rotation within maxCorrection of the candidate, and its first closest rotation
+     */
+    bool identify(const Mat &onlyBits, int maxCorrection, int &idx, int &rotation) const {
+        CV_DbgAssert(packed() && maxCorrection >= 0);
+
+        // byte list of the candidate as getByteListFromBits computes it, without rotations
+        uchar bytes[8] = { 0 };
+        int bit = 0;
+        for(int row = 0; row < onlyBits.rows; row++) {
+            const uchar *bits = onlyBits.ptr(row);
+            for(int col = 0; col < onlyBits.cols; col++, bit++)
+                bytes[bit / 8] = (uchar)((bytes[bit / 8] << 1) | bits[col]);
+        }
+        const uint64 code = pack(bytes, (bit + 7) / 8);
+
+        if(maxCorrection < (int)tables.size() && tablesCost[maxCorrection + 1] < (double)codes.size())
+            idx = lookup(code, maxCorrection);
+        else
+            idx = scan(code, maxCorrection);
+        if(idx < 0)
+            return false;
+
+        int minDistance = markerSize * markerSize + 1;
+        for(int r = 0; r < 4; r++) {
+            int distance = _hammingDistance(code, codes[r * nMarkers + idx]);
+            if(distance < minDistance) {
+                minDistance = distance;
+                rotation = r;
+            }
+        }
+        return true;
+    }
+
+private:
+    enum { TABLE_SEARCH_COST = 64, TABLE_PROBE_COST = 8 };
+
+    static uint64 pack(const uchar *bytes, int nbytes) {
+        uint64 code = 0;
+        for(int j = 0; j < nbytes; j++)
+            code |= (uint64)bytes[j] << (8 * j);
+        return code;
+    }
+
+    /** @brief First marker within maxCorrection of code, comparing it with every code */
+    int scan(uint64 code, int maxCorrection) const {
+        int m = 0;
+#if CV_SIMD
+        const int lanes = v_uint64::nlanes;
+        const v_uint64 vcode = vx_setall_u64(code);
+        const v_uint32 vmaxCorrection = vx_setall_u32((unsigned)maxCorrection);
+        for(; m <= nMarkers - 2 * lanes; m += 2 * lanes) {
+            v_uint32 within = vx_setzero_u32();
+            for(int r = 0; r < 4; r++) {
+                const uint64 *rotationCodes = &codes[r * nMarkers + m];
+                v_uint32 distance = v_pack(v_popcount(vx_load(rotationCodes) ^ vcode),
+                                           v_popcount(vx_load(rotationCodes + lanes) ^ vcode));
+                within = within | (distance <= vmaxCorrection);
+            }
+            if(v_check_any(within))
+                return m + v_scan_forward(within);
+        }
+#endif
+        for(; m < nMarkers; m++) {
+            for(int r = 0; r < 4; r++) {
+                if(_hammingDistance(code, codes[r * nMarkers + m]) <= maxCorrection)
+                    return m;
+            }
+        }
+        return -1;
+    }
+
+    /** @brief First marker within maxCorrection of code, comparing only the codes in the tables */
+    int lookup(uint64 code, int maxCorrection) const {
+        int idx = -1;
+        for(int c = 0; c <= maxCorrection; c++) {
+            vector< pair< uint64, int > >::const_iterator it =
+                std::lower_bound(tables[c].begin(), tables[c].end(),
+                                 make_pair(code & masks[c], -1));
+            for(; it != tables[c].end() && it->first == (code & masks[c]); ++it) {
+                int m = it->second;
+                if(idx >= 0 && m >= idx)
+                    break; // entries of a key are sorted by marker
+                for(int r = 0; r < 4; r++) {
+                    if(_hammingDistance(code, codes[r * nMarkers + m]) <= maxCorrection) {
+                        idx = m;
+                        break;
+                    }
+                }
+            }
+        }
+        return idx;
+    }
+
+    // what the codes were packed from, held so that its buffer is not reused by another byte list
+    Mat bytesList;
+    int markerSize, maxCorrectionBits;
+    Mat packedBytes; // copy of the bytes of bytesList when they were packed, empty if not packed
+
+    int nMarkers;
+    vector< uint64 > codes; // codes[r * nMarkers + m] is marker m in rotation r
+    vector< uint64 > masks; // bits of each chunk
+    vector< vector< pair< uint64, int > > > tables; // (chunk bits, marker), sorted
+    vector< double > tablesCost;
+};
+
+
+/**
+ * @brief Dictionary::identify comparing the byte list of the candidate with every marker
+ */
+static bool _identifyByteList(const Dictionary &dictionary, const Mat &onlyBits,
+                              int maxCorrection, int &idx, int &rotation) {
+
+    // get as a byte list
+    Mat candidateBytes = Dictionary::getByteListFromBits(onlyBits);
+
+    idx = -1; // by default, not found
+
+    // search closest marker in dict
+    for(int m = 0; m < dictionary.bytesList.rows; m++) {
+        int currentMinDistance = dictionary.markerSize * dictionary.markerSize + 1;
+        int currentRotation = -1;
+        for(unsigned int r = 0; r < 4; r++) {
+            int currentHamming = cv::hal::normHamming(
+                    dictionary.bytesList.ptr(m)+r*candidateBytes.cols,
+                    candidateBytes.ptr(),
+                    candidateBytes.cols);
+
+            if(currentHamming < currentMinDistance) {
+                currentMinDistance = currentHamming;
+                currentRotation = r;
+            }
+        }
+
+        // if maxCorrection is fulfilled, return this one
+        if(currentMinDistance <= maxCorrection) {
+            idx = m;
+            rotation = currentRotation;
+            break;
+        }
+    }
+
+    return idx != -1;
+}
+
+
+/**
+ * @brief Holder of the tables of a dictionary, rebuilt when its bytesList changes. Each dictionary
+ * has its own, so that copies given other byte lists do not rebuild each other's tables.
+ */
+struct Dictionary::Index {
+    /**
+     * @brief Tables of the current byte list of dictionary. With checkContent, bytes edited in
+     * place since the tables were built are found too, at a cost linear in the dictionary size.
+     */
+    Ptr< MarkerCodeIndex > get(const Dictionary &dictionary, bool checkContent = false) {
+        Ptr< MarkerCodeIndex > current;
+        {
+            AutoLock lock(mutex);
+            current = tables;
+        }
+        // compared and built without the lock, identify runs from several threads at once
+        if(!current || !(checkContent ? current->matchesContent(dictionary) : current->matches(dictionary))) {
+            current = makePtr< MarkerCodeIndex >(dictionary);
+            AutoLock lock(mutex);
+            tables = current;
+        }
+        return current;
+    }
+
+    /**
+     * @brief Index of a copy of dictionary, starting with the tables of dictionary (built now if
+     * they were not yet) so that the copies of a predefined dictionary share them
+     */
+    static Ptr< Index > copy(const Dictionary &dictionary) {
+        Ptr< Index > copied = makePtr< Index >();
+        if(dictionary.index)
+            copied->tables = dictionary.index->get(dictionary);
+        return copied;
+    }
+
+    Mutex mutex;
+    Ptr< MarkerCodeIndex > tables;
+};
+
+
+/**
+  */
+Dictionary::Dictionary(const Dictionary &_dictionary)
+    : bytesList(_dictionary.bytesList), markerSize(_dictionary.markerSize),
+      maxCorrectionBits(_dictionary.maxCorrectionBits) {
+    index = Index::copy(_dictionary);
+}
+
+
+/**
+  */
+Dictionary &Dictionary::operator=(const Dictionary &_dictionary) {
+    if(this != &_dictionary) {
+        bytesList = _dictionary.bytesList;
+        markerSize = _dictionary.markerSize;
+        maxCorrectionBits = _dictionary.maxCorrectionBits;
+        index = Index::copy(_dictionary);
+    }
+    return *this;
+}
+
+
 /**
   */
 Dictionary::Dictionary(const Ptr<Dictionary> &_dictionary) {
     markerSize = _dictionary->markerSize;
     maxCorrectionBits = _dictionary->maxCorrectionBits;
     bytesList = _dictionary->bytesList.clone();
+    index = makePtr<Index>();
 }
 
 
@@ -65,6 +391,7 @@ Dictionary::Dictionary(const Mat &_bytesList, int _markerSize, int _maxcorr) {
     markerSize = _markerSize;
     maxCorrectionBits = _maxcorr;
     bytesList = _bytesList;
+    index = makePtr<Index>();
 }
 
 
@@ -101,36 +428,41 @@ bool Dictionary::identify(const Mat &onlyBits, int &idx, int &rotation,
 
     int maxCorrectionRecalculed = int(double(maxCorrectionBits) * maxCorrectionRate);
 
-    // get as a byte list
-    Mat candidateBytes = getByteListFromBits(onlyBits);
+    if(index) {
+        Ptr< MarkerCodeIndex > codeIndex = index->get(*this);
+        if(codeIndex->packed() && maxCorrectionRecalculed >= 0)
+            return codeIndex->identify(onlyBits, maxCorrectionRecalculed, idx, rotation);
+    }
+    return _identifyByteList(*this, onlyBits, maxCorrectionRecalculed, idx, rotation);
+}
 
-    idx = -1; // by default, not found
 
-    // search closest marker in dict
-    for(int m = 0; m < bytesList.rows; m++) {
-        int currentMinDistance = markerSize * markerSize + 1;
-        int currentRotation = -1;
-        for(unsigned int r = 0; r < 4; r++) {
-            int currentHamming = cv::hal::normHamming(
-                    bytesList.ptr(m)+r*candidateBytes.cols,
-                    candidateBytes.ptr(),
-                    candidateBytes.cols);
+/**
+  */
+void Dictionary::identify(const vector< Mat > &onlyBits, vector< int > &idx,
+                          vector< int > &rotation, double maxCorrectionRate) const {
 
-            if(currentHamming < currentMinDistance) {
-                currentMinDistance = currentHamming;
-                currentRotation = r;
-            }
-        }
+    int maxCorrectionRecalculed = int(double(maxCorrectionBits) * maxCorrectionRate);
 
-        // if maxCorrection is fulfilled, return this one
-        if(currentMinDistance <= maxCorrectionRecalculed) {
-            idx = m;
-            rotation = currentRotation;
-            break;
-        }
+    // bytesList is compared with the tables byte by byte, once for the whole batch
+    Ptr< MarkerCodeIndex > codeIndex;
+    if(index && maxCorrectionRecalculed >= 0) {
+        codeIndex = index->get(*this, true);
+        if(!codeIndex->packed())
+            codeIndex.release();
     }
 
-    return idx != -1;
+    idx.assign(onlyBits.size(), -1);
+    rotation.assign(onlyBits.size(), 0);
+    for(size_t i = 0; i < onlyBits.size(); i++) {
+        if(onlyBits[i].empty())
+            continue;
+        CV_Assert(onlyBits[i].rows == markerSize && onlyBits[i].cols == markerSize);
+        if(codeIndex)
+            codeIndex->identify(onlyBits[i], maxCorrectionRecalculed, idx[i], rotation[i]);
+        else
+            _identifyByteList(*this, onlyBits[i], maxCorrectionRecalculed, idx[i], rotation[i]);
+    }
 }
 
 
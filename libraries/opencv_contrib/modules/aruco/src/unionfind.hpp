@@ -35,14 +35,26 @@ struct ufrec{
     uint32_t size;
 };
 
-static inline unionfind_t *unionfind_create(uint32_t maxid){
+// allocates the nodes without making them sets yet, so that threads can
+// each initialize their own part with unionfind_reset.
+static inline unionfind_t *unionfind_alloc(uint32_t maxid){
     unionfind_t *uf = (unionfind_t*) calloc(1, sizeof(unionfind_t));
     uf->maxid = maxid;
     uf->data = (struct ufrec*) malloc((maxid+1) * sizeof(struct ufrec));
-    for (unsigned int i = 0; i <= maxid; i++) {
+    return uf;
+}
+
+// makes each of the ids in [begin, end) a set of its own.
+static inline void unionfind_reset(unionfind_t *uf, uint32_t begin, uint32_t end){
+    for (uint32_t i = begin; i < end; i++) {
         uf->data[i].size = 1;
         uf->data[i].parent = i;
     }
+}
+
+static inline unionfind_t *unionfind_create(uint32_t maxid){
+    unionfind_t *uf = unionfind_alloc(maxid);
+    unionfind_reset(uf, 0, maxid + 1);
     return uf;
 }
 
@@ -104,28 +116,18 @@ static inline uint32_t unionfind_connect(unionfind_t *uf, uint32_t aid, uint32_t
     if (aroot == broot)
         return aroot;
 
-    // we don't perform "union by rank", but we perform a similar
-    // operation (but probably without the same asymptotic guarantee):
-    // We join trees based on the number of *elements* (as opposed to
-    // rank) contained within each tree. I.e., we use size as a proxy
-    // for rank.  In my testing, it's often *faster* to use size than
-    // rank, perhaps because the rank of the tree isn't that critical
-    // if there are very few nodes in it.
-    uint32_t asize = uf->data[aroot].size;
-    uint32_t bsize = uf->data[broot].size;
-
-    // optimization idea: We could shortcut some or all of the tree
-    // that is grafted onto the other tree. Pro: those nodes were just
-    // read and so are probably in cache. Con: it might end up being
-    // wasted effort -- the tree might be grafted onto another tree in
-    // a moment!
-    if (asize > bsize) {
+    // the tree with the larger root is grafted onto the other one, so
+    // the root of a set is always its smallest id. The representatives
+    // then do not depend on the order the sets were joined in, e.g. on
+    // how an image was split between threads. Path compression in
+    // unionfind_get_representative keeps the trees shallow.
+    if (aroot < broot) {
         uf->data[broot].parent = aroot;
-        uf->data[aroot].size += bsize;
+        uf->data[aroot].size += uf->data[broot].size;
         return aroot;
     } else {
         uf->data[aroot].parent = broot;
-        uf->data[broot].size += asize;
+        uf->data[broot].size += uf->data[aroot].size;
         return broot;
     }
 }
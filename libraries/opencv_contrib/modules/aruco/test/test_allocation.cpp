@@ -0,0 +1,83 @@
+// This file is part of OpenCV project.
+// It is subject to the license terms in the LICENSE file found in the top-level directory
+// of this distribution and at http://opencv.org/license.html.
+
+#include "test_precomp.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// The replaceable allocation functions of the test binary, in a translation unit of their own so
+// that the compiler never sees them next to the allocations they serve. They are plain malloc and
+// free for every test, and only count the allocations between startCountingAllocations and
+// stopCountingAllocations. The libraries the binary loads allocate through them too, except on
+// Windows where each DLL keeps its own operator new.
+
+static std::atomic<bool> countAllocations(false);
+static std::atomic<int> allocationCount(0);
+
+static void *allocate(std::size_t size) CV_NOEXCEPT {
+    if(countAllocations)
+        allocationCount++;
+    return std::malloc(size ? size : 1);
+}
+
+void *operator new(std::size_t size) {
+    if(void *ptr = allocate(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    if(void *ptr = allocate(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) CV_NOEXCEPT {
+    return allocate(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) CV_NOEXCEPT {
+    return allocate(size);
+}
+
+void operator delete(void *ptr) CV_NOEXCEPT {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) CV_NOEXCEPT {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) CV_NOEXCEPT {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) CV_NOEXCEPT {
+    std::free(ptr);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void *ptr, std::size_t) CV_NOEXCEPT {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) CV_NOEXCEPT {
+    std::free(ptr);
+}
+#endif
+
+namespace opencv_test {
+
+void startCountingAllocations() {
+    allocationCount = 0;
+    countAllocations = true;
+}
+
+int stopCountingAllocations() {
+    countAllocations = false;
+    return allocationCount;
+}
+
+} // namespace
@@ -554,4 +554,313 @@ TEST(CV_ArucoBitCorrection, algorithmic) {
     test.safe_run();
 }
 
+TEST(CV_ArucoDetectionRegions, sameAsFullImage) {
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+    const int markerSidePixels = 80;
+    const int cells = 4;
+    Mat img(cells * 2 * markerSidePixels, cells * 2 * markerSidePixels, CV_8UC1, Scalar::all(255));
+    vector< Rect > markerRects;
+    for(int i = 0; i < cells * cells; i++) {
+        Mat marker;
+        aruco::drawMarker(dictionary, i, markerSidePixels, marker);
+        Rect rect((i % cells) * 2 * markerSidePixels + markerSidePixels / 2,
+                  (i / cells) * 2 * markerSidePixels + markerSidePixels / 2, markerSidePixels, markerSidePixels);
+        marker.copyTo(img(rect));
+        markerRects.push_back(rect);
+    }
+
+    for(int method = 0; method < 2; method++) {
+        for(int color = 0; color < 2; color++) {
+            Mat image = img;
+            if(color)
+                cvtColor(img, image, COLOR_GRAY2BGR);
+            Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+            params->cornerRefinementMethod = method ? aruco::CORNER_REFINE_SUBPIX : aruco::CORNER_REFINE_NONE;
+
+            vector< vector< Point2f > > corners, regionCorners;
+            vector< int > ids, regionIds;
+            aruco::detectMarkers(image, dictionary, corners, ids, params);
+            ASSERT_EQ((size_t)(cells * cells), ids.size());
+
+            // markers 0 and 1 share a merged region, 5 has its own, 15 is cut off at the border
+            vector< Rect > regions;
+            regions.push_back(Rect(markerRects[0].tl() - Point(20, 20), markerRects[0].br() + Point(90, 20)));
+            regions.push_back(Rect(markerRects[1].tl() - Point(20, 20), markerRects[1].br() + Point(20, 20)));
+            regions.push_back(Rect(markerRects[5].tl() - Point(20, 20), markerRects[5].br() + Point(20, 20)));
+            regions.push_back(Rect(markerRects[15].tl() - Point(20, 20), Size(1000, 1000)));
+            aruco::detectMarkers(image, dictionary, regionCorners, regionIds, regions, params);
+
+            ASSERT_EQ(4u, regionIds.size());
+            for(size_t i = 0; i < regionIds.size(); i++) {
+                size_t k = std::find(ids.begin(), ids.end(), regionIds[i]) - ids.begin();
+                ASSERT_LT(k, ids.size());
+                EXPECT_TRUE(regionIds[i] == 0 || regionIds[i] == 1 || regionIds[i] == 5 || regionIds[i] == 15);
+                for(int c = 0; c < 4; c++)
+                    EXPECT_LE(cv::norm(corners[k][c] - regionCorners[i][c]), 1e-4);
+            }
+        }
+    }
+}
+
+TEST(CV_ArucoDetectionDecimate, groundTruth) {
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+
+    // rotated markers on a noisy 720p image, with the position of their corners
+    const int nMarkers = 12, markerSidePixels = 100, margin = 20;
+    Mat img(720, 1280, CV_8UC1, Scalar::all(200));
+    vector< vector< Point2f > > groundTruthCorners;
+    for(int i = 0; i < nMarkers; i++) {
+        Mat marker;
+        aruco::drawMarker(dictionary, i, markerSidePixels, marker);
+        cv::copyMakeBorder(marker, marker, margin, margin, margin, margin, BORDER_CONSTANT, Scalar::all(255));
+        Point2f center(180.f + 300.f * (i % 4), 130.f + 230.f * (i / 4));
+        Mat transform = getRotationMatrix2D(Point2f((marker.cols - 1) / 2.f, (marker.rows - 1) / 2.f),
+                                            7. + 23. * i, 1.);
+        transform.at< double >(0, 2) += center.x - (marker.cols - 1) / 2.;
+        transform.at< double >(1, 2) += center.y - (marker.rows - 1) / 2.;
+        warpAffine(marker, img, transform, img.size(), INTER_LINEAR, BORDER_TRANSPARENT);
+
+        // the outer edges of the marker pixels
+        const float first = margin - 0.5f, last = margin + markerSidePixels - 0.5f;
+        vector< Point2f > corners;
+        corners.push_back(Point2f(first, first));
+        corners.push_back(Point2f(last, first));
+        corners.push_back(Point2f(last, last));
+        corners.push_back(Point2f(first, last));
+        cv::transform(corners, corners, transform);
+        groundTruthCorners.push_back(corners);
+    }
+    Mat noise(img.size(), CV_16SC1);
+    RNG rng(0x2d2d);
+    rng.fill(noise, RNG::NORMAL, 0, 3);
+    cv::add(img, noise, img, noArray(), CV_8U);
+
+    Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+    params->candidateDecimate = 2.f;
+    vector< vector< Point2f > > corners;
+    vector< int > ids;
+    aruco::detectMarkers(img, dictionary, corners, ids, params);
+
+    // the candidates are found at half resolution, then refined on the full image
+    ASSERT_EQ((size_t)nMarkers, ids.size());
+    for(size_t k = 0; k < ids.size(); k++) {
+        ASSERT_GE(ids[k], 0);
+        ASSERT_LT(ids[k], nMarkers);
+        for(int c = 0; c < 4; c++)
+            EXPECT_LE(cv::norm(corners[k][c] - groundTruthCorners[ids[k]][c]), 0.5)
+                << "id " << ids[k] << " corner " << c;
+    }
+
+    // CORNER_REFINE_CONTOUR would fit lines to contours found at half resolution, so it is
+    // skipped and the corners are the ones of CORNER_REFINE_NONE
+    params->cornerRefinementMethod = aruco::CORNER_REFINE_CONTOUR;
+    vector< vector< Point2f > > contourCorners;
+    vector< int > contourIds;
+    aruco::detectMarkers(img, dictionary, contourCorners, contourIds, params);
+    ASSERT_EQ(ids, contourIds);
+    for(size_t k = 0; k < ids.size(); k++)
+        EXPECT_EQ(corners[k], contourCorners[k]) << "id " << ids[k];
+}
+
+static bool lessCorners(const vector< Point2f > &a, const vector< Point2f > &b) {
+    for(size_t c = 0; c < a.size() && c < b.size(); c++) {
+        if(a[c].x != b[c].x)
+            return a[c].x < b[c].x;
+        if(a[c].y != b[c].y)
+            return a[c].y < b[c].y;
+    }
+    return a.size() < b.size();
+}
+
+TEST(CV_AprilTagDetection, sameForAnyThreadCount) {
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_APRILTAG_36h11);
+
+    // rotated markers among dark blobs, so that the components and quads span the stripes of rows
+    const int nMarkers = 12, markerSidePixels = 90;
+    Mat img(720, 1280, CV_8UC1, Scalar::all(190));
+    RNG rng(0x36b1);
+    for(int k = 0; k < 40; k++)
+        cv::circle(img, Point(rng.uniform(0, img.cols), rng.uniform(0, img.rows)), rng.uniform(3, 40),
+                   Scalar::all(rng.uniform(0, 120)), FILLED);
+    for(int i = 0; i < nMarkers; i++) {
+        Mat marker;
+        aruco::drawMarker(dictionary, 3 * i, markerSidePixels, marker);
+        cv::copyMakeBorder(marker, marker, 15, 15, 15, 15, BORDER_CONSTANT, Scalar::all(255));
+        Point2f center(170.f + 310.f * (i % 4), 120.f + 240.f * (i / 4));
+        Mat transform = getRotationMatrix2D(Point2f(marker.cols / 2.f, marker.rows / 2.f), 11. + 29. * i, 1.);
+        transform.at< double >(0, 2) += center.x - marker.cols / 2.;
+        transform.at< double >(1, 2) += center.y - marker.rows / 2.;
+        warpAffine(marker, img, transform, img.size(), INTER_LINEAR, BORDER_TRANSPARENT);
+    }
+    Mat noise(img.size(), CV_16SC1);
+    rng.fill(noise, RNG::NORMAL, 0, 3);
+    cv::add(img, noise, img, noArray(), CV_8U);
+
+    const int nThreads = getNumThreads();
+    const int threadCounts[] = { 1, 2, 3, 8 };
+    for(int decimate = 1; decimate <= 2; decimate++) {
+        Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+        params->cornerRefinementMethod = aruco::CORNER_REFINE_APRILTAG;
+        params->aprilTagQuadDecimate = (float)decimate;
+
+        // the markers sorted by id and the rejected candidates by their corners, the order of
+        // the quads depends on how the parallel loops were split
+        vector< vector< Point2f > > expectedCorners, expectedRejected;
+        vector< int > expectedIds;
+        for(size_t t = 0; t < sizeof(threadCounts) / sizeof(threadCounts[0]); t++) {
+            setNumThreads(threadCounts[t]);
+            vector< vector< Point2f > > corners, rejected;
+            vector< int > ids;
+            aruco::detectMarkers(img, dictionary, corners, ids, params, rejected);
+
+            vector< int > order(ids.size());
+            for(size_t k = 0; k < order.size(); k++)
+                order[k] = (int)k;
+            std::sort(order.begin(), order.end(), [&](int a, int b) { return ids[a] < ids[b]; });
+            vector< vector< Point2f > > sortedCorners;
+            vector< int > sortedIds;
+            for(size_t k = 0; k < order.size(); k++) {
+                sortedIds.push_back(ids[order[k]]);
+                sortedCorners.push_back(corners[order[k]]);
+            }
+            std::sort(rejected.begin(), rejected.end(), lessCorners);
+
+            if(t == 0) {
+                ASSERT_EQ((size_t)nMarkers, sortedIds.size()) << "decimate " << decimate;
+                expectedIds = sortedIds;
+                expectedCorners = sortedCorners;
+                expectedRejected = rejected;
+                continue;
+            }
+            EXPECT_EQ(expectedIds, sortedIds) << "decimate " << decimate << " threads " << threadCounts[t];
+            EXPECT_EQ(expectedCorners, sortedCorners) << "decimate " << decimate << " threads " << threadCounts[t];
+            EXPECT_EQ(expectedRejected, rejected) << "decimate " << decimate << " threads " << threadCounts[t];
+        }
+    }
+    setNumThreads(nThreads);
+}
+
+TEST(CV_ArucoDetector, noAllocationAfterWarmUp) {
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+
+    // frames of a video, the same markers moving a little from one frame to the next
+    const int nFrames = 4, nMarkers = 12, markerSidePixels = 60;
+    vector< Mat > frames;
+    RNG rng(0x5678);
+    for(int f = 0; f < nFrames; f++) {
+        Mat frame(480, 640, CV_8UC1, Scalar::all(200));
+        for(int i = 0; i < nMarkers; i++) {
+            Mat marker;
+            aruco::drawMarker(dictionary, i, markerSidePixels, marker);
+            cv::copyMakeBorder(marker, marker, 15, 15, 15, 15, BORDER_CONSTANT, Scalar::all(255));
+            Point2f center(100.f + 150.f * (i % 4) + 3.f * f, 90.f + 150.f * (i / 4) + 2.f * f);
+            Mat transform = getRotationMatrix2D(Point2f(marker.cols / 2.f, marker.rows / 2.f),
+                                                10. * f + 5. * i, 1.);
+            transform.at< double >(0, 2) += center.x - marker.cols / 2.;
+            transform.at< double >(1, 2) += center.y - marker.rows / 2.;
+            warpAffine(marker, frame, transform, frame.size(), INTER_LINEAR, BORDER_TRANSPARENT);
+        }
+        Mat noise(frame.size(), CV_16SC1);
+        rng.fill(noise, RNG::NORMAL, 0, 4);
+        cv::add(frame, noise, frame, noArray(), CV_8U);
+        frames.push_back(frame);
+    }
+
+    for(int color = 0; color < 2; color++) {
+        if(color) {
+            for(int f = 0; f < nFrames; f++)
+                cvtColor(frames[f], frames[f], COLOR_GRAY2BGR);
+        }
+        Ptr<aruco::ArucoDetector> detector = aruco::ArucoDetector::create(dictionary);
+        vector< vector< vector< Point2f > > > expectedCorners(nFrames);
+        vector< vector< int > > expectedIds(nFrames);
+        for(int f = 0; f < nFrames; f++) {
+            aruco::detectMarkers(frames[f], dictionary, expectedCorners[f], expectedIds[f], detector->parameters);
+            ASSERT_EQ((size_t)nMarkers, expectedIds[f].size());
+        }
+
+        // the thread pool allocates for each parallel loop, so the loops run on this thread
+        const int nThreads = getNumThreads();
+        setNumThreads(1);
+
+        // the buffers grow to what the frames need
+        vector< vector< Point2f > > corners;
+        vector< int > ids;
+        for(int f = 0; f < nFrames; f++)
+            detector->detectMarkers(frames[f], corners, ids);
+
+        int allocations = 0;
+        bool same = true;
+        for(int f = 0; f < nFrames; f++) {
+            startCountingAllocations();
+            detector->detectMarkers(frames[f], corners, ids);
+            allocations += stopCountingAllocations();
+            same = same && ids == expectedIds[f] && corners == expectedCorners[f];
+        }
+        setNumThreads(nThreads);
+
+        EXPECT_EQ(0, allocations) << "color: " << color;
+        EXPECT_TRUE(same) << "color: " << color;
+    }
+}
+
+TEST(CV_ArucoDetector, statistics) {
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+    const int markerSidePixels = 80;
+    const int cells = 4;
+    Mat img(cells * 2 * markerSidePixels, cells * 2 * markerSidePixels, CV_8UC1, Scalar::all(255));
+    vector< Rect > markerRects;
+    for(int i = 0; i < cells * cells; i++) {
+        // the last marker is not in the dictionary
+        Mat marker;
+        if(i < cells * cells - 1)
+            aruco::drawMarker(dictionary, i, markerSidePixels, marker);
+        else
+            aruco::drawMarker(aruco::getPredefinedDictionary(aruco::DICT_6X6_1000), 999, markerSidePixels, marker);
+        Rect rect((i % cells) * 2 * markerSidePixels + markerSidePixels / 2,
+                  (i / cells) * 2 * markerSidePixels + markerSidePixels / 2, markerSidePixels, markerSidePixels);
+        marker.copyTo(img(rect));
+        markerRects.push_back(rect);
+    }
+
+    for(int method = 0; method < 2; method++) {
+        Ptr<aruco::DetectorParameters> params = aruco::DetectorParameters::create();
+        params->cornerRefinementMethod = method ? aruco::CORNER_REFINE_APRILTAG : aruco::CORNER_REFINE_NONE;
+        Ptr<aruco::ArucoDetector> detector = aruco::ArucoDetector::create(dictionary, params);
+
+        vector< vector< Point2f > > corners;
+        vector< int > ids;
+        detector->detectMarkers(img, corners, ids);
+        ASSERT_EQ((size_t)(cells * cells - 1), ids.size());
+        vector< Rect > regions(1, Rect(markerRects[0].tl() - Point(20, 20), markerRects[0].br() + Point(20, 20)));
+        detector->detectMarkers(img, corners, ids, regions);
+        ASSERT_EQ(1u, ids.size());
+
+        // every candidate is either kept or rejected for one reason
+        aruco::DetectorStatistics stats = detector->getStatistics();
+        EXPECT_EQ(2, stats.frames);
+        EXPECT_EQ(cells * cells, stats.markers);
+        EXPECT_GE(stats.rejectedDictionary, 1);
+        EXPECT_EQ(stats.candidates, stats.rejectedTooClose + stats.rejectedBorderBits + stats.rejectedDictionary +
+                                    stats.markers);
+        if(method == 0) {
+            EXPECT_EQ(stats.contours, stats.rejectedPerimeter + stats.rejectedShape + stats.rejectedCornerDistance +
+                                      stats.rejectedImageBorder + stats.candidates);
+        }
+        else
+            EXPECT_EQ(0, stats.contours);
+
+        const double stages = stats.greyTime + stats.thresholdTime + stats.contourTime + stats.filterTime +
+                              stats.bitsTime + stats.identifyTime + stats.refineTime;
+        EXPECT_GT(stats.totalTime, 0);
+        EXPECT_LE(stages, stats.totalTime);
+
+        detector->resetStatistics();
+        stats = detector->getStatistics();
+        EXPECT_EQ(0, stats.frames);
+        EXPECT_EQ(0, stats.candidates);
+        EXPECT_EQ(0, stats.totalTime);
+    }
+}
+
 }} // namespace
@@ -335,6 +335,35 @@ TEST(CV_ArucoRefine, accuracy) {
     test.safe_run();
 }
 
+TEST(CV_ArucoRefine, farRejectedCandidate)
+{
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_6X6_250);
+    Ptr<aruco::GridBoard> gridboard = aruco::GridBoard::create(3, 3, 0.02f, 0.005f, dictionary);
+    Ptr<aruco::Board> board = gridboard.staticCast<aruco::Board>();
+    Mat img;
+    gridboard->draw(Size(500, 500), img, 50);
+
+    vector< vector< Point2f > > corners, rejected;
+    vector< int > ids;
+    aruco::detectMarkers(img, dictionary, corners, ids);
+    ASSERT_EQ(gridboard->ids.size(), ids.size());
+
+    // the missing marker and a candidate far away on the same row: the centers are on a line,
+    // which must not make a grid of the whole distance
+    rejected.push_back(corners[0]);
+    rejected.push_back(corners[0]);
+    for(int c = 0; c < 4; c++)
+        rejected[1][c].x += 1e12f;
+    const int missingId = ids[0];
+    corners.erase(corners.begin());
+    ids.erase(ids.begin());
+
+    aruco::refineDetectedMarkers(img, board, corners, ids, rejected);
+    ASSERT_EQ(gridboard->ids.size(), ids.size());
+    EXPECT_EQ(missingId, ids.back());
+    EXPECT_EQ(1u, rejected.size());
+}
+
 TEST(CV_ArucoBoardPose, CheckNegativeZ)
 {
     double matrixData[9] = { -3.9062571886921410e+02, 0., 4.2350000000000000e+02,
@@ -3,6 +3,7 @@
 // of this distribution and at http://opencv.org/license.html.
 
 #include "test_precomp.hpp"
+#include "../src/aruco_internal.hpp"
 
 namespace opencv_test { namespace {
 
@@ -24,4 +25,631 @@ TEST(CV_ArucoDrawMarker, regression_1226)
     });
 }
 
+/**
+ * @brief Dictionary::identify as a scan over all the markers of the dictionary
+ */
+static bool identifyLinear(const Ptr<aruco::Dictionary> &dictionary, const Mat &bits,
+                           double maxCorrectionRate, int &idx, int &rotation)
+{
+    int maxCorrection = int(dictionary->maxCorrectionBits * maxCorrectionRate);
+    Mat candidate = aruco::Dictionary::getByteListFromBits(bits);
+    for (int m = 0; m < dictionary->bytesList.rows; m++)
+    {
+        int minDistance = dictionary->markerSize * dictionary->markerSize + 1;
+        for (int r = 0; r < 4; r++)
+        {
+            int distance = cv::hal::normHamming(dictionary->bytesList.ptr(m) + r * candidate.cols,
+                                                candidate.ptr(), candidate.cols);
+            if (distance < minDistance)
+            {
+                minDistance = distance;
+                rotation = r;
+            }
+        }
+        if (minDistance <= maxCorrection)
+        {
+            idx = m;
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST(CV_ArucoDictionary, identifySameAsLinearScan)
+{
+    RNG rng(0x4242);
+    const double rates[] = { 0., 0.6, 1. };
+    for (int name = aruco::DICT_4X4_50; name <= aruco::DICT_APRILTAG_36h11; name++)
+    {
+        // a copy of the markers, other tests edit the predefined ones in place
+        Ptr<aruco::Dictionary> dictionary = makePtr<aruco::Dictionary>(aruco::getPredefinedDictionary(name));
+        const int markerSize = dictionary->markerSize;
+        for (int i = 0; i < 300; i++)
+        {
+            // markers with a few flipped bits, and random codes
+            Mat bits(markerSize, markerSize, CV_8UC1);
+            if (i % 2 == 0)
+            {
+                int id = rng.uniform(0, dictionary->bytesList.rows);
+                aruco::Dictionary::getBitsFromByteList(dictionary->bytesList.row(id), markerSize).copyTo(bits);
+                int flips = rng.uniform(0, dictionary->maxCorrectionBits + 3);
+                for (int f = 0; f < flips; f++)
+                {
+                    uchar &bit = bits.at<uchar>(rng.uniform(0, markerSize), rng.uniform(0, markerSize));
+                    bit = (uchar)(1 - bit);
+                }
+            }
+            else
+                rng.fill(bits, RNG::UNIFORM, 0, 2);
+
+            for (size_t r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+            {
+                int expectedIdx = -1, expectedRotation = -1, idx = -1, rotation = -1;
+                bool expected = identifyLinear(dictionary, bits, rates[r], expectedIdx, expectedRotation);
+                ASSERT_EQ(expected, dictionary->identify(bits, idx, rotation, rates[r])) << "dictionary " << name;
+                if (expected)
+                {
+                    EXPECT_EQ(expectedIdx, idx) << "dictionary " << name;
+                    EXPECT_EQ(expectedRotation, rotation) << "dictionary " << name;
+                }
+            }
+        }
+    }
+}
+
+TEST(CV_ArucoDictionary, identifyAfterBytesListChange)
+{
+    Ptr<aruco::Dictionary> dictionary = aruco::generateCustomDictionary(10, 5, 7);
+    Mat bits = aruco::Dictionary::getBitsFromByteList(dictionary->bytesList.row(9), 5);
+    int idx = -1, rotation = -1;
+    ASSERT_TRUE(dictionary->identify(bits, idx, rotation, 0.));
+    EXPECT_EQ(9, idx);
+
+    // the lookup tables follow the new markers
+    dictionary->bytesList = dictionary->bytesList.rowRange(5, 10).clone();
+    ASSERT_TRUE(dictionary->identify(bits, idx, rotation, 0.));
+    EXPECT_EQ(4, idx);
+    dictionary->bytesList = dictionary->bytesList.rowRange(0, 4).clone();
+    EXPECT_FALSE(dictionary->identify(bits, idx, rotation, 0.));
+
+    // a copy given other markers keeps its own tables
+    Ptr<aruco::Dictionary> original = aruco::generateCustomDictionary(10, 5, 7);
+    aruco::Dictionary copy = *original;
+    copy.bytesList = original->bytesList.rowRange(8, 10).clone();
+    for (int i = 0; i < 3; i++)
+    {
+        ASSERT_TRUE(original->identify(bits, idx, rotation, 0.));
+        EXPECT_EQ(9, idx);
+        ASSERT_TRUE(copy.identify(bits, idx, rotation, 0.));
+        EXPECT_EQ(1, idx);
+    }
+
+    // the batch overload also sees bytes edited in place
+    vector<Mat> batch(1, bits);
+    vector<int> ids, rotations;
+    Mat nineBytes = original->bytesList.row(9).clone();
+    original->bytesList.row(0).copyTo(original->bytesList.row(9));
+    original->identify(batch, ids, rotations, 0.);
+    ASSERT_EQ(1u, ids.size());
+    EXPECT_EQ(-1, ids[0]);
+    nineBytes.copyTo(original->bytesList.row(9));
+    original->identify(batch, ids, rotations, 0.);
+    EXPECT_EQ(9, ids[0]);
+}
+
+TEST(CV_ArucoInternal, thresholdMultiScaleSameAsAdaptiveThreshold)
+{
+    RNG rng(0x7e57);
+    const int winSizes[] = { 3, 4, 5, 7, 13, 16, 23, 31, 53 };
+    const double constants[] = { 7., 0., -3., 2.5 };
+    for (int i = 0; i < 24; i++)
+    {
+        // odd sizes, some smaller than the windows, seen through a larger buffer
+        Size size(rng.uniform(1, 160) | 1, rng.uniform(1, 120) | 1);
+        Mat buffer(size.height + 4, size.width + 13, CV_8UC1);
+        Mat grey = buffer(Rect(5, 3, size.width, size.height));
+        rng.fill(grey, RNG::UNIFORM, 0, 256);
+        if (i % 2 == 0)
+        {
+            // flat areas, where the pixels are often exactly at the mean
+            blur(grey, grey, Size(9, 9));
+            grey &= 0xf0;
+        }
+
+        vector< int > sizes(winSizes, winSizes + sizeof(winSizes) / sizeof(winSizes[0]));
+        vector< Mat > thresholds(sizes.size()), outputs(sizes.size());
+        for (size_t k = 0; k < sizes.size(); k++)
+        {
+            // written in place when they have the size of the image
+            outputs[k].create(size.height + 2, size.width + 6, CV_8UC1);
+            thresholds[k] = outputs[k](Rect(3, 1, size.width, size.height));
+        }
+
+        for (size_t c = 0; c < sizeof(constants) / sizeof(constants[0]); c++)
+        {
+            aruco::internal::thresholdMultiScale(grey, sizes, constants[c], thresholds);
+            ASSERT_EQ(sizes.size(), thresholds.size());
+            for (size_t k = 0; k < sizes.size(); k++)
+            {
+                Mat expected;
+                adaptiveThreshold(grey, expected, 255, ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV,
+                                  sizes[k] | 1, constants[c]);
+                ASSERT_EQ(outputs[k].data + outputs[k].step + 3, thresholds[k].data);
+                EXPECT_EQ(0, cvtest::norm(expected, thresholds[k], NORM_INF))
+                    << "size " << size << " window " << sizes[k] << " constant " << constants[c];
+            }
+        }
+    }
+}
+
+TEST(CV_ArucoInternal, approxClosedContourSameAsApproxPolyDP)
+{
+    RNG rng(0xa99c);
+    const double epsilons[] = { 0., 0.5, 1., 2.5, 7. };
+    for (int i = 0; i < 400; i++)
+    {
+        vector< Point > contour;
+        const int count = i < 8 ? i : rng.uniform(1, 300);
+        if (i % 2 == 0)
+        {
+            // closed walks of unit steps, as traced borders are
+            Point p(rng.uniform(0, 100), rng.uniform(0, 100));
+            for (int k = 0; k < count; k++)
+            {
+                contour.push_back(p);
+                p += Point(rng.uniform(-1, 2), rng.uniform(-1, 2));
+            }
+        }
+        else
+        {
+            // polygons with long edges, repeated and collinear points
+            const double radius = rng.uniform(5., 200.);
+            for (int k = 0; k < count; k++)
+            {
+                double angle = 2 * CV_PI * k / count + rng.uniform(-0.2, 0.2);
+                double r = radius * (k % 7 == 0 ? 0.5 : 1.);
+                contour.push_back(Point(cvRound(r * std::cos(angle)), cvRound(r * std::sin(angle))));
+                if (k % 11 == 3)
+                    contour.push_back(contour.back());
+            }
+        }
+
+        for (size_t e = 0; e < sizeof(epsilons) / sizeof(epsilons[0]); e++)
+        {
+            double eps = epsilons[e] * (i % 3 == 0 ? contour.size() * 0.03 : 1.);
+            vector< Point > expected, approx(3, Point(-1, -1));
+            if (!contour.empty())
+                approxPolyDP(contour, expected, eps, true);
+            aruco::internal::approxClosedContour(contour, eps, approx);
+            EXPECT_EQ(expected, approx) << "contour " << i << " eps " << eps;
+        }
+    }
+}
+
+/**
+ * @brief Marker candidates of a binary image as findContours and approxPolyDP find them, with the
+ * checks of the detection
+ */
+static void findMarkerContours(const Mat &binary, double minPerimeterRate, double maxPerimeterRate,
+                               double accuracyRate, double minCornerDistanceRate, int minDistanceToBorder,
+                               vector< vector< Point2f > > &candidates, vector< vector< Point > > &contoursOut)
+{
+    const unsigned minPerimeterPixels = (unsigned)(minPerimeterRate * max(binary.cols, binary.rows));
+    const unsigned maxPerimeterPixels = (unsigned)(maxPerimeterRate * max(binary.cols, binary.rows));
+    vector< vector< Point > > contours;
+    findContours(binary.clone(), contours, RETR_LIST, CHAIN_APPROX_NONE);
+    candidates.clear();
+    contoursOut.clear();
+    for (size_t i = 0; i < contours.size(); i++)
+    {
+        if (contours[i].size() < minPerimeterPixels || contours[i].size() > maxPerimeterPixels)
+            continue;
+        vector< Point > approx;
+        approxPolyDP(contours[i], approx, double(contours[i].size()) * accuracyRate, true);
+        if (approx.size() != 4 || !isContourConvex(approx))
+            continue;
+        double minDistSq = max(binary.cols, binary.rows) * max(binary.cols, binary.rows);
+        for (int j = 0; j < 4; j++)
+        {
+            Point d = approx[j] - approx[(j + 1) % 4];
+            minDistSq = min(minDistSq, (double)d.x * d.x + (double)d.y * d.y);
+        }
+        double minCornerDistancePixels = double(contours[i].size()) * minCornerDistanceRate;
+        if (minDistSq < minCornerDistancePixels * minCornerDistancePixels)
+            continue;
+        bool tooNearBorder = false;
+        for (int j = 0; j < 4; j++)
+            tooNearBorder = tooNearBorder || approx[j].x < minDistanceToBorder || approx[j].y < minDistanceToBorder ||
+                            approx[j].x > binary.cols - 1 - minDistanceToBorder ||
+                            approx[j].y > binary.rows - 1 - minDistanceToBorder;
+        if (tooNearBorder)
+            continue;
+        vector< Point2f > candidate;
+        for (int j = 0; j < 4; j++)
+            candidate.push_back(Point2f((float)approx[j].x, (float)approx[j].y));
+        candidates.push_back(candidate);
+        contoursOut.push_back(contours[i]);
+    }
+}
+
+TEST(CV_ArucoInternal, traceMarkerContoursSameAsFindContours)
+{
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_4X4_50);
+    RNG rng(0xc047);
+    // the detection defaults, then looser checks with a small maximum perimeter
+    const double rates[2][5] = { { 0.03, 4., 0.03, 0.05, 3 }, { 0.01, 0.5, 0.1, 0., 0 } };
+    int accepted = 0;
+    for (int i = 0; i < 12; i++)
+    {
+        Size size(rng.uniform(64, 400), rng.uniform(64, 300));
+        Mat binary;
+        if (i % 3 == 0)
+        {
+            // markers, some cut by the image border, thresholded as the detection does
+            Mat img(size, CV_8UC1, Scalar::all(220));
+            for (int m = 0; m < 6; m++)
+            {
+                Mat marker;
+                int side = rng.uniform(16, 80);
+                aruco::drawMarker(dictionary, m, side, marker);
+                Mat transform = getRotationMatrix2D(Point2f(side / 2.f, side / 2.f), rng.uniform(0., 360.), 1.);
+                transform.at< double >(0, 2) += rng.uniform(-side / 2., (double)size.width - side / 2.);
+                transform.at< double >(1, 2) += rng.uniform(-side / 2., (double)size.height - side / 2.);
+                warpAffine(marker, img, transform, size, INTER_LINEAR, BORDER_TRANSPARENT);
+            }
+            Mat noise(size, CV_16SC1);
+            rng.fill(noise, RNG::NORMAL, 0, 6);
+            cv::add(img, noise, img, noArray(), CV_8U);
+            adaptiveThreshold(img, binary, 255, ADAPTIVE_THRESH_MEAN_C, THRESH_BINARY_INV, 13, 7);
+        }
+        else if (i % 3 == 1)
+        {
+            // blobs with holes and nested borders
+            Mat noise(size, CV_32FC1);
+            rng.fill(noise, RNG::UNIFORM, 0., 1.);
+            GaussianBlur(noise, noise, Size(0, 0), rng.uniform(1.5, 5.));
+            cv::compare(noise, mean(noise)[0], binary, CMP_GT);
+        }
+        else
+        {
+            // isolated pixels and thin lines
+            binary.create(size, CV_8UC1);
+            rng.fill(binary, RNG::UNIFORM, 0, 100);
+            cv::threshold(binary, binary, 80, 255, THRESH_BINARY);
+        }
+
+        for (int r = 0; r < 2; r++)
+        {
+            vector< vector< Point2f > > expectedCandidates, candidates;
+            vector< vector< Point > > expectedContours, contours;
+            findMarkerContours(binary, rates[r][0], rates[r][1], rates[r][2], rates[r][3], (int)rates[r][4],
+                               expectedCandidates, expectedContours);
+            aruco::internal::traceMarkerContours(binary, rates[r][0], rates[r][1], rates[r][2], rates[r][3],
+                                                 (int)rates[r][4], candidates, contours);
+            ASSERT_EQ(expectedCandidates.size(), candidates.size()) << "image " << i << " checks " << r;
+            for (size_t k = 0; k < candidates.size(); k++)
+            {
+                EXPECT_EQ(expectedCandidates[k], candidates[k]) << "image " << i << " checks " << r;
+                EXPECT_EQ(expectedContours[k], contours[k]) << "image " << i << " checks " << r;
+            }
+            accepted += (int)candidates.size();
+        }
+    }
+    EXPECT_GT(accepted, 20);
+}
+
+/**
+ * @brief Bits of a candidate from the warped image of its cell grid
+ */
+static Mat warpedBits(const Mat &image, const vector< Point2f > &corners, int markerSize, int markerBorderBits,
+                      int cellSize, double cellMarginRate, double minStdDevOtsu)
+{
+    int markerSizeWithBorders = markerSize + 2 * markerBorderBits;
+    int cellMarginPixels = int(cellMarginRate * cellSize);
+    int resultImgSize = markerSizeWithBorders * cellSize;
+    vector< Point2f > resultImgCorners;
+    resultImgCorners.push_back(Point2f(0, 0));
+    resultImgCorners.push_back(Point2f((float)resultImgSize - 1, 0));
+    resultImgCorners.push_back(Point2f((float)resultImgSize - 1, (float)resultImgSize - 1));
+    resultImgCorners.push_back(Point2f(0, (float)resultImgSize - 1));
+
+    Mat resultImg;
+    Mat transformation = getPerspectiveTransform(corners, resultImgCorners);
+    warpPerspective(image, resultImg, transformation, Size(resultImgSize, resultImgSize), INTER_NEAREST);
+
+    Mat bits(markerSizeWithBorders, markerSizeWithBorders, CV_8UC1, Scalar::all(0));
+    Mat innerRegion = resultImg.colRange(cellSize / 2, resultImg.cols - cellSize / 2)
+                          .rowRange(cellSize / 2, resultImg.rows - cellSize / 2);
+    Scalar mean, stddev;
+    meanStdDev(innerRegion, mean, stddev);
+    if (stddev[0] < minStdDevOtsu)
+    {
+        if (mean[0] > 127)
+            bits.setTo(1);
+        return bits;
+    }
+
+    cv::threshold(resultImg, resultImg, 125, 255, THRESH_BINARY | THRESH_OTSU);
+    for (int y = 0; y < markerSizeWithBorders; y++)
+    {
+        for (int x = 0; x < markerSizeWithBorders; x++)
+        {
+            Mat square = resultImg(Rect(x * cellSize + cellMarginPixels, y * cellSize + cellMarginPixels,
+                                        cellSize - 2 * cellMarginPixels, cellSize - 2 * cellMarginPixels));
+            if ((size_t)countNonZero(square) > square.total() / 2)
+                bits.at< uchar >(y, x) = 1;
+        }
+    }
+    return bits;
+}
+
+TEST(CV_ArucoInternal, extractBitsSameAsWarpedCells)
+{
+    Ptr<aruco::Dictionary> dictionary = aruco::getPredefinedDictionary(aruco::DICT_5X5_50);
+    RNG rng(0xb175);
+    const double margins[] = { 0., 0.13, 0.3, 0.5 };
+    const int cellSizes[] = { 3, 4, 8 };
+    int flat = 0;
+    for (int i = 0; i < 60; i++)
+    {
+        // a marker seen in perspective, on a noisy background
+        Mat image(240, 320, CV_8UC1);
+        rng.fill(image, RNG::UNIFORM, 0, 256);
+        GaussianBlur(image, image, Size(0, 0), 3.);
+        Mat marker;
+        aruco::drawMarker(dictionary, i % 50, 70, marker, 1 + i % 2);
+        vector< Point2f > square, corners;
+        square.push_back(Point2f(0, 0));
+        square.push_back(Point2f(69, 0));
+        square.push_back(Point2f(69, 69));
+        square.push_back(Point2f(0, 69));
+        Point2f center(rng.uniform(60.f, 260.f), rng.uniform(60.f, 180.f));
+        for (int c = 0; c < 4; c++)
+        {
+            float angle = (float)(CV_PI / 2 * c + rng.uniform(-0.4, 0.4) + CV_PI * 1.25);
+            float radius = rng.uniform(30.f, 80.f);
+            corners.push_back(center + radius * Point2f(std::cos(angle), std::sin(angle)));
+        }
+        warpPerspective(marker, image, getPerspectiveTransform(square, corners), image.size(), INTER_LINEAR,
+                        BORDER_TRANSPARENT);
+
+        // candidate corners off by a few pixels, sometimes outside of the image
+        for (int c = 0; c < 4; c++)
+            corners[c] += Point2f(rng.uniform(-3.f, 3.f), rng.uniform(-3.f, 3.f));
+        if (i % 10 == 9)
+            corners[i % 4] += Point2f(-300.f, -200.f);
+
+        for (int k = 0; k < 3; k++)
+        {
+            const int markerBorderBits = 1 + i % 2, cellSize = cellSizes[k];
+            const double margin = margins[(i + k) % 4], minStdDevOtsu = (i % 3) ? 5. : 40.;
+            Mat expected = warpedBits(image, corners, dictionary->markerSize, markerBorderBits, cellSize, margin,
+                                      minStdDevOtsu);
+            Mat bits;
+            aruco::internal::extractBits(image, corners, dictionary->markerSize, markerBorderBits, cellSize,
+                                         margin, minStdDevOtsu, bits);
+            ASSERT_EQ(expected.size(), bits.size());
+            EXPECT_EQ(0, cvtest::norm(expected, bits, NORM_INF))
+                << "image " << i << " cell size " << cellSize << " margin " << margin;
+            flat += countNonZero(expected) == 0 || countNonZero(expected) == (int)expected.total();
+        }
+    }
+    // both the uniform candidates and the ones thresholded with Otsu are covered
+    EXPECT_GT(flat, 0);
+    EXPECT_LT(flat, 60);
+}
+
+/**
+ * AprilTag edge image as apriltag_quad_thresh computed it before the tiles were vectorized: the
+ * extrema of 4x4 tiles, spread to their 3x3 neighbours, then 127 on the low contrast tiles and the
+ * mid-range elsewhere, the partial tiles of the borders using the last full tile
+ */
+static Mat tileThreshold(const Mat &grey, int minWhiteBlackDiff)
+{
+    const int tilesz = 4, w = grey.cols, h = grey.rows, tw = w / tilesz, th = h / tilesz;
+    Mat_<uchar> tileMax(th, tw), tileMin(th, tw);
+    for (int ty = 0; ty < th; ty++)
+        for (int tx = 0; tx < tw; tx++)
+        {
+            uchar max = 0, min = 255;
+            for (int dy = 0; dy < tilesz; dy++)
+                for (int dx = 0; dx < tilesz; dx++)
+                {
+                    uchar v = grey.at<uchar>(ty * tilesz + dy, tx * tilesz + dx);
+                    min = std::min(min, v);
+                    max = std::max(max, v);
+                }
+            tileMax(ty, tx) = max;
+            tileMin(ty, tx) = min;
+        }
+
+    Mat_<uchar> blurredMax(th, tw), blurredMin(th, tw);
+    for (int ty = 0; ty < th; ty++)
+        for (int tx = 0; tx < tw; tx++)
+        {
+            uchar max = 0, min = 255;
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    if (ty + dy < 0 || ty + dy >= th || tx + dx < 0 || tx + dx >= tw)
+                        continue;
+                    max = std::max(max, tileMax(ty + dy, tx + dx));
+                    min = std::min(min, tileMin(ty + dy, tx + dx));
+                }
+            blurredMax(ty, tx) = max;
+            blurredMin(ty, tx) = min;
+        }
+
+    Mat_<uchar> thresh(h, w);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++)
+        {
+            int ty = std::min(y / tilesz, th - 1), tx = std::min(x / tilesz, tw - 1);
+            int max = blurredMax(ty, tx), min = blurredMin(ty, tx);
+            bool fullTile = y < th * tilesz && x < tw * tilesz;
+            if (fullTile && max - min < minWhiteBlackDiff)
+                thresh(y, x) = 127;
+            else
+                thresh(y, x) = grey.at<uchar>(y, x) > min + (max - min) / 2 ? 255 : 0;
+        }
+    return thresh;
+}
+
+TEST(CV_ArucoInternal, aprilTagThresholdSameAsScalarTiles)
+{
+    RNG rng(0x71e5);
+    const int diffs[] = { 0, 1, 5, 20, 60, 256 };
+    for (int i = 0; i < 40; i++)
+    {
+        // odd sizes, up to rows of tiles wider than the widest vectors, seen through a larger buffer
+        Size size(rng.uniform(4, 300) | 1, rng.uniform(4, 90) | 1);
+        Mat buffer(size.height + 3, size.width + 11, CV_8UC1);
+        Mat grey = buffer(Rect(7, 2, size.width, size.height));
+        switch (i % 4)
+        {
+        case 0: // noise
+            rng.fill(grey, RNG::UNIFORM, 0, 256);
+            break;
+        case 1: // smooth, with tiles of every contrast
+            rng.fill(grey, RNG::UNIFORM, 0, 256);
+            blur(grey, grey, Size(15, 15));
+            break;
+        case 2: // flat
+            grey.setTo(rng.uniform(0, 256));
+            break;
+        default: // sharp edges on a flat background, as markers have
+            grey.setTo(200);
+            for (int k = 0; k < 6; k++)
+                rectangle(grey, Rect(rng.uniform(0, size.width), rng.uniform(0, size.height),
+                                     rng.uniform(1, 30), rng.uniform(1, 30)),
+                          Scalar(rng.uniform(0, 60)), FILLED);
+        }
+
+        for (size_t d = 0; d < sizeof(diffs) / sizeof(diffs[0]); d++)
+        {
+            Mat thresh;
+            aruco::internal::aprilTagThreshold(grey, diffs[d], thresh);
+            ASSERT_EQ(grey.size(), thresh.size());
+            EXPECT_EQ(0, cvtest::norm(tileThreshold(grey, diffs[d]), thresh, NORM_INF))
+                << "size " << size << " min white black diff " << diffs[d];
+        }
+    }
+}
+
+TEST(CV_ArucoPose, squareMarkersSameAsSolvePnPIppeSquare)
+{
+    RNG rng(0x1bbe);
+    const float markerLength = 0.05f;
+    Mat cameraMatrix = (Mat_<double>(3, 3) << 800, 0, 320, 0, 780, 240, 0, 0, 1);
+    Mat objPoints = (Mat_<Vec3f>(4, 1) << Vec3f(-markerLength / 2.f, markerLength / 2.f, 0),
+                     Vec3f(markerLength / 2.f, markerLength / 2.f, 0),
+                     Vec3f(markerLength / 2.f, -markerLength / 2.f, 0),
+                     Vec3f(-markerLength / 2.f, -markerLength / 2.f, 0));
+
+    for (int distorted = 0; distorted < 2; distorted++)
+    {
+        Mat distCoeffs = Mat::zeros(1, 5, CV_64F);
+        if (distorted)
+            distCoeffs = (Mat_<double>(1, 5) << 0.1, -0.2, 0.001, -0.002, 0.05);
+
+        // enough markers for the vector path and a scalar tail, with noise on the corners
+        // so that the two solutions differ in error
+        const int nMarkers = 23;
+        vector< vector< Point2f > > corners(nMarkers);
+        for (int i = 0; i < nMarkers; i++)
+        {
+            Vec3d rvec(rng.uniform(-0.8, 0.8), rng.uniform(-0.8, 0.8), rng.uniform(-3., 3.));
+            Vec3d tvec(rng.uniform(-0.1, 0.1), rng.uniform(-0.1, 0.1), rng.uniform(0.2, 0.6));
+            projectPoints(objPoints, rvec, tvec, cameraMatrix, distCoeffs, corners[i]);
+            for (int c = 0; c < 4; c++)
+                corners[i][c] += Point2f((float)rng.gaussian(0.3), (float)rng.gaussian(0.3));
+        }
+
+        vector< Vec3d > rvecs, tvecs, rvecs2, tvecs2;
+        vector< Vec2d > errors;
+        aruco::estimatePoseSquareMarkers(corners, markerLength, cameraMatrix, distCoeffs, rvecs, tvecs,
+                                         rvecs2, tvecs2, errors);
+        ASSERT_EQ((size_t)nMarkers, rvecs.size());
+        ASSERT_EQ((size_t)nMarkers, rvecs2.size());
+        ASSERT_EQ((size_t)nMarkers, errors.size());
+
+        for (int i = 0; i < nMarkers; i++)
+        {
+            vector< Mat > expectedRvecs, expectedTvecs;
+            Mat expectedErrors(2, 1, CV_64F);
+            ASSERT_EQ(2, solvePnPGeneric(objPoints, corners[i], cameraMatrix, distCoeffs, expectedRvecs,
+                                         expectedTvecs, false, SOLVEPNP_IPPE_SQUARE, noArray(), noArray(),
+                                         expectedErrors));
+            EXPECT_LE(cvtest::norm(expectedRvecs[0], Mat(rvecs[i]), NORM_INF), 1e-6) << "marker " << i;
+            EXPECT_LE(cvtest::norm(expectedTvecs[0], Mat(tvecs[i]), NORM_INF), 1e-6) << "marker " << i;
+            EXPECT_LE(cvtest::norm(expectedRvecs[1], Mat(rvecs2[i]), NORM_INF), 1e-6) << "marker " << i;
+            EXPECT_LE(cvtest::norm(expectedTvecs[1], Mat(tvecs2[i]), NORM_INF), 1e-6) << "marker " << i;
+            EXPECT_LE(errors[i][0], errors[i][1]) << "marker " << i;
+
+            // the errors are measured after undistortion, so they are the same without distortion
+            if (!distorted)
+            {
+                EXPECT_NEAR(expectedErrors.at<double>(0), errors[i][0], 1e-4) << "marker " << i;
+                EXPECT_NEAR(expectedErrors.at<double>(1), errors[i][1], 1e-4) << "marker " << i;
+            }
+        }
+
+        // all the corners in one array
+        Mat packed((int)corners.size() * 4, 1, CV_32FC2);
+        for (int i = 0; i < nMarkers; i++)
+            Mat(corners[i]).copyTo(packed.rowRange(4 * i, 4 * i + 4));
+        vector< Vec3d > packedRvecs, packedTvecs;
+        aruco::estimatePoseSquareMarkers(packed, markerLength, cameraMatrix, distCoeffs, packedRvecs, packedTvecs);
+        EXPECT_EQ(0, cvtest::norm(Mat(rvecs), Mat(packedRvecs), NORM_INF));
+        EXPECT_EQ(0, cvtest::norm(Mat(tvecs), Mat(packedTvecs), NORM_INF));
+    }
+}
+
+TEST(CV_ArucoPose, squareMarkersRotationNearPi)
+{
+    // a marker facing the camera upside down, whose rotation is close to pi
+    const float markerLength = 0.05f;
+    Mat cameraMatrix = (Mat_<double>(3, 3) << 1920, 0, 960, 0, 1920, 540, 0, 0, 1);
+    vector< Point3f > objPoints;
+    objPoints.push_back(Point3f(-markerLength / 2.f, markerLength / 2.f, 0));
+    objPoints.push_back(Point3f(markerLength / 2.f, markerLength / 2.f, 0));
+    objPoints.push_back(Point3f(markerLength / 2.f, -markerLength / 2.f, 0));
+    objPoints.push_back(Point3f(-markerLength / 2.f, -markerLength / 2.f, 0));
+    const double angles[] = { CV_PI - 1e-3, CV_PI - 1e-6, CV_PI };
+    for (size_t a = 0; a < sizeof(angles) / sizeof(angles[0]); a++)
+    {
+        Vec3d axis(0.995, -0.0998, 0.);
+        Vec3d rvec = axis * (angles[a] / cv::norm(axis)), tvec(0.07, 0.008, 0.8);
+        vector< vector< Point2f > > corners(1);
+        projectPoints(objPoints, rvec, tvec, cameraMatrix, noArray(), corners[0]);
+
+        vector< Vec3d > rvecs, tvecs;
+        aruco::estimatePoseSquareMarkers(corners, markerLength, cameraMatrix, noArray(), rvecs, tvecs);
+        Matx33d expected, estimated;
+        Rodrigues(rvec, expected);
+        Rodrigues(rvecs[0], estimated);
+        EXPECT_LE(cvtest::norm(Mat(expected), Mat(estimated), NORM_INF), 1e-4) << "angle " << angles[a];
+        EXPECT_LE(cvtest::norm(Mat(tvec), Mat(tvecs[0]), NORM_INF), 1e-4) << "angle " << angles[a];
+    }
+}
+
+TEST(CV_ArucoPose, squareMarkersDegenerate)
+{
+    Mat cameraMatrix = (Mat_<double>(3, 3) << 800, 0, 320, 0, 800, 240, 0, 0, 1);
+    vector< vector< Point2f > > corners(1, vector< Point2f >(4, Point2f(100, 100)));
+    vector< Vec3d > rvecs, tvecs;
+    vector< Vec2d > errors;
+    aruco::estimatePoseSquareMarkers(corners, 0.05f, cameraMatrix, noArray(), rvecs, tvecs, noArray(), noArray(),
+                                     errors);
+    ASSERT_EQ(1u, rvecs.size());
+    EXPECT_EQ(Vec3d(0, 0, 0), rvecs[0]);
+    EXPECT_EQ(Vec3d(0, 0, 0), tvecs[0]);
+    EXPECT_TRUE(cvIsInf(errors[0][0]) && cvIsInf(errors[0][1]));
+
+    // no marker, no pose
+    corners.clear();
+    aruco::estimatePoseSquareMarkers(corners, 0.05f, cameraMatrix, noArray(), rvecs, tvecs);
+    EXPECT_TRUE(rvecs.empty() && tvecs.empty());
+}
+
 }} // namespace
@@ -10,4 +10,12 @@
 #include "opencv2/aruco.hpp"
 #include <opencv2/aruco/charuco.hpp>
 
+namespace opencv_test {
+
+// Heap allocations made by the binary between the two calls (test_allocation.cpp)
+void startCountingAllocations();
+int stopCountingAllocations();
+
+} // namespace
+
 #endif
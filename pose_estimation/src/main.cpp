@@ -4,6 +4,8 @@
 #include <cstdlib>
 
 #include "fdcl_common.hpp"
+#include "fdcl_pipeline.hpp"
+#include "fdcl_tracker.hpp"
 
 
 int main(int argc, char **argv)
@@ -41,6 +43,10 @@ int main(int argc, char **argv)
     cv::Ptr<cv::aruco::Dictionary> dictionary =
         cv::aruco::getPredefinedDictionary( \
         cv::aruco::PREDEFINED_DICTIONARY_NAME(dictionary_id));
+    fdcl::MarkerTracker tracker(dictionary, parser.get<int>("t"));
+    tracker.filter_poses(parser.get<double>("f"));
+    const bool print_statistics = parser.get<bool>("s");
+    int64_t last_report = fdcl::now_ns();
 
 
     cv::FileStorage fs("../../calibration_params.yml", cv::FileStorage::READ);
@@ -55,7 +61,7 @@ int main(int argc, char **argv)
 
         std::vector<int> ids;
         std::vector<std::vector<cv::Point2f> > corners;
-        cv::aruco::detectMarkers(image, dictionary, corners, ids);
+        tracker.detect(image, corners, ids);
 
         // if at least one marker detected
         if (ids.size() > 0)
@@ -63,7 +69,7 @@ int main(int argc, char **argv)
             cv::aruco::drawDetectedMarkers(image_copy, corners, ids);
 
             std::vector<cv::Vec3d> rvecs, tvecs;
-            cv::aruco::estimatePoseSingleMarkers(corners, marker_length_m,
+            tracker.estimate_pose(corners, ids, marker_length_m,
                     camera_matrix, dist_coeffs, rvecs, tvecs);
                     
             std::cout << "Translation: " << tvecs[0]
@@ -86,6 +92,11 @@ int main(int argc, char **argv)
             }
         }
 
+        if (print_statistics && fdcl::now_ns() - last_report > 1000000000) {
+            last_report = fdcl::now_ns();
+            std::cout << tracker.detector_report_and_reset() << std::endl;
+        }
+
         imshow("Pose estimation", image_copy);
         char key = (char)cv::waitKey(wait_time);
         if (key == 27) {
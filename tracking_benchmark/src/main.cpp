@@ -0,0 +1,289 @@
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+#include <iostream>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "fdcl_common.hpp"
+#include "fdcl_pipeline.hpp"
+#include "fdcl_tracker.hpp"
+
+// Markers on a desk: a few markers drifting and turning slowly, with sensor
+// noise, so the benchmark needs no camera and gives the same frames each run.
+class SyntheticScene {
+public:
+    SyntheticScene(const cv::Ptr<cv::aruco::Dictionary>& dictionary, cv::Size size, int markers)
+        : size(size) {
+        for (int id = 0; id < markers; id++) {
+            cv::Mat marker;
+            cv::aruco::drawMarker(dictionary, id, 120, marker, 1);
+            // white quiet zone around the marker
+            cv::copyMakeBorder(marker, marker, 30, 30, 30, 30, cv::BORDER_CONSTANT, cv::Scalar(255));
+            cv::cvtColor(marker, marker, cv::COLOR_GRAY2BGR);
+            images.push_back(marker);
+        }
+    }
+
+    void render(int frame, cv::Mat& out) const {
+        out.create(size, CV_8UC3);
+        out.setTo(cv::Scalar(90, 100, 110));
+        for (size_t i = 0; i < images.size(); i++) {
+            double phase = frame * 0.01 + i * 1.7;
+            cv::Point2f center(size.width * (i + 1.f) / (images.size() + 1) + 20 * std::cos(phase),
+                               size.height / 2.f + 40 * std::sin(phase * 0.7));
+            cv::Mat transform = cv::getRotationMatrix2D(
+                cv::Point2f(images[i].cols / 2.f, images[i].rows / 2.f), 15 * std::sin(phase), 1.0);
+            transform.at<double>(0, 2) += center.x - images[i].cols / 2.f;
+            transform.at<double>(1, 2) += center.y - images[i].rows / 2.f;
+            cv::warpAffine(images[i], out, transform, size, cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+        }
+        cv::Mat noise(size, CV_16SC3);
+        cv::RNG rng(frame);
+        rng.fill(noise, cv::RNG::NORMAL, 0, 4);
+        cv::add(out, noise, out, cv::noArray(), CV_8U);
+    }
+
+private:
+    cv::Size size;
+    std::vector<cv::Mat> images;
+};
+
+struct RunResult {
+    int frames = 0;
+    int full_detections = 0;
+    int64_t total_ns = 0;
+    double translation_jitter = 0; // RMS second difference of tvec [m]
+    double rotation_jitter = 0;    // RMS change of the frame-to-frame rotation [rad]
+    int64_t pose_ns = 0;           // part of total_ns spent in estimate_pose
+    int64_t tracked_solves = 0;    // solves of markers tracked from a previous pose
+    int64_t tracked_iterations = 0; // solvePnP iterations for those, from where they started
+};
+
+// Reprojection error of a pose, as minimized by solvePnP SOLVEPNP_ITERATIVE.
+class ReprojectionError : public cv::LMSolver::Callback {
+public:
+    ReprojectionError(const std::vector<cv::Point3f>& object_points, const std::vector<cv::Point2f>& image_points,
+                      const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs)
+        : object_points(object_points), image_points(image_points), camera_matrix(camera_matrix),
+          dist_coeffs(dist_coeffs) {}
+
+    bool compute(cv::InputArray param, cv::OutputArray err, cv::OutputArray J) const override {
+        cv::Mat pose = param.getMat();
+        std::vector<cv::Point2f> projected;
+        if (J.needed()) {
+            cv::Mat jacobian;
+            cv::projectPoints(object_points, pose.rowRange(0, 3), pose.rowRange(3, 6), camera_matrix, dist_coeffs,
+                              projected, jacobian);
+            jacobian.colRange(0, 6).copyTo(J);
+        } else {
+            cv::projectPoints(object_points, pose.rowRange(0, 3), pose.rowRange(3, 6), camera_matrix, dist_coeffs,
+                              projected);
+        }
+        err.create((int)projected.size() * 2, 1, CV_64F);
+        cv::Mat e = err.getMat();
+        for (size_t i = 0; i < projected.size(); i++) {
+            e.at<double>((int)(2 * i)) = projected[i].x - image_points[i].x;
+            e.at<double>((int)(2 * i + 1)) = projected[i].y - image_points[i].y;
+        }
+        return true;
+    }
+
+private:
+    const std::vector<cv::Point3f>& object_points;
+    const std::vector<cv::Point2f>& image_points;
+    const cv::Mat& camera_matrix;
+    const cv::Mat& dist_coeffs;
+};
+
+// Levenberg-Marquardt iterations solvePnP SOLVEPNP_ITERATIVE needs from a
+// pose, which it does not report: the same minimization (at most 20
+// iterations, to FLT_EPSILON) run with cv::LMSolver.
+int pnpIterations(const std::vector<cv::Point3f>& object_points, const std::vector<cv::Point2f>& image_points,
+                  const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs, const cv::Vec3d& rvec,
+                  const cv::Vec3d& tvec) {
+    cv::Mat pose = (cv::Mat_<double>(6, 1) << rvec[0], rvec[1], rvec[2], tvec[0], tvec[1], tvec[2]);
+    cv::Ptr<cv::LMSolver> solver = cv::LMSolver::create(
+        cv::makePtr<ReprojectionError>(object_points, image_points, camera_matrix, dist_coeffs), 20, FLT_EPSILON);
+    return solver->run(pose);
+}
+
+// Accumulates the second difference of each marker's pose over consecutive
+// frames; a marker moving at constant speed contributes nothing.
+class JitterMeter {
+public:
+    void add(int frame, const std::vector<int>& ids, const std::vector<cv::Vec3d>& rvecs,
+             const std::vector<cv::Vec3d>& tvecs) {
+        for (size_t i = 0; i < ids.size(); i++) {
+            History& h = history[ids[i]];
+            if (h.frame + 1 != frame) {
+                h.count = 0;
+            }
+            h.frame = frame;
+            h.r[0] = h.r[1]; h.r[1] = h.r[2]; h.r[2] = rvecs[i];
+            h.t[0] = h.t[1]; h.t[1] = h.t[2]; h.t[2] = tvecs[i];
+            if (++h.count >= 3) {
+                translation += cv::norm(h.t[2] - 2 * h.t[1] + h.t[0], cv::NORM_L2SQR);
+                // angle between the rotation from frame k-1 to k and the
+                // one from k-2 to k-1; rvecs wrap around at pi, matrices do not
+                cv::Matx33d r0, r1, r2;
+                cv::Rodrigues(h.r[0], r0);
+                cv::Rodrigues(h.r[1], r1);
+                cv::Rodrigues(h.r[2], r2);
+                cv::Vec3d change;
+                cv::Rodrigues((r2 * r1.t()) * (r1 * r0.t()).t(), change);
+                rotation += change.dot(change);
+                samples++;
+            }
+        }
+    }
+
+    void result(RunResult& run) const {
+        run.translation_jitter = samples > 0 ? std::sqrt(translation / samples) : 0;
+        run.rotation_jitter = samples > 0 ? std::sqrt(rotation / samples) : 0;
+    }
+
+private:
+    struct History {
+        int frame = -2;
+        int count = 0;
+        cv::Vec3d r[3], t[3];
+    };
+    std::map<int, History> history;
+    double translation = 0, rotation = 0;
+    int64_t samples = 0;
+};
+
+int main(int argc, char **argv) {
+    cv::CommandLineParser parser(argc, argv, fdcl::keys);
+
+    const char* about = "Compare full-frame detection with marker tracking";
+    auto success = parse_inputs(parser, about);
+    if (!success) {
+        return 1;
+    }
+
+    int dictionary_id = parser.get<int>("d");
+    float marker_length_m = parser.has("l") ? parser.get<float>("l") : 0.05f;
+    int interval = parser.get<int>("t") > 0 ? parser.get<int>("t") : 10;
+    double filter_gain = parser.get<double>("f") > 0 ? parser.get<double>("f") : 0.5;
+    const int synthetic_frames = 300;
+
+    cv::Ptr<cv::aruco::Dictionary> dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::PREDEFINED_DICTIONARY_NAME(dictionary_id));
+    SyntheticScene scene(dictionary, cv::Size(1920, 1080), 4);
+
+    cv::Mat camera_matrix, dist_coeffs;
+    cv::FileStorage fs("../../calibration_params.yml", cv::FileStorage::READ);
+    if (fs.isOpened()) {
+        fs["camera_matrix"] >> camera_matrix;
+        fs["distortion_coefficients"] >> dist_coeffs;
+    }
+
+    const float half = marker_length_m / 2.f;
+    const std::vector<cv::Point3f> object_points = {
+        cv::Point3f(-half, half, 0), cv::Point3f(half, half, 0),
+        cv::Point3f(half, -half, 0), cv::Point3f(-half, -half, 0)
+    };
+
+    auto run = [&](int redetect_interval, double gain, RunResult& result) -> bool {
+        cv::VideoCapture in_video;
+        if (parser.has("v") && !parse_video_in(in_video, parser)) {
+            return false;
+        }
+
+        fdcl::MarkerTracker tracker(dictionary, redetect_interval);
+        tracker.filter_poses(gain);
+        JitterMeter jitter;
+        cv::Mat image;
+        std::vector<int> ids;
+        std::vector<std::vector<cv::Point2f>> corners;
+        std::vector<cv::Vec3d> rvecs, tvecs;
+
+        for (int frame = 0; ; frame++) {
+            if (in_video.isOpened()) {
+                if (!in_video.read(image)) {
+                    break;
+                }
+            } else if (frame < synthetic_frames) {
+                scene.render(frame, image);
+            } else {
+                break;
+            }
+
+            if (camera_matrix.empty()) {
+                double f = image.cols;
+                camera_matrix = (cv::Mat_<double>(3, 3) << f, 0, image.cols / 2.0, 0, f, image.rows / 2.0, 0, 0, 1);
+                dist_coeffs = cv::Mat::zeros(1, 5, CV_64F);
+            }
+
+            int64_t start = fdcl::now_ns();
+            tracker.detect(image, corners, ids);
+            int64_t pose_start = fdcl::now_ns();
+            if (ids.size() > 0) {
+                tracker.estimate_pose(corners, ids, marker_length_m, camera_matrix, dist_coeffs, rvecs, tvecs);
+            }
+            result.pose_ns += fdcl::now_ns() - pose_start;
+            result.total_ns += fdcl::now_ns() - start;
+
+            result.frames++;
+            result.full_detections += tracker.last_was_full() ? 1 : 0;
+            if (ids.size() > 0) {
+                jitter.add(frame, ids, rvecs, tvecs);
+            }
+
+            // iterations from the pose solvePnP started from: the last pose
+            // without filter, the seed chosen by the filter with it
+            if (redetect_interval > 0 && ids.size() > 0) {
+                const std::vector<fdcl::MarkerTracker::PoseSeed>& seeds = tracker.last_seeds();
+                for (size_t i = 0; i < seeds.size(); i++) {
+                    if (!seeds[i].tracked) {
+                        continue;
+                    }
+                    result.tracked_solves++;
+                    result.tracked_iterations += pnpIterations(object_points, corners[i], camera_matrix,
+                                                               dist_coeffs, seeds[i].rvec, seeds[i].tvec);
+                }
+            }
+        }
+        jitter.result(result);
+        return result.frames > 0;
+    };
+
+    RunResult full, tracked, filtered;
+    if (!run(0, 0, full) || !run(interval, 0, tracked) || !run(interval, filter_gain, filtered)) {
+        std::cerr << "No frames to benchmark\n";
+        return 1;
+    }
+
+    auto print = [](const std::string& name, const RunResult& r) {
+        double ms = r.total_ns / 1e6 / r.frames;
+        std::cout << name << ": " << r.frames << " frames, " << r.full_detections
+                  << " full detections, " << ms << " ms/frame (" << 1000.0 / ms << " fps, pose "
+                  << r.pose_ns / 1e6 / r.frames << " ms), jitter "
+                  << r.translation_jitter * 1000 << " mm, " << r.rotation_jitter * 180 / CV_PI << " deg\n";
+    };
+    print("full detection", full);
+    print("tracking (t=" + std::to_string(interval) + ")", tracked);
+    std::cout << "speed-up: " << (double)full.total_ns / tracked.total_ns << "x, jitter change: "
+              << (tracked.translation_jitter - full.translation_jitter) * 1000 << " mm, "
+              << (tracked.rotation_jitter - full.rotation_jitter) * 180 / CV_PI << " deg\n";
+
+    print("tracking (t=" + std::to_string(interval) + ") + pose filter (f=" + cv::format("%g", filter_gain) + ")",
+          filtered);
+    std::cout << "jitter reduction by the filter: "
+              << 100 * (1 - filtered.translation_jitter / std::max(tracked.translation_jitter, DBL_MIN))
+              << "% translation, "
+              << 100 * (1 - filtered.rotation_jitter / std::max(tracked.rotation_jitter, DBL_MIN))
+              << "% rotation\n";
+    if (tracked.tracked_solves > 0 && filtered.tracked_solves > 0) {
+        double without = (double)tracked.tracked_iterations / tracked.tracked_solves;
+        double with = (double)filtered.tracked_iterations / filtered.tracked_solves;
+        std::cout << "solvePnP iterations per tracked marker: " << without << " re-solving from the last pose ("
+                  << tracked.tracked_solves << " solves), " << with << " from the filter's seed ("
+                  << filtered.tracked_solves << " solves), " << tracked.tracked_iterations - filtered.tracked_iterations
+                  << " saved over the run; pose estimation "
+                  << 100 * (1 - (double)filtered.pose_ns / tracked.pose_ns) << "% faster than without filter\n";
+    }
+
+    return 0;
+}